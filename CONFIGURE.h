@@ -75,6 +75,26 @@
 
 // #define HAS_SRANDDEV 1
 
+/***************************************
+ * HAS_ZLIB
+ * Read gzip compressed iTunes XML (Library.xml.gz).
+ *
+ * NOTE: Also uncomment "# LDFLAGS+=-lz" in configure.mk
+ * (on Deb-like, the headers are in zlib1g-dev).
+ */
+
+// #define HAS_ZLIB 1
+
+/***************************************
+ * HAS_ZSTD
+ * Read zstd compressed iTunes XML (Library.xml.zst).
+ *
+ * NOTE: Also uncomment "# LDFLAGS+=-lzstd" in configure.mk
+ * (on Deb-like, the headers are in libzstd-dev).
+ */
+
+// #define HAS_ZSTD 1
+
 #endif /* CCOONNFFIIGGUURREE_H */
 /**
  * vim: sw=4 ts=4 expandtab
@@ -0,0 +1,941 @@
+/****************************************************************************
+ * File: cache.c
+ *
+ * Binary library snapshot, so an unchanged XML is not parsed again.
+ *
+ * After a successful parse, the stored tracks, the wanted playlists and
+ * their members are written to one file: a fixed header, then flat
+ * arrays that point into a string pool by offset.  The next run maps it
+ * and, if the XML still has the same size, mtime and content hash, fills
+ * storage from it directly.
+ *
+ * A parse only keeps what that run needs (see trackProject() and
+ * listProject()), so the header also records which track fields and
+ * which playlist names were asked for.  A run that needs more than that
+ * parses the XML and writes a new snapshot.  Anything that doesn't add
+ * up (short file, bad offsets, body hash) is treated as no snapshot.
+ *
+ * With --incremental, tracks also keep their Persistent ID and Date
+ * Modified.  A snapshot of an XML that has since changed is then kept
+ * mapped while the new one is parsed: a track whose Persistent ID and
+ * Date Modified both match is copied from it (set_node skips the rest of
+ * its values), and a playlist whose members are all such copies, in the
+ * same order, is not written again.  Track IDs are renumbered on every
+ * export, so only Persistent IDs are compared between the two.
+ *
+ * Copyright (c) 2019-2024, Gary Allen Vollink.  http://voll.ink/playlister
+ * All rights reserved.
+ *
+ * Licence to use, see LICENSE file in this distribution.
+ */
+#define CACHE_C 1
+#include <stdio.h>
+#include <stdlib.h>      // malloc, realloc
+#include <stdint.h>      // uint32_t, uint64_t
+#include <string.h>      // memcpy, strerror
+#include <fcntl.h>       // open
+#include <unistd.h>      // close, unlink, getpid
+#include <sys/mman.h>    // mmap
+#include <sys/stat.h>    // fstat
+#include <sys/errno.h>   // errno
+#include "utils.h"
+#include "strkern.h"
+#include "options.h"
+#include "storage.h"
+#include "stamp.h"
+#include "cache.h"
+
+#define CACHE_MAGIC   "PLCACHE"
+#define CACHE_VERSION 2             // Bump on any change below
+#define CACHE_ENDIAN  0x01020304u
+#define CACHE_SUFFIX  ".plcache"
+
+/****
+ * Track fields a snapshot can hold (struct cachehead fields).
+ */
+enum cachefield {
+    CF_NAME   = 1,
+    CF_TIME   = 2,
+    CF_ALBUM  = 4,
+    CF_ARTIST = 8,
+    CF_PID    = 16      // Persistent ID and Date Modified
+};
+
+struct cachehead {
+    char     magic[8];
+    uint32_t version;
+    uint32_t endian;
+    uint64_t xmlsize;
+    int64_t  xmlmtime;
+    uint64_t xmlhash;
+    uint32_t fields;        // enum cachefield, what the parse kept
+    uint32_t ntracks;
+    uint32_t nlists;
+    uint32_t nmembers;
+    uint32_t nwanted;       // playlist names the parse was asked for
+    int32_t  stattracks;    // struct statistics of that parse
+    int32_t  statplaylists;
+    int32_t  statskipped;
+    uint64_t strsize;
+    uint64_t bodyhash;      // everything after the header
+    uint64_t confighash;    // stampConfig() of the run that saved it
+};
+
+// Body, in this order: tracks, lists, members, wanted, strings.
+struct cachetrack {
+    uint64_t pid;
+    uint64_t modified;
+    int32_t  id;
+    int32_t  time;
+    uint32_t file;          // string pool offsets
+    uint32_t name;
+    uint32_t album;
+    uint32_t artist;
+};
+
+struct cachelist {
+    uint64_t ppid;
+    int32_t  id;
+    uint32_t name;
+    uint32_t first;         // index into members
+    uint32_t count;
+};
+
+struct cachepool {
+    char   *buf;
+    size_t  len;
+    size_t  sz;
+};
+
+/****
+ * --incremental: the snapshot of the XML before it changed, see
+ * _keep_prev().  seen is only written after the parse, by cacheReport().
+ */
+struct prevtrack {
+    uint64_t       pid;
+    uint32_t       rec;     // index into tracks
+    int            seen;
+    UT_hash_handle hh;
+};
+
+struct cacheprev {
+    void                    *map;
+    size_t                   size;
+    const struct cachehead  *head;
+    const struct cachetrack *tracks;
+    const struct cachelist  *lists;
+    const int32_t           *members;
+    const char              *strings;
+    struct prevtrack        *all;
+    struct prevtrack        *bypid;
+    int                      sameconfig;
+};
+
+static struct cacheprev prev;
+
+/****
+ * The XML's key, taken by cacheLoad() before the parse and saved with
+ * the snapshot: an XML rewritten while it was being read must not be
+ * filed under the new file's key.
+ */
+static struct cachehead xmlkey;
+static int              xmlkeyok = 0;
+
+
+/****************************************************************************
+ * Which of the enum cachefield fields this run needs.
+ */
+static uint32_t
+_fields()
+{
+    uint32_t fields = 0;
+
+    if ( want_track_key(K_NAME) ) {
+        fields |= CF_NAME;
+    }
+    if ( want_track_key(K_TOTAL_TIME) ) {
+        fields |= CF_TIME;
+    }
+    if ( want_track_key(K_ALBUM) ) {
+        fields |= CF_ALBUM;
+    }
+    if ( ( want_track_key(K_ARTIST) ) || ( want_track_key(K_ALBUM_ARTIST) ) ) {
+        fields |= CF_ARTIST;
+    }
+    if ( want_track_key(K_PERSISTENT_ID) ) {
+        fields |= CF_PID;
+    }
+    return fields;
+}
+
+
+/****************************************************************************
+ * Snapshot path for this device, beside the XML unless cache_dir is set.
+ */
+static int
+_path(struct options *dev, char *path, size_t pathsz)
+{
+    const char *base = NULL;
+
+    if ( 0 == str_diffn(dev->itunes_xml_file, "-", 2) ) {
+        return -1;      // stdin has no file to key on
+    }
+    if ( strlen(dev->cache_dir) ) {
+        if ( NULL == ( base = rindex(dev->itunes_xml_file, '/') ) ) {
+            base = dev->itunes_xml_file;
+        }
+        else {
+            base++;
+        }
+        snprintf(path, pathsz, "%s/%s%s", dev->cache_dir, base, CACHE_SUFFIX);
+    }
+    else {
+        snprintf(path, pathsz, "%s%s", dev->itunes_xml_file, CACHE_SUFFIX);
+    }
+    return 0;
+}
+
+
+/****************************************************************************
+ * Size, mtime and content hash of the XML (as stored, compressed or not).
+ */
+static int
+_xml_key(const char *filename, struct cachehead *head)
+{
+    struct stat statbuf;
+    void       *map = NULL;
+    int          fd = -1;
+
+    if ( 0 > ( fd = open(filename, O_RDONLY) ) ) {
+        return -1;
+    }
+    if (   ( fstat(fd, &statbuf) ) || ( ! S_ISREG(statbuf.st_mode) )
+        || ( 0 == statbuf.st_size ) ) {
+        close(fd);
+        return -1;
+    }
+    map = mmap(NULL, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if ( MAP_FAILED == map ) {
+        return -1;
+    }
+#ifdef MADV_SEQUENTIAL
+    madvise(map, statbuf.st_size, MADV_SEQUENTIAL);
+#endif
+    head->xmlsize  = (uint64_t)statbuf.st_size;
+    head->xmlmtime = (int64_t)statbuf.st_mtime;
+    head->xmlhash  = strkHash((const char *)map, statbuf.st_size);
+    munmap(map, statbuf.st_size);
+    return 0;
+}
+
+
+static uint32_t
+_pool_add(struct cachepool *pool, const char *s)
+{
+    size_t len = strlen(s) + 1;
+    size_t off = pool->len;
+    char *grow = NULL;
+
+    if ( pool->len + len > pool->sz ) {
+        size_t newsz = ( pool->sz ? pool->sz * 2 : 65536 );
+        while ( pool->len + len > newsz ) {
+            newsz *= 2;
+        }
+        if ( NULL == ( grow = realloc(pool->buf, newsz) ) ) {
+            mydebug("cache:Unable to allocate %ld bytes of space: %s\n"
+                    , newsz, strerror(errno));
+            exit(2);
+        }
+        pool->buf = grow;
+        pool->sz  = newsz;
+    }
+    memcpy(pool->buf + pool->len, s, len);
+    pool->len += len;
+    return (uint32_t)off;
+}
+
+
+/****************************************************************************
+ * Copy a pool string into a track field.
+ */
+static void
+_field(struct trackstr *dst, const char *src)
+{
+    trackStrSet(dst, src, strlen(src));
+}
+
+
+static uint32_t
+_symbol(const char *src)
+{
+    return trackIntern(src, strlen(src));
+}
+
+
+/****************************************************************************
+ * Pool offset of a track symbol, each one added to the pool only once.
+ * symoff is indexed by symbol, 0 where it isn't pooled yet.
+ */
+static uint32_t
+_pool_sym(struct cachepool *pool, uint32_t *symoff, uint32_t sym)
+{
+    if ( 0 == symoff[sym] ) {
+        symoff[sym] = _pool_add(pool, trackSym(sym));
+    }
+    return symoff[sym];
+}
+
+
+/****************************************************************************
+ * Is every offset and count in the mapped snapshot inside it?
+ * Returns the body layout through the pointers.
+ */
+static int
+_check(const char *map, size_t size, const struct cachehead *head
+        , const struct cachetrack **tracks, const struct cachelist **lists
+        , const int32_t **members, const uint32_t **wanted
+        , const char **strings)
+{
+    uint64_t need = sizeof(struct cachehead);
+    uint64_t cx   = 0;
+
+    need += (uint64_t)head->ntracks  * sizeof(struct cachetrack);
+    need += (uint64_t)head->nlists   * sizeof(struct cachelist);
+    need += (uint64_t)head->nmembers * sizeof(int32_t);
+    need += (uint64_t)head->nwanted  * sizeof(uint32_t);
+    need += head->strsize;
+    if (   ( need != size ) || ( 0 == head->strsize )
+        || ( UINT32_MAX < head->strsize ) ) {
+        return -1;
+    }
+    if ( head->bodyhash != strkHash(map + sizeof(struct cachehead)
+                , size - sizeof(struct cachehead)) ) {
+        return -1;
+    }
+    *tracks  = (const struct cachetrack *)( map + sizeof(struct cachehead) );
+    *lists   = (const struct cachelist *)( *tracks + head->ntracks );
+    *members = (const int32_t *)( *lists + head->nlists );
+    *wanted  = (const uint32_t *)( *members + head->nmembers );
+    *strings = (const char *)( *wanted + head->nwanted );
+
+    if ( '\0' != (*strings)[head->strsize - 1] ) {
+        return -1;
+    }
+    for ( cx = 0; cx < head->ntracks; cx++ ) {
+        if (   ( (*tracks)[cx].file   >= head->strsize )
+            || ( (*tracks)[cx].name   >= head->strsize )
+            || ( (*tracks)[cx].album  >= head->strsize )
+            || ( (*tracks)[cx].artist >= head->strsize ) ) {
+            return -1;
+        }
+    }
+    for ( cx = 0; cx < head->nlists; cx++ ) {
+        if (   ( (*lists)[cx].name >= head->strsize )
+            || ( (uint64_t)(*lists)[cx].first + (*lists)[cx].count
+                    > head->nmembers ) ) {
+            return -1;
+        }
+    }
+    for ( cx = 0; cx < head->nwanted; cx++ ) {
+        if ( (*wanted)[cx] >= head->strsize ) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+/****************************************************************************
+ * Were all of this run's playlist names asked for when it was saved?
+ */
+static int
+_covers_lists(const struct cachehead *head, const uint32_t *wanted
+        , const char *strings)
+{
+    UT_array *names = NULL;
+    char   **name = NULL;
+    uint32_t cx = 0;
+    int     ret = 1;
+
+    utarray_new(names, &ut_str_icd);
+    want_names(names);
+    for ( name = (char **) utarray_front(names)
+        ; ( ret ) && ( name != NULL )
+        ; name = (char **) utarray_next(names, name) ) {
+        for ( cx = 0; cx < head->nwanted; cx++ ) {
+            if ( 0 == strcmp(*name, strings + wanted[cx]) ) {
+                break;
+            }
+        }
+        if ( cx == head->nwanted ) {
+            mydebug("cache: list [%s] is not in the snapshot\n", *name);
+            ret = 0;
+        }
+    }
+    utarray_free(names);
+    return ret;
+}
+
+
+/****************************************************************************
+ * The XML changed since this snapshot, keep it (mapped) as the previous
+ * run for --incremental.  Unmaps it if it can't be used.
+ */
+static void
+_keep_prev(void *map, size_t size, const char *path)
+{
+    const struct cachehead *head = (const struct cachehead *)map;
+    const uint32_t         *wanted = NULL;
+
+    memset(&prev, 0, sizeof(prev));
+    if ( _check((const char *)map, size, head, &prev.tracks, &prev.lists
+                , &prev.members, &wanted, &prev.strings) ) {
+        mywarning("cache: %s is damaged, parsing the XML\n", path);
+        munmap(map, size);
+        return;
+    }
+    if ( _fields() & ~head->fields ) {
+        mydebug("cache: snapshot lacks track fields this run needs\n");
+        munmap(map, size);
+        return;
+    }
+    if ( NULL == ( prev.all = calloc(head->ntracks + 1
+                    , sizeof(struct prevtrack)) ) ) {
+        mydebug("cache:Unable to allocate %ld bytes of space: %s\n"
+                , ( head->ntracks + 1 ) * sizeof(struct prevtrack)
+                , strerror(errno));
+        exit(2);
+    }
+    for ( uint32_t cx = 0; cx < head->ntracks; cx++ ) {
+        struct prevtrack *dup = NULL;
+
+        if ( 0 == prev.tracks[cx].pid ) {
+            continue;
+        }
+        HASH_FIND(hh, prev.bypid, &prev.tracks[cx].pid, sizeof(uint64_t), dup);
+        if ( NULL != dup ) {
+            continue;   // The first one is the one a lookup finds
+        }
+        prev.all[cx].pid = prev.tracks[cx].pid;
+        prev.all[cx].rec = cx;
+        HASH_ADD(hh, prev.bypid, pid, sizeof(uint64_t), &prev.all[cx]);
+    }
+    prev.map        = map;
+    prev.size       = size;
+    prev.head       = head;
+    prev.sameconfig = ( stampConfig() == head->confighash );
+    mydebug("cache: matching tracks against %s, %u tracks, %u lists\n"
+            , path, head->ntracks, head->nlists);
+}
+
+
+/**
+ * function: cacheLoad
+ * dev: the device configuration about to parse its XML
+ *
+ * Fill storage from the snapshot if there is one for this exact XML,
+ * and it holds everything this run needs.  Returns 0 if it did, the
+ * caller parses the XML otherwise (storage is untouched then).
+ */
+int
+cacheLoad(struct options *dev)
+{
+    char                    path[2100];
+    struct stat             statbuf;
+    const struct cachehead *head    = NULL;
+    const struct cachetrack *tracks = NULL;
+    const struct cachelist  *lists  = NULL;
+    const int32_t           *members = NULL;
+    const uint32_t          *wanted = NULL;
+    const char              *strings = NULL;
+    struct trackmap         *trk    = NULL;
+    struct list             *lst    = NULL;
+    void                    *map    = NULL;
+    int                      fd     = -1;
+    uint32_t                 fields = _fields();
+
+    xmlkeyok = 0;
+    if ( ( CACHE_OFF == dev->cache ) || ( _path(dev, path, sizeof(path)) ) ) {
+        return -1;
+    }
+    memset(&xmlkey, 0, sizeof(xmlkey));
+    if ( _xml_key(dev->itunes_xml_file, &xmlkey) ) {
+        return -1;
+    }
+    xmlkeyok = 1;
+    if ( CACHE_ON != dev->cache ) {
+        return -1;
+    }
+    if ( 0 > ( fd = open(path, O_RDONLY) ) ) {
+        mydebug("cache: no snapshot %s\n", path);
+        return -1;
+    }
+    if (   ( fstat(fd, &statbuf) )
+        || ( sizeof(struct cachehead) > (size_t)statbuf.st_size ) ) {
+        mywarning("cache: %s is damaged, parsing the XML\n", path);
+        close(fd);
+        return -1;
+    }
+    map = mmap(NULL, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if ( MAP_FAILED == map ) {
+        mywarning("cache: Unable to map %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    head = (const struct cachehead *)map;
+
+    if (   ( memcmp(head->magic, CACHE_MAGIC, 8) )
+        || ( CACHE_VERSION != head->version )
+        || ( CACHE_ENDIAN != head->endian ) ) {
+        mydebug("cache: %s is from another version, parsing the XML\n"
+                , path);
+        goto miss;
+    }
+    if (   ( xmlkey.xmlsize  != head->xmlsize )
+        || ( xmlkey.xmlmtime != head->xmlmtime )
+        || ( xmlkey.xmlhash  != head->xmlhash ) ) {
+        mydebug("cache: %s changed since the snapshot\n"
+                , dev->itunes_xml_file);
+        if ( dev->incremental ) {
+            _keep_prev(map, statbuf.st_size, path);
+            return -1;
+        }
+        goto miss;
+    }
+    if ( columnCount() ) {
+        mydebug("cache: captured track keys are not in the snapshot\n");
+        goto miss;
+    }
+    if ( _check((const char *)map, statbuf.st_size, head
+                , &tracks, &lists, &members, &wanted, &strings) ) {
+        mywarning("cache: %s is damaged, parsing the XML\n", path);
+        goto miss;
+    }
+    if ( fields & ~head->fields ) {
+        mydebug("cache: snapshot lacks track fields this run needs\n");
+        goto miss;
+    }
+    if ( ! _covers_lists(head, wanted, strings) ) {
+        goto miss;
+    }
+
+    for ( uint32_t cx = 0; cx < head->ntracks; cx++ ) {
+        trk = trackAdd(tracks[cx].id);
+        trk->time = tracks[cx].time;
+        trk->pid  = tracks[cx].pid;
+        trk->modified = tracks[cx].modified;
+        _field(&trk->file,   strings + tracks[cx].file);
+        _field(&trk->name,   strings + tracks[cx].name);
+        trk->album  = _symbol(strings + tracks[cx].album);
+        trk->artist = _symbol(strings + tracks[cx].artist);
+    }
+    for ( uint32_t cx = 0; cx < head->nlists; cx++ ) {
+        lst = listAdd(lists[cx].id);
+        lst->ppid = lists[cx].ppid;
+        strncpy(lst->name, strings + lists[cx].name, 1023);
+        want_list_any(lst->id, lst->name);
+        for ( uint32_t mx = 0; mx < lists[cx].count; mx++ ) {
+            listAppend(lst, (uint32_t)members[lists[cx].first + mx]);
+        }
+    }
+    Stats.tracks    = head->stattracks;
+    Stats.playlists = head->statplaylists;
+    Stats.skipped   = head->statskipped;
+
+    mydebug("cache: loaded %s, %u tracks, %u lists\n"
+            , path, head->ntracks, head->nlists);
+    munmap(map, statbuf.st_size);
+    return 0;
+
+miss:
+    munmap(map, statbuf.st_size);
+    return -1;
+}
+
+
+/**
+ * function: cacheSave
+ * dev: the device configuration whose XML was just parsed
+ *
+ * Write what storage holds to the snapshot (by way of a temporary file,
+ * so a reader never sees half of one).  Failure only costs the next run
+ * a parse.
+ */
+void
+cacheSave(struct options *dev)
+{
+    char              path[2100];
+    char              temp[2200];
+    struct cachehead  head;
+    struct cachepool  pool;
+    struct trackmap  *curtrk = NULL;
+    struct list      *curlst, *ltmp;
+    struct cachetrack *tracks = NULL;
+    struct cachelist  *lists  = NULL;
+    int32_t          *members = NULL;
+    uint32_t         *wanted  = NULL;
+    uint32_t         *symoff  = NULL;
+    uint32_t         *refs    = NULL;
+    UT_array         *names   = NULL;
+    char            **name    = NULL;
+    char             *body    = NULL;
+    size_t            bodysz  = 0;
+    uint32_t          cx      = 0;
+    uint32_t          mx      = 0;
+    FILE             *out     = NULL;
+
+    if (   ( CACHE_OFF == dev->cache ) || ( ! xmlkeyok )
+        || ( _path(dev, path, sizeof(path)) ) ) {
+        return;
+    }
+    xmlkeyok = 0;
+    memset(&head, 0, sizeof(head));
+    memset(&pool, 0, sizeof(pool));
+    head.xmlsize  = xmlkey.xmlsize;
+    head.xmlmtime = xmlkey.xmlmtime;
+    head.xmlhash  = xmlkey.xmlhash;
+    memcpy(head.magic, CACHE_MAGIC, 8);
+    head.version = CACHE_VERSION;
+    head.endian  = CACHE_ENDIAN;
+    head.fields  = _fields();
+    head.ntracks = track.count;
+    HASH_ITER(hh, playlist, curlst, ltmp) {
+        if ( curlst->wanted ) {
+            head.nlists++;
+            head.nmembers += curlst->count;
+        }
+    }
+    utarray_new(names, &ut_str_icd);
+    want_names(names);
+    head.nwanted       = utarray_len(names);
+    head.stattracks    = Stats.tracks;
+    head.statplaylists = Stats.playlists;
+    head.statskipped   = Stats.skipped;
+    head.confighash    = stampConfig();
+
+    tracks  = calloc(head.ntracks + 1, sizeof(struct cachetrack));
+    lists   = calloc(head.nlists + 1, sizeof(struct cachelist));
+    members = calloc(head.nmembers + 1, sizeof(int32_t));
+    wanted  = calloc(head.nwanted + 1, sizeof(uint32_t));
+    symoff  = calloc(track_syms.count + 1, sizeof(uint32_t));
+    if (   ( NULL == tracks ) || ( NULL == lists )
+        || ( NULL == members ) || ( NULL == wanted ) || ( NULL == symoff ) ) {
+        mydebug("cache:Unable to allocate snapshot tables: %s\n"
+                , strerror(errno));
+        exit(2);
+    }
+
+    for ( cx = 0; cx < track.count; cx++ ) {
+        curtrk = trackAt(cx);
+        tracks[cx].pid    = curtrk->pid;
+        tracks[cx].modified = curtrk->modified;
+        tracks[cx].id     = curtrk->id;
+        tracks[cx].time   = curtrk->time;
+        tracks[cx].file   = _pool_add(&pool, trackStr(curtrk->file));
+        tracks[cx].name   = _pool_add(&pool, trackStr(curtrk->name));
+        tracks[cx].album  = _pool_sym(&pool, symoff, curtrk->album);
+        tracks[cx].artist = _pool_sym(&pool, symoff, curtrk->artist);
+    }
+    cx = 0;
+    mx = 0;
+    HASH_ITER(hh, playlist, curlst, ltmp) {
+        if ( ! curlst->wanted ) {
+            continue;
+        }
+        lists[cx].ppid  = curlst->ppid;
+        lists[cx].id    = curlst->id;
+        lists[cx].name  = _pool_add(&pool, curlst->name);
+        lists[cx].first = mx;
+        lists[cx].count = curlst->count;
+        refs = listRefs(curlst);
+        for ( uint32_t rx = 0; rx < curlst->count; rx++ ) {
+            members[mx++] = trackAt(refs[rx])->id;
+        }
+        cx++;
+    }
+    cx = 0;
+    for ( name = (char **) utarray_front(names)
+        ; name != NULL
+        ; name = (char **) utarray_next(names, name) ) {
+        wanted[cx++] = _pool_add(&pool, *name);
+    }
+    utarray_free(names);
+    _pool_add(&pool, "");   // never empty, always NUL terminated
+    head.strsize = pool.len;
+
+    bodysz = head.ntracks  * sizeof(struct cachetrack)
+           + head.nlists   * sizeof(struct cachelist)
+           + head.nmembers * sizeof(int32_t)
+           + head.nwanted  * sizeof(uint32_t)
+           + pool.len;
+    if ( NULL == ( body = malloc(bodysz) ) ) {
+        mydebug("cache:Unable to allocate %ld bytes of space: %s\n"
+                , bodysz, strerror(errno));
+        exit(2);
+    }
+    mx = 0;
+    memcpy(body + mx, tracks, head.ntracks * sizeof(struct cachetrack));
+    mx += head.ntracks * sizeof(struct cachetrack);
+    memcpy(body + mx, lists, head.nlists * sizeof(struct cachelist));
+    mx += head.nlists * sizeof(struct cachelist);
+    memcpy(body + mx, members, head.nmembers * sizeof(int32_t));
+    mx += head.nmembers * sizeof(int32_t);
+    memcpy(body + mx, wanted, head.nwanted * sizeof(uint32_t));
+    mx += head.nwanted * sizeof(uint32_t);
+    memcpy(body + mx, pool.buf, pool.len);
+    head.bodyhash = strkHash(body, bodysz);
+
+    snprintf(temp, sizeof(temp), "%s.%d", path, (int)getpid());
+    if ( NULL == ( out = fopen(temp, "wb") ) ) {
+        mywarning("cache: Unable to write %s: %s\n", temp, strerror(errno));
+    }
+    else if (   ( 1 != fwrite(&head, sizeof(head), 1, out) )
+             || ( 1 != fwrite(body, bodysz, 1, out) )
+             || ( fflush(out) ) ) {
+        mywarning("cache: Unable to write %s: %s\n", temp, strerror(errno));
+        fclose(out);
+        unlink(temp);
+    }
+    else if ( fclose(out) ) {
+        mywarning("cache: Unable to write %s: %s\n", temp, strerror(errno));
+        unlink(temp);
+    }
+    else if ( rename(temp, path) ) {
+        mywarning("cache: Unable to rename %s: %s\n", temp, strerror(errno));
+        unlink(temp);
+    }
+    else {
+        mydebug("cache: saved %s, %u tracks, %u lists, %ld bytes\n"
+                , path, head.ntracks, head.nlists
+                , (long)( sizeof(head) + bodysz ));
+    }
+
+    free(body);
+    free(pool.buf);
+    free(tracks);
+    free(lists);
+    free(members);
+    free(wanted);
+    free(symoff);
+}
+
+
+/**
+ * function: cacheReuse
+ * work: a track being parsed, with its Persistent ID and Date Modified
+ *
+ * If the previous snapshot has this track, unmodified, copy the rest of
+ * it from there.  Returns 1 if it did.  Called on parser threads, only
+ * reads prev.
+ */
+int
+cacheReuse(struct trackmap *work)
+{
+    const struct cachetrack *rec = NULL;
+    struct prevtrack        *was = NULL;
+
+    if ( NULL == prev.bypid ) {
+        return 0;
+    }
+    HASH_FIND(hh, prev.bypid, &work->pid, sizeof(uint64_t), was);
+    if ( NULL == was ) {
+        return 0;
+    }
+    rec = &prev.tracks[was->rec];
+    if ( rec->modified != work->modified ) {
+        return 0;
+    }
+    work->previd = rec->id;
+    work->time   = rec->time;
+    _field(&work->file,   prev.strings + rec->file);
+    _field(&work->name,   prev.strings + rec->name);
+    work->album  = _symbol(prev.strings + rec->album);
+    work->artist = _symbol(prev.strings + rec->artist);
+    return 1;
+}
+
+
+/****************************************************************************
+ * The previous snapshot's list with this Playlist Persistent ID, or -1.
+ */
+static int
+_prev_list(uint64_t ppid)
+{
+    for ( uint32_t cx = 0; cx < prev.head->nlists; cx++ ) {
+        if ( ( ppid ) && ( ppid == prev.lists[cx].ppid ) ) {
+            return (int)cx;
+        }
+    }
+    return -1;
+}
+
+
+/****************************************************************************
+ * Same members, in the same order, every one copied unchanged?
+ */
+static int
+_same_list(struct list *work, const struct cachelist *was)
+{
+    struct trackmap *trk  = NULL;
+    uint32_t        *refs = listRefs(work);
+
+    if ( work->count != was->count ) {
+        return 0;
+    }
+    for ( uint32_t mx = 0; mx < work->count; mx++ ) {
+        trk = trackAt(refs[mx]);
+        if (   ( 0 == trk->previd )
+            || ( prev.members[was->first + mx] != trk->previd ) ) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+/**
+ * function: cacheListUnchanged
+ * work: a wanted playlist, after the parse
+ *
+ * 1 if the previous snapshot (of the same settings) had this playlist
+ * with exactly these tracks, so its file would be written the same.
+ */
+int
+cacheListUnchanged(struct list *work)
+{
+    int was = -1;
+
+    if ( ( NULL == prev.map ) || ( ! prev.sameconfig ) ) {
+        return 0;
+    }
+    if ( 0 > ( was = _prev_list(work->ppid) ) ) {
+        return 0;
+    }
+    return _same_list(work, &prev.lists[was]);
+}
+
+
+static const char *
+_track_label(struct trackmap *work)
+{
+    return trackStr(( work->name.len ) ? work->name : work->file);
+}
+
+
+/**
+ * function: cacheReport
+ * dev: the device configuration whose XML was just parsed
+ *
+ * With a previous snapshot, count the tracks and wanted playlists added,
+ * changed and removed since it.
+ */
+void
+cacheReport(struct options *dev)
+{
+    struct trackmap  *curtrk = NULL;
+    struct list      *curlst, *ltmp;
+    struct prevtrack *was = NULL;
+    char             *lseen = NULL;
+    int   added = 0, changed = 0, removed = 0, same = 0;
+    int   ladded = 0, lchanged = 0, lremoved = 0, lsame = 0;
+    int   lx = 0;
+    uint32_t inlists = 0;
+
+    if ( NULL == prev.map ) {
+        return;
+    }
+    for ( uint32_t cx = 0; cx < track.count; cx++ ) {
+        curtrk = trackAt(cx);
+        if ( 0 == curtrk->pid ) {
+            continue;   // Not a track iTunes wrote (no Persistent ID)
+        }
+        HASH_FIND(hh, prev.bypid, &curtrk->pid, sizeof(uint64_t), was);
+        if ( NULL == was ) {
+            extradebug("refresh: added track %016llx %s\n"
+                    , (unsigned long long)curtrk->pid, _track_label(curtrk));
+            added++;
+            continue;
+        }
+        was->seen = 1;
+        if ( curtrk->previd ) {
+            same++;
+        }
+        else {
+            listsOf(cx, &inlists);
+            extradebug("refresh: changed track %016llx %s, in %u list%s\n"
+                    , (unsigned long long)curtrk->pid, _track_label(curtrk)
+                    , inlists, ( 1 == inlists ? "" : "s" ));
+            changed++;
+        }
+    }
+    for ( uint32_t cx = 0; cx < prev.head->ntracks; cx++ ) {
+        if ( ( prev.all[cx].pid ) && ( ! prev.all[cx].seen ) ) {
+            extradebug("refresh: removed track %016llx %s\n"
+                    , (unsigned long long)prev.all[cx].pid
+                    , prev.strings + ( prev.strings[prev.tracks[cx].name]
+                        ? prev.tracks[cx].name : prev.tracks[cx].file ));
+            removed++;
+        }
+    }
+
+    if ( NULL == ( lseen = calloc(prev.head->nlists + 1, 1) ) ) {
+        mydebug("cache:Unable to allocate %ld bytes of space: %s\n"
+                , (long)prev.head->nlists + 1, strerror(errno));
+        exit(2);
+    }
+    HASH_ITER(hh, playlist, curlst, ltmp) {
+        if ( ! curlst->wanted ) {
+            continue;
+        }
+        if ( 0 > ( lx = _prev_list(curlst->ppid) ) ) {
+            extradebug("refresh: added list %s\n", curlst->name);
+            ladded++;
+            continue;
+        }
+        lseen[lx] = 1;
+        if ( _same_list(curlst, &prev.lists[lx]) ) {
+            lsame++;
+        }
+        else {
+            extradebug("refresh: changed list %s\n", curlst->name);
+            lchanged++;
+        }
+    }
+    for ( uint32_t cx = 0; cx < prev.head->nlists; cx++ ) {
+        if ( ! lseen[cx] ) {
+            extradebug("refresh: removed list %s\n"
+                    , prev.strings + prev.lists[cx].name);
+            lremoved++;
+        }
+    }
+    free(lseen);
+
+    myprint("%s : tracks %d added, %d changed, %d removed, %d unchanged\n"
+            , dev->itunes_xml_file, added, changed, removed, same);
+    myprint("%s : lists %d added, %d changed, %d removed, %d unchanged\n"
+            , dev->itunes_xml_file, ladded, lchanged, lremoved, lsame);
+}
+
+
+/**
+ * function: cacheFree
+ *
+ * Let go of the previous snapshot, once its lists have been written.
+ */
+void
+cacheFree()
+{
+    if ( NULL == prev.map ) {
+        return;
+    }
+    HASH_CLEAR(hh, prev.bypid);
+    free(prev.all);
+    munmap(prev.map, prev.size);
+    memset(&prev, 0, sizeof(prev));
+}
+
+/**
+ * vim: sw=4 ts=4 expandtab
+ * EOF: cache.c
+ */
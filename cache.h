@@ -0,0 +1,30 @@
+/****************************************************************************
+ * File: cache.h
+ *
+ * Binary library snapshot (cache.c), loaded instead of parsing the XML.
+ *
+ * Copyright (c) 2019-2024, Gary Allen Vollink.  http://voll.ink/playlister
+ * All rights reserved.
+ *
+ * Licence to use, see LICENSE file in this distribution.
+ */
+#ifndef CACHE_H
+#define CACHE_H 1
+#include "utils.h"
+
+struct options;
+struct trackmap;
+struct list;
+
+int  cacheLoad(struct options *dev);
+void cacheSave(struct options *dev);
+int  cacheReuse(struct trackmap *work);
+int  cacheListUnchanged(struct list *work);
+void cacheReport(struct options *dev);
+void cacheFree(void);
+
+#endif /* CACHE_H */
+/**
+ * vim: sw=4 ts=4 expandtab
+ * EOF: cache.h
+ */
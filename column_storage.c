@@ -0,0 +1,533 @@
+/****************************************************************************
+ * File: column_storage.c
+ *
+ * Captured track metadata, one column per key (memory storage)
+ *
+ * Copyright (c) 2019-2024, Gary Allen Vollink.  http://voll.ink/playlister
+ * All rights reserved.
+ *
+ * Licence to use, see LICENSE file in this distribution.
+ */
+#define COLUMN_STORAGE_C 1
+#include <stdio.h>
+#include <stdlib.h>    // malloc, realloc, strtoll
+#include <sys/errno.h> // errno
+#include <string.h>    // strerror
+#include <time.h>      // timegm
+#include "utils.h"
+#include "options.h"
+#include "storage.h"
+
+__thread struct coltab track_cols;
+
+/****
+ * The type every capturable track key is kept as.  Track ID is the slot
+ * itself, Location, Name, Persistent ID and the like are already kept
+ * for the playlists (struct trackmap).
+ */
+static const struct {
+    enum itunesKey key;
+    enum coltype   type;
+} col_types[] = {
+    { K_SIZE,                   COL_INT64 },
+    { K_TOTAL_TIME,             COL_INT32 },
+    { K_START_TIME,             COL_INT32 },
+    { K_STOP_TIME,              COL_INT32 },
+    { K_DISC_NUMBER,            COL_INT32 },
+    { K_DISC_COUNT,             COL_INT32 },
+    { K_TRACK_NUMBER,           COL_INT32 },
+    { K_TRACK_COUNT,            COL_INT32 },
+    { K_YEAR,                   COL_INT32 },
+    { K_BPM,                    COL_INT32 },
+    { K_DATE_MODIFIED,          COL_DATE  },
+    { K_DATE_ADDED,             COL_DATE  },
+    { K_BIT_RATE,               COL_INT32 },
+    { K_SAMPLE_RATE,            COL_INT32 },
+    { K_VOLUME_ADJUSTMENT,      COL_INT32 },
+    { K_PART_OF_GAPLESS_ALBUM,  COL_BOOL  },
+    { K_EQUALIZER,              COL_SYM   },
+    { K_COMMENTS,               COL_SYM   },
+    { K_PLAY_COUNT,             COL_INT32 },
+    { K_PLAY_DATE,              COL_INT64 },
+    { K_PLAY_DATE_UTC,          COL_DATE  },
+    { K_SKIP_COUNT,             COL_INT32 },
+    { K_SKIP_DATE,              COL_DATE  },
+    { K_RELEASE_DATE,           COL_DATE  },
+    { K_RATING,                 COL_INT32 },
+    { K_RATING_COMPUTED,        COL_BOOL  },
+    { K_ALBUM_RATING,           COL_INT32 },
+    { K_ALBUM_RATING_COMPUTED,  COL_BOOL  },
+    { K_LOVED,                  COL_BOOL  },
+    { K_ALBUM_LOVED,            COL_BOOL  },
+    { K_DISLIKED,               COL_BOOL  },
+    { K_ALBUM_DISLIKED,         COL_BOOL  },
+    { K_COMPILATION,            COL_BOOL  },
+    { K_ARTWORK_COUNT,          COL_INT32 },
+    { K_TRACK_TYPE,             COL_SYM   },
+    { K_PROTECTED,              COL_BOOL  },
+    { K_PURCHASED,              COL_BOOL  },
+    { K_HAS_VIDEO,              COL_BOOL  },
+    { K_HD,                     COL_BOOL  },
+    { K_VIDEO_WIDTH,            COL_INT32 },
+    { K_VIDEO_HEIGHT,           COL_INT32 },
+    { K_MOVIE,                  COL_BOOL  },
+    { K_TV_SHOW,                COL_BOOL  },
+    { K_MUSIC_VIDEO,            COL_BOOL  },
+    { K_PODCAST,                COL_BOOL  },
+    { K_ITUNESU,                COL_BOOL  },
+    { K_UNPLAYED,               COL_BOOL  },
+    { K_EXPLICIT,               COL_BOOL  },
+    { K_CLEAN,                  COL_BOOL  },
+    { K_DISABLED,               COL_BOOL  },
+    { K_PLAYLIST_ONLY,          COL_BOOL  },
+    { K_APPLE_MUSIC,            COL_BOOL  },
+    { K_MATCHED,                COL_BOOL  },
+    { K_ARTIST,                 COL_SYM   },
+    { K_ALBUM_ARTIST,           COL_SYM   },
+    { K_COMPOSER,               COL_SYM   },
+    { K_ALBUM,                  COL_SYM   },
+    { K_GROUPING,               COL_SYM   },
+    { K_GENRE,                  COL_SYM   },
+    { K_KIND,                   COL_SYM   },
+    { K_CONTENT_RATING,         COL_SYM   },
+    { K_SERIES,                 COL_SYM   },
+    { K_SEASON,                 COL_INT32 },
+    { K_EPISODE,                COL_SYM   },
+    { K_EPISODE_ORDER,          COL_INT32 },
+    { K_WORK,                   COL_SYM   },
+    { K_MOVEMENT_NAME,          COL_SYM   },
+    { K_MOVEMENT_NUMBER,        COL_INT32 },
+    { K_MOVEMENT_COUNT,         COL_INT32 },
+    { K_FILE_FOLDER_COUNT,      COL_INT32 },
+    { K_LIBRARY_FOLDER_COUNT,   COL_INT32 },
+    { K_SORT_NAME,              COL_SYM   },
+    { K_SORT_ALBUM,             COL_SYM   },
+    { K_SORT_ARTIST,            COL_SYM   },
+    { K_SORT_ALBUM_ARTIST,      COL_SYM   },
+    { K_SORT_COMPOSER,          COL_SYM   },
+    { K_SORT_SERIES,            COL_SYM   },
+    { K_NORMALIZATION,          COL_INT32 },
+};
+
+static const char *col_typename[] = {
+    "int32", "int64", "date", "bool", "string"
+};
+
+/****
+ * Set by columnProject() on the main thread, read by every thread: the
+ * column of each key (-1, not captured), and the column list itself.
+ */
+static signed char    col_of[K_COUNT];
+static enum itunesKey col_key[COL_MAX];
+static enum coltype   col_type[COL_MAX];
+static int            col_count = 0;
+
+
+/****************************************************************************
+ * Add name (one entry of a capture = list) as a column, if it can be one.
+ */
+static void
+_col_add(const char *name)
+{
+    enum itunesKey key   = itunesKey(name);
+    size_t         types = sizeof(col_types) / sizeof(col_types[0]);
+    size_t         cx    = 0;
+
+    for ( cx = 0; cx < types; cx++ ) {
+        if ( key == col_types[cx].key ) {
+            break;
+        }
+    }
+    if ( ( K_UNKNOWN == key ) || ( types <= cx ) ) {
+        mywarning("capture: [%s] is not a track key that can be captured\n"
+                , name);
+        return;
+    }
+    if ( 0 <= col_of[key] ) {
+        return;
+    }
+    if ( COL_MAX <= col_count ) {
+        mywarning("capture: more than %d keys, [%s] is not captured\n"
+                , COL_MAX, name);
+        return;
+    }
+    col_of[key]         = (signed char)col_count;
+    col_key[col_count]  = key;
+    col_type[col_count] = col_types[cx].type;
+    col_count++;
+}
+
+
+/****************************************************************************
+ * Collect the keys every device configuration asked to capture.
+ */
+void
+columnProject()
+{
+    char  names[1025];
+    char *name = NULL;
+    char *next = NULL;
+
+    memset(col_of, -1, sizeof(col_of));
+    col_count = 0;
+    for ( struct options *dev = (struct options *) utarray_front(Devices)
+        ; dev != NULL
+        ; dev = (struct options *) utarray_next(Devices, dev)
+        ) {
+        strncpy(names, dev->capture, sizeof(names) - 1);
+        names[sizeof(names) - 1] = '\0';
+        for ( name = names; name; name = next ) {
+            if ( NULL != ( next = strchr(name, ',') ) ) {
+                *next++ = '\0';
+            }
+            while ( ( ' ' == *name ) || ( '\t' == *name ) ) {
+                name++;
+            }
+            for ( char *end = name + strlen(name)
+                ; ( end > name ) && ( ( ' ' == end[-1] )
+                    || ( '\t' == end[-1] ) )
+                ; end-- ) {
+                end[-1] = '\0';
+            }
+            if ( *name ) {
+                _col_add(name);
+            }
+        }
+    }
+    if ( col_count ) {
+        extradebug("columnProject: capturing %d track key%s\n"
+                , col_count, ( 1 == col_count ? "" : "s" ));
+    }
+}
+
+int
+columnCount()
+{
+    return col_count;
+}
+
+/****************************************************************************
+ * The column holding key, or -1.
+ */
+int
+columnIndex(enum itunesKey key)
+{
+    return col_of[key];
+}
+
+/****************************************************************************
+ * This thread's column col, for scans (see COL_BIT).  Slots at or past
+ * its size have no value.
+ */
+struct column *
+columnAt(int col)
+{
+    return &track_cols.col[col];
+}
+
+/****************************************************************************
+ * Bytes for size slots of a column of type.
+ */
+static size_t
+_col_bytes(enum coltype type, uint32_t size)
+{
+    switch ( type ) {
+        case COL_INT64:
+        case COL_DATE:
+            return size * sizeof(int64_t);
+        case COL_BOOL:
+            return ( ( size + 63 ) / 64 ) * sizeof(uint64_t);
+        default:
+            return size * sizeof(uint32_t);
+    }
+}
+
+/****************************************************************************
+ * Room in column c for slot, and at least for as many tracks as the track
+ * table has room for.  New space is zeroed, no value.
+ */
+static void
+_col_room(struct column *c, uint32_t slot)
+{
+    uint32_t  size  = ( c->size ? c->size : 1024 );
+    size_t    was   = 0;
+    size_t    now   = 0;
+    void     *grow  = NULL;
+
+    if ( slot < c->size ) {
+        return;
+    }
+    while ( slot >= size ) {
+        size *= 2;
+    }
+    if ( track.size > size ) {
+        size = track.size;
+    }
+
+    was = _col_bytes(c->type, c->size);
+    now = _col_bytes(c->type, size);
+    if ( NULL == ( grow = realloc(c->data, now) ) ) {
+        mydebug("col:Unable to allocate %ld bytes of space: %s\n",
+                (long)now, strerror(errno));
+        exit(2);
+    }
+    memset((char *)grow + was, 0, now - was);
+    c->data = grow;
+
+    was = _col_bytes(COL_BOOL, c->size);
+    now = _col_bytes(COL_BOOL, size);
+    if ( NULL == ( grow = realloc(c->valid, now) ) ) {
+        mydebug("col:Unable to allocate %ld bytes of space: %s\n",
+                (long)now, strerror(errno));
+        exit(2);
+    }
+    memset((char *)grow + was, 0, now - was);
+    c->valid = grow;
+    c->size  = size;
+}
+
+/****************************************************************************
+ * 2019-02-13T04:53:29Z as seconds since 1970, or -1 if it isn't one.
+ */
+static int
+_col_date(const char *value, int64_t *seconds)
+{
+    struct tm tm;
+
+    memset(&tm, 0, sizeof(struct tm));
+    if ( 6 != sscanf(value, "%d-%d-%dT%d:%d:%d", &tm.tm_year, &tm.tm_mon
+                , &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec) ) {
+        return -1;
+    }
+    tm.tm_year -= 1900;
+    tm.tm_mon  -= 1;
+    *seconds = (int64_t)timegm(&tm);
+    return 0;
+}
+
+/****************************************************************************
+ * Store the value of key for the track in slot, if key is captured.
+ * Booleans arrive as the element name, "true" or "false".
+ */
+void
+columnSet(uint32_t slot, enum itunesKey key, const char *value)
+{
+    struct column *c  = NULL;
+    int64_t        v  = 0;
+    int            cx = col_of[key];
+
+    if ( 0 > cx ) {
+        return;
+    }
+    c = &track_cols.col[cx];
+    if ( NULL == c->valid ) {
+        c->key  = col_key[cx];
+        c->type = col_type[cx];
+        if ( track_cols.count <= cx ) {
+            track_cols.count = cx + 1;
+        }
+    }
+    if ( ( COL_DATE == c->type ) && ( _col_date(value, &v) ) ) {
+        return;
+    }
+    _col_room(c, slot);
+    switch ( c->type ) {
+        case COL_INT32:
+            ((int32_t *)c->data)[slot] = (int32_t)strtol(value, NULL, 10);
+            break;
+        case COL_INT64:
+            ((int64_t *)c->data)[slot] = (int64_t)strtoll(value, NULL, 10);
+            break;
+        case COL_DATE:
+            ((int64_t *)c->data)[slot] = v;
+            break;
+        case COL_BOOL:
+            if ( 't' == value[0] ) {
+                COL_SET((uint64_t *)c->data, slot);
+            }
+            else {
+                COL_CLR((uint64_t *)c->data, slot);
+            }
+            break;
+        case COL_SYM:
+            ((uint32_t *)c->data)[slot] = trackIntern(value, strlen(value));
+            break;
+    }
+    if ( ! COL_BIT(c->valid, slot) ) {
+        COL_SET(c->valid, slot);
+        c->count++;
+    }
+}
+
+/****************************************************************************
+ * The value column col holds for slot (a symbol for COL_SYM, 0 or 1 for
+ * COL_BOOL), returns 0 if the track had none.
+ */
+int
+columnGet(int col, uint32_t slot, int64_t *value)
+{
+    struct column *c = &track_cols.col[col];
+
+    if ( ( slot >= c->size ) || ( ! COL_BIT(c->valid, slot) ) ) {
+        return 0;
+    }
+    switch ( c->type ) {
+        case COL_INT32:
+            *value = ((int32_t *)c->data)[slot];
+            break;
+        case COL_INT64:
+        case COL_DATE:
+            *value = ((int64_t *)c->data)[slot];
+            break;
+        case COL_BOOL:
+            *value = COL_BIT((uint64_t *)c->data, slot);
+            break;
+        case COL_SYM:
+            *value = ((uint32_t *)c->data)[slot];
+            break;
+    }
+    return 1;
+}
+
+/****************************************************************************
+ * Main thread: take over a worker's columns.  Its track cx is now slot
+ * slotmap[cx] here (UINT32_MAX, a duplicate that was dropped), its
+ * symbol s is symmap[s].  With no slotmap, this thread had no tracks and
+ * the worker's columns are taken whole.
+ */
+void
+columnMerge(struct coltab *from, const uint32_t *slotmap, uint32_t n
+        , const uint32_t *symmap)
+{
+    struct column *src  = NULL;
+    struct column *dst  = NULL;
+    uint32_t       slot = 0;
+
+    if ( NULL == slotmap ) {
+        columnFree(&track_cols);
+        track_cols = *from;
+        memset(from, 0, sizeof(struct coltab));
+        return;
+    }
+    for ( int col = 0; col < from->count; col++ ) {
+        src = &from->col[col];
+        if ( NULL == src->valid ) {
+            continue;
+        }
+        dst = &track_cols.col[col];
+        if ( NULL == dst->valid ) {
+            dst->key  = src->key;
+            dst->type = src->type;
+            if ( track_cols.count <= col ) {
+                track_cols.count = col + 1;
+            }
+        }
+        for ( uint32_t cx = 0; ( cx < n ) && ( cx < src->size ); cx++ ) {
+            slot = slotmap[cx];
+            if ( ( UINT32_MAX == slot ) || ( ! COL_BIT(src->valid, cx) ) ) {
+                continue;
+            }
+            _col_room(dst, slot);
+            switch ( src->type ) {
+                case COL_INT32:
+                    ((int32_t *)dst->data)[slot] = ((int32_t *)src->data)[cx];
+                    break;
+                case COL_INT64:
+                case COL_DATE:
+                    ((int64_t *)dst->data)[slot] = ((int64_t *)src->data)[cx];
+                    break;
+                case COL_BOOL:
+                    if ( COL_BIT((uint64_t *)src->data, cx) ) {
+                        COL_SET((uint64_t *)dst->data, slot);
+                    }
+                    else {
+                        COL_CLR((uint64_t *)dst->data, slot);
+                    }
+                    break;
+                case COL_SYM:
+                    ((uint32_t *)dst->data)[slot]
+                        = symmap[((uint32_t *)src->data)[cx]];
+                    break;
+            }
+            if ( ! COL_BIT(dst->valid, slot) ) {
+                COL_SET(dst->valid, slot);
+                dst->count++;
+            }
+        }
+    }
+    columnFree(from);
+}
+
+/****************************************************************************
+ * For trackInfo(): the captured values of slot, as " Key=value" each.
+ */
+void
+columnPrint(uint32_t slot)
+{
+    int64_t v = 0;
+    char    date[32];
+    time_t  t = 0;
+
+    for ( int col = 0; col < track_cols.count; col++ ) {
+        if ( ! columnGet(col, slot, &v) ) {
+            continue;
+        }
+        switch ( track_cols.col[col].type ) {
+            case COL_DATE:
+                t = (time_t)v;
+                strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ"
+                        , gmtime(&t));
+                printf(" %s=%s", itunesKeyName(track_cols.col[col].key)
+                        , date);
+                break;
+            case COL_BOOL:
+                printf(" %s=%s", itunesKeyName(track_cols.col[col].key)
+                        , ( v ? "true" : "false" ));
+                break;
+            case COL_SYM:
+                printf(" %s=%s", itunesKeyName(track_cols.col[col].key)
+                        , trackSym((uint32_t)v));
+                break;
+            default:
+                printf(" %s=%lld", itunesKeyName(track_cols.col[col].key)
+                        , (long long)v);
+                break;
+        }
+    }
+}
+
+/****************************************************************************
+ * -v -v -v: what each captured column holds, and what it costs.
+ */
+void
+columnInfo()
+{
+    struct column *c = NULL;
+
+    for ( int col = 0; col < track_cols.count; col++ ) {
+        c = &track_cols.col[col];
+        if ( NULL == c->valid ) {
+            continue;
+        }
+        mydebug("sI:    Column: %s (%s), %u of %u tracks, %ld KB\n"
+                , itunesKeyName(c->key), col_typename[c->type]
+                , c->count, track.count
+                , (long)( ( _col_bytes(c->type, c->size)
+                        + _col_bytes(COL_BOOL, c->size) ) / 1024 ));
+    }
+}
+
+void
+columnFree(struct coltab *tab)
+{
+    for ( int col = 0; col < tab->count; col++ ) {
+        free(tab->col[col].data);
+        free(tab->col[col].valid);
+    }
+    memset(tab, 0, sizeof(struct coltab));
+}
+
+/**
+ * vim: sw=4 ts=4 expandtab
+ * EOF column_storage.c
+ */
@@ -0,0 +1,296 @@
+/****************************************************************************
+ * keys.c
+ *
+ * iTunes <key> names to enum itunesKey, in one table probe.
+ *
+ * _keytable[] below is a perfect hash: every name in _keyname[] lands in
+ * its own slot for KEY_SEED, so a lookup is one hash, one table read and
+ * one strcmp to reject names that aren't ours.  Nothing here is computed
+ * at run time.
+ *
+ * To add a key: add it to enum itunesKey (keys.h) and _keyname[], then
+ * regenerate the seed and table and paste them in:
+ *
+ *     cc -DKEYS_GENERATE -I. -Iuthash/src -o keygen keys.c && ./keygen
+ *
+ * Copyright (c) 2019-2024, Gary Allen Vollink.  http://voll.ink/playlister
+ * All rights reserved.
+ *
+ * Licence to use, see LICENSE file in this distribution.
+ */
+#define KEYS_C 1
+#include <stdio.h>
+#include <string.h>      // strcmp
+#include "utils.h"
+#include "keys.h"
+
+#define KEY_SLOTS 1024   // Power of two, see _keyhash()
+
+/* In enum itunesKey order */
+static const char *_keyname[K_COUNT] = {
+    "",                  // K_UNKNOWN
+    "Major Version",
+    "Minor Version",
+    "Date",
+    "Application Version",
+    "Features",
+    "Show Content Ratings",
+    "Music Folder",
+    "Library Persistent ID",
+    "Tracks",
+    "Playlists",
+    "Track ID",
+    "Size",
+    "Total Time",
+    "Start Time",
+    "Stop Time",
+    "Disc Number",
+    "Disc Count",
+    "Track Number",
+    "Track Count",
+    "Year",
+    "BPM",
+    "Date Modified",
+    "Date Added",
+    "Bit Rate",
+    "Sample Rate",
+    "Volume Adjustment",
+    "Part Of Gapless Album",
+    "Equalizer",
+    "Comments",
+    "Play Count",
+    "Play Date",
+    "Play Date UTC",
+    "Skip Count",
+    "Skip Date",
+    "Release Date",
+    "Rating",
+    "Rating Computed",
+    "Album Rating",
+    "Album Rating Computed",
+    "Loved",
+    "Album Loved",
+    "Disliked",
+    "Album Disliked",
+    "Compilation",
+    "Artwork Count",
+    "Persistent ID",
+    "Track Type",
+    "Protected",
+    "Purchased",
+    "Has Video",
+    "HD",
+    "Video Width",
+    "Video Height",
+    "Movie",
+    "TV Show",
+    "Music Video",
+    "Podcast",
+    "iTunesU",
+    "Unplayed",
+    "Explicit",
+    "Clean",
+    "Disabled",
+    "Playlist Only",
+    "Apple Music",
+    "Matched",
+    "Name",
+    "Artist",
+    "Album Artist",
+    "Composer",
+    "Album",
+    "Grouping",
+    "Genre",
+    "Kind",
+    "Content Rating",
+    "Series",
+    "Season",
+    "Episode",
+    "Episode Order",
+    "Work",
+    "Movement Name",
+    "Movement Number",
+    "Movement Count",
+    "Location",
+    "File Folder Count",
+    "Library Folder Count",
+    "Sort Name",
+    "Sort Album",
+    "Sort Artist",
+    "Sort Album Artist",
+    "Sort Composer",
+    "Sort Series",
+    "Normalization",
+    "Playlist ID",
+    "Playlist Persistent ID",
+    "Parent Persistent ID",
+    "All Items",
+    "Master",
+    "Visible",
+    "Distinguished Kind",
+    "Music",
+    "Movies",
+    "TV Shows",
+    "Podcasts",
+    "Audiobooks",
+    "Purchased Music",
+    "Folder",
+    "Description",
+    "Smart Info",
+    "Smart Criteria",
+    "Playlist Items",
+};
+
+/* Seeded FNV-1a, folded to KEY_SLOTS */
+static inline unsigned int
+_keyhash(const char *key, unsigned int seed)
+{
+    unsigned int h = seed;
+
+    while ( *key ) {
+        h ^= (unsigned char)*key++;
+        h *= 16777619U;
+    }
+    return ( ( h ^ ( h >> 15 ) ) & ( KEY_SLOTS - 1 ) );
+}
+
+#ifndef KEYS_GENERATE
+
+/* Generated by KEYS_GENERATE, below.  Do not edit by hand. */
+#define KEY_SEED 2166136991U
+
+static const unsigned char _keytable[KEY_SLOTS] = {
+      0,   0,   0,   0,   0,   0,   0,   0,   0,  97,   0,  18,   0,  11,   0,   0,
+     76,   0,   0,   0,   0,  32,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   5,   0,   0,  30,   0,   7,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+     90,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,  21,   0,   0,  29,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,  39,   0, 109,   0,   0,   0,   0,   0,  69,   0,   0,   0,   0,   0,
+      2,   0,   0,   0,   0,   0, 107,   0,  74,   0,   0,   0,   0,   0,   0,   0,
+      0,  47,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0, 105,
+      0,  16,   0,   0,   0,  50,   0,   0,   0,   0,   0,   0,   0,   0,  26,   0,
+      0,   0,   0,   0,   0,   1,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,  71,   0,   0,   0,   0,
+     34,   0,   0,  70,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,  51,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,  14,  92,   0,   0,   0,   0,   8,  55,   0,   0,   0,   0,  78,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,  35,
+      0,  25,  10,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,  52,   0,
+     60,   0,   0,   0,   0,   0,   0,   0,   0,   0,  73,   0,   0,   0,  53,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,  89,   0,   0,   0,   0,   0,
+      9,   0,   0,   0,  46,   0,   0,  56,   0,   0,  95,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0, 108,   0,   0,   0,   0, 106,   0,   0,   0,   0,   0,  63,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,  61,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,  13,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+     19,   0,   0,   0,   0,  87,   0,   0,   0,   0,   0,  24,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,  54,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,  57,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,  37,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,  38,   0,   0,   0,   0,   0,   0,  65,   0,   0,
+      0,   0, 110,  80,   0,   0,   0,   0,  68,   0,   0,   0,  49,   0,   0,   0,
+      0,   0,   0,   0,   0,  22,   0,   0,   0,   0,   0,   0,   0,   0,   0,  36,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,  15,   0,   0,   0,   0,
+      0,   0,  58,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0, 101,
+      0,   0,   0,   0,   0,   0,  85,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,  93,  33,   0,   3,   0,   0,   0,   0,   0,   0,  48,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,  42,   0,   0,   0,   0,   0,   0,  23,   0,
+      0,  72,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+     77,  82,   0,  66,   0,   0,   0,   0,   0,   0,   0,  99,   0,  27,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,  41,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+     81,   0,   0,   0,   0,   0,  79,   0,   0,   0,   0,   0,  44,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,  45,   0,   0,
+      0,  88,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,  94,   0,   0,   0,   0,   0,  75,   0,   0, 103,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0, 104,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+     86,   0,   0,   0,   0,   0,  28,   0,   0,   0,   0,  31, 100,   0,   0,   0,
+      0,   0,  12,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,  64,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,  67,   0,   0,  40,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,  17,   0,   0,
+      0,   0,   0,  62,   0,   0,   0,  96,   0,   0,   0,  98,   0,   0,   0,   0,
+      6,   0,   0,   0,   0,   0,  20,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,  91,   0,   0,   0,   0,   0,   0,  84,   4,   0,   0,   0,
+      0,   0,   0,  43,  59,   0,   0,   0,   0,   0,   0,   0,  83,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0, 102,   0,   0,   0,   0,   0,   0,   0,   0,
+};
+
+/**
+ * function: itunesKey
+ * key: the text of a <key> element
+ *
+ * Returns the enum itunesKey, K_UNKNOWN for anything not in the set.
+ */
+enum itunesKey
+itunesKey(const char *key)
+{
+    unsigned char k = _keytable[_keyhash(key, KEY_SEED)];
+
+    if ( ( k ) && ( 0 == strcmp(_keyname[k], key) ) ) {
+        return (enum itunesKey)k;
+    }
+    return K_UNKNOWN;
+}
+
+
+const char *
+itunesKeyName(enum itunesKey k)
+{
+    if ( ( k <= K_UNKNOWN ) || ( k >= K_COUNT ) ) {
+        return "";
+    }
+    return _keyname[k];
+}
+
+#else /* KEYS_GENERATE */
+
+/****************************************************************************
+ * Search for the first seed with no collisions and print the table.
+ */
+int
+main(void)
+{
+    unsigned char table[KEY_SLOTS];
+    unsigned int  seed = 2166136261U;   // FNV offset basis
+    int           k    = 0;
+
+    for ( ; ; seed++ ) {
+        memset(table, 0, KEY_SLOTS);
+        for ( k = 1; k < K_COUNT; k++ ) {
+            unsigned int slot = _keyhash(_keyname[k], seed);
+            if ( table[slot] ) {
+                break;
+            }
+            table[slot] = k;
+        }
+        if ( K_COUNT == k ) {
+            break;
+        }
+    }
+
+    printf("#define KEY_SEED %uU\n\n", seed);
+    printf("static const unsigned char _keytable[KEY_SLOTS] = {");
+    for ( k = 0; k < KEY_SLOTS; k++ ) {
+        printf("%s%3d,", ( 0 == ( k % 16 ) ? "\n    " : " " ), table[k]);
+    }
+    printf("\n};\n");
+    return 0;
+}
+
+#endif /* KEYS_GENERATE */
+
+/**
+ * vim: sw=4 ts=4 expandtab
+ * EOF: keys.c
+ */
@@ -0,0 +1,146 @@
+/****************************************************************************
+ * File: keys.h
+ *
+ * keys.c, storage.c, track_storage.c, list_storage.c
+ *
+ * Copyright (c) 2019-2024, Gary Allen Vollink.  http://voll.ink/playlister
+ * All rights reserved.
+ *
+ * Licence to use, see LICENSE file in this distribution.
+ */
+#ifndef KEYS_H
+#define KEYS_H 1
+#include "utils.h"
+
+/****
+ * Every <key> name iTunes is known to write into a Library.xml.
+ * ORDER MATTERS: keys.c (_keyname[]) is in the same order, and the
+ * perfect hash table in keys.c stores these values.  Append new keys just
+ * before K_COUNT and regenerate the table (see keys.c).
+ */
+enum itunesKey {
+    K_UNKNOWN = 0,          // Not a known key (or a <dict> id key)
+    /* Library (top level) */
+    K_MAJOR_VERSION,
+    K_MINOR_VERSION,
+    K_DATE,
+    K_APPLICATION_VERSION,
+    K_FEATURES,
+    K_SHOW_CONTENT_RATINGS,
+    K_MUSIC_FOLDER,
+    K_LIBRARY_PERSISTENT_ID,
+    K_TRACKS,
+    K_PLAYLISTS,
+    /* Tracks */
+    K_TRACK_ID,
+    K_SIZE,
+    K_TOTAL_TIME,
+    K_START_TIME,
+    K_STOP_TIME,
+    K_DISC_NUMBER,
+    K_DISC_COUNT,
+    K_TRACK_NUMBER,
+    K_TRACK_COUNT,
+    K_YEAR,
+    K_BPM,
+    K_DATE_MODIFIED,
+    K_DATE_ADDED,
+    K_BIT_RATE,
+    K_SAMPLE_RATE,
+    K_VOLUME_ADJUSTMENT,
+    K_PART_OF_GAPLESS_ALBUM,
+    K_EQUALIZER,
+    K_COMMENTS,
+    K_PLAY_COUNT,
+    K_PLAY_DATE,
+    K_PLAY_DATE_UTC,
+    K_SKIP_COUNT,
+    K_SKIP_DATE,
+    K_RELEASE_DATE,
+    K_RATING,
+    K_RATING_COMPUTED,
+    K_ALBUM_RATING,
+    K_ALBUM_RATING_COMPUTED,
+    K_LOVED,
+    K_ALBUM_LOVED,
+    K_DISLIKED,
+    K_ALBUM_DISLIKED,
+    K_COMPILATION,
+    K_ARTWORK_COUNT,
+    K_PERSISTENT_ID,
+    K_TRACK_TYPE,
+    K_PROTECTED,
+    K_PURCHASED,
+    K_HAS_VIDEO,
+    K_HD,
+    K_VIDEO_WIDTH,
+    K_VIDEO_HEIGHT,
+    K_MOVIE,
+    K_TV_SHOW,
+    K_MUSIC_VIDEO,
+    K_PODCAST,
+    K_ITUNESU,
+    K_UNPLAYED,
+    K_EXPLICIT,
+    K_CLEAN,
+    K_DISABLED,
+    K_PLAYLIST_ONLY,
+    K_APPLE_MUSIC,
+    K_MATCHED,
+    K_NAME,
+    K_ARTIST,
+    K_ALBUM_ARTIST,
+    K_COMPOSER,
+    K_ALBUM,
+    K_GROUPING,
+    K_GENRE,
+    K_KIND,
+    K_CONTENT_RATING,
+    K_SERIES,
+    K_SEASON,
+    K_EPISODE,
+    K_EPISODE_ORDER,
+    K_WORK,
+    K_MOVEMENT_NAME,
+    K_MOVEMENT_NUMBER,
+    K_MOVEMENT_COUNT,
+    K_LOCATION,
+    K_FILE_FOLDER_COUNT,
+    K_LIBRARY_FOLDER_COUNT,
+    K_SORT_NAME,
+    K_SORT_ALBUM,
+    K_SORT_ARTIST,
+    K_SORT_ALBUM_ARTIST,
+    K_SORT_COMPOSER,
+    K_SORT_SERIES,
+    K_NORMALIZATION,
+    /* Playlists */
+    K_PLAYLIST_ID,
+    K_PLAYLIST_PERSISTENT_ID,
+    K_PARENT_PERSISTENT_ID,
+    K_ALL_ITEMS,
+    K_MASTER,
+    K_VISIBLE,
+    K_DISTINGUISHED_KIND,
+    K_MUSIC,
+    K_MOVIES,
+    K_TV_SHOWS,
+    K_PODCASTS,
+    K_AUDIOBOOKS,
+    K_PURCHASED_MUSIC,
+    K_FOLDER,
+    K_DESCRIPTION,
+    K_SMART_INFO,
+    K_SMART_CRITERIA,
+    K_PLAYLIST_ITEMS,
+    K_COUNT                 // Not a key, keep last
+};
+
+enum itunesKey itunesKey    (const char *key);
+const char   * itunesKeyName(enum itunesKey k);
+
+#endif /* KEYS_H */
+/**
+vim: sw=4 ts=4 expandtab
+ * EOF: keys.h
+ */
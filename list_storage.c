@@ -19,67 +19,485 @@
 #include "utils.h"
 #include "options.h"
 #include "storage.h"
+#include "region.h"
 
 
 struct list *playlist = NULL;
+struct listpool list_members;
+struct listindex list_index;
 
+/****
+ * Every playlist name any device asked for, built by listProject().
+ * plid is the Playlist ID that took the name, the first one wins.
+ */
+struct wantname {
+    const char    *name;    // borrowed from the device's listopts
+    int            plid;
+    UT_hash_handle hh;
+};
+
+static struct wantname *wantnames  = NULL;
+static int              wantcount  = 0;
+static int              claimcount = 0;
+
+/****************************************************************************
+ * Want name, if nothing has yet.  A name kept from a composite expression
+ * is copied, the device's listopts only holds the whole expression.
+ */
+static void
+_want_name(const char *name, int copy)
+{
+    struct wantname *want = NULL;
+    char            *keep = NULL;
+
+    HASH_FIND_STR(wantnames, name, want);
+    if ( NULL != want ) {
+        return;
+    }
+    want = regionAlloc(&parse_region, sizeof(struct wantname));
+    if ( copy ) {
+        keep = regionAlloc(&parse_region, strlen(name) + 1);
+        strcpy(keep, name);
+        name = keep;
+    }
+    want->name = name;
+    want->plid = 0;
+    HASH_ADD_KEYPTR(hh, wantnames, want->name, strlen(want->name), want);
+    wantcount++;
+}
+
+/****************************************************************************
+ * Collect the distinct requested names from every device.  A composite
+ * list is not read from iTunes, the playlists it is made from are.
+ */
+void
+listProject()
+{
+    const char *expr = NULL;
+    char        name[1025];
+    char        op   = 0;
+
+    wantcount  = 0;
+    claimcount = 0;
+    for ( struct options *dev = (struct options *) utarray_front(Devices)
+        ; dev != NULL
+        ; dev = (struct options *) utarray_next(Devices, dev)
+        ) {
+        for ( struct listopts * lo
+                = (struct listopts *) utarray_front(dev->playlist)
+            ; lo != NULL
+            ; lo = (struct listopts *) utarray_next(dev->playlist, lo)
+            ) {
+            if ( 0 == strlen(lo->compose) ) {
+                _want_name(lo->name, 0);
+                continue;
+            }
+            expr = lo->compose;
+            while ( 0 < composeNext(&expr, &op, name, sizeof(name)) ) {
+                _want_name(name, 1);
+            }
+        }
+    }
+}
+
+/****************************************************************************
+ * True once every requested name has been taken by a playlist.  Callers
+ * only ask between playlists (or after a Playlist Items array closes), so
+ * every list taken so far is complete.  This only works because lists are
+ * selected by exact name, a selection without a known set of names would
+ * have to read to the end.
+ */
 int
-want_list(int plid, char* name)
+lists_complete()
 {
-    if ( utarray_len(Opts.playlist) ) {
-        for ( char ** list = (char **) utarray_front(Opts.playlist)
+    return ( claimcount == wantcount );
+}
+
+int
+want_list(struct options *opts, int plid, char* name)
+{
+    if ( utarray_len(opts->playlist) ) {
+        for ( struct listopts * list
+                = (struct listopts *) utarray_front(opts->playlist)
             ; list != NULL
-            ; list = (char **) utarray_next(Opts.playlist, list)
+            ; list = (struct listopts *) utarray_next(opts->playlist, list)
             ) {
-            if ( 0 == str_diffn(name, *list, 1024) ) {
+            if (   ( 0 == strlen(list->compose) )
+                && ( 0 == str_diffn(name, list->name, 1024) ) ) {
                 return plid;
             }
         }
     }
-    extradebug("want_list:Reject iTunes Playlist: [%s]\n", name);
     return 0;
 }
 
+/****************************************************************************
+ * A playlist is kept while parsing if ANY device configuration wants it.
+ * iTunes allows two playlists with the same name, only the first is kept.
+ */
 int
-set_list(int plid, char* name, char* value)
+want_list_any(int plid, char* name)
+{
+    struct wantname *want = NULL;
+
+    HASH_FIND_STR(wantnames, name, want);
+    if ( NULL == want ) {
+        extradebug("want_list:Reject iTunes Playlist: [%s]\n", name);
+        return 0;
+    }
+    if ( ( want->plid ) && ( plid != want->plid ) ) {
+        mydebug("want_list:Playlist %i is also named [%s], using %i\n"
+                , plid, name, want->plid);
+        return 0;
+    }
+    if ( 0 == want->plid ) {
+        want->plid = plid;
+        claimcount++;
+    }
+    return plid;
+}
+
+/****************************************************************************
+ * Fill names (ut_str_icd) with every requested playlist name.
+ */
+void
+want_names(UT_array *names)
+{
+    struct wantname *want, *wtmp;
+
+    HASH_ITER(hh, wantnames, want, wtmp) {
+        utarray_push_back(names, &want->name);
+    }
+}
+
+/****************************************************************************
+ * The playlist with this Playlist ID, created (wanted, no tracks) if it
+ * isn't stored yet.
+ */
+struct list *
+listAdd(int plid)
 {
     struct list *work = NULL;
-    int cx = 0;
 
     HASH_FIND_INT(playlist, &plid, work);
     if ( NULL == work ) {
-        work = malloc( sizeof(struct list) );
-        if ( NULL == work ) {
-            mydebug("setlist:Unable to allocate %ld bytes of space: %s\n",
-                    sizeof(struct list), strerror(errno));
-            exit(-2);
-        }
-        // Full Initialization of new playlist
-        memset((void *)work, 0, sizeof(struct list));
+        // Zeroed, freed with the rest of parse_region by storageFree()
+        work = regionAlloc(&parse_region, sizeof(struct list));
         work->wanted = 1; // Default to wanted, until we have a playlist name.
         work->id = plid;  // id should be set to iTunes Playlist ID
-        utarray_new(work->trid, &ut_int_icd);
         HASH_ADD_INT(playlist, id, work);
     }
-    if (0 == str_diffn("Name", name, 5) ) {
-        strncpy(work->name, value, 1024);
-        if ( ! want_list(plid, value) ) {
-            work->wanted = 0;
+    return work;
+}
+
+/****************************************************************************
+ * This list's members.  Only good until the next listAppend().
+ */
+uint32_t *
+listRefs(struct list *work)
+{
+    return list_members.ref + work->first;
+}
+
+/****************************************************************************
+ * Add a member at the end of work.  A list's items arrive together, so
+ * its run is normally the last one in the pool; if another list was
+ * appended to since, the run is moved to the end first.
+ */
+void
+listAppend(struct list *work, uint32_t ref)
+{
+    struct listpool *pool = &list_members;
+    uint32_t        *grow = NULL;
+    uint32_t         move = 0;
+    uint32_t         size = 0;
+
+    if ( ( work->count ) && ( work->first + work->count != pool->used ) ) {
+        move = work->count;
+    }
+    if ( pool->used + move + 1 > pool->size ) {
+        size = ( pool->size ? pool->size * 2 : 65536 );
+        while ( pool->used + move + 1 > size ) {
+            size *= 2;
+        }
+        if ( NULL == ( grow = realloc(pool->ref, size * sizeof(uint32_t)) ) ) {
+            mydebug("listAppend:Unable to allocate %ld bytes of space: %s\n",
+                    size * sizeof(uint32_t), strerror(errno));
+            exit(2);
         }
+        pool->ref  = grow;
+        pool->size = size;
+    }
+    if ( move ) {
+        memcpy(pool->ref + pool->used, pool->ref + work->first
+                , move * sizeof(uint32_t));
+        work->first = pool->used;
+        pool->used += move;
+    }
+    else if ( 0 == work->count ) {
+        work->first = pool->used;
+    }
+    pool->ref[pool->used++] = ref;
+    work->count++;
+}
+
+/****************************************************************************
+ * Presize the member pool for members Playlist Items (see storageEstimate).
+ */
+void
+listReserve(long members)
+{
+    struct listpool *pool = &list_members;
+    uint32_t        *grow = NULL;
+
+    if ( ( 0 >= members ) || ( pool->size >= members ) ) {
+        return;
+    }
+    if ( UINT32_MAX < members ) {
+        members = UINT32_MAX;
+    }
+    if ( NULL == ( grow = realloc(pool->ref, members * sizeof(uint32_t)) ) ) {
+        mydebug("listReserve:Unable to allocate %ld bytes of space: %s\n",
+                members * sizeof(uint32_t), strerror(errno));
+        exit(2);
+    }
+    pool->ref  = grow;
+    pool->size = (uint32_t)members;
+}
+
+int
+set_list(int plid, enum itunesKey key, char* value)
+{
+    struct list *work = listAdd(plid);
+
+    if ( K_PLAYLIST_PERSISTENT_ID == key ) {
+        work->ppid = strtoull(value, NULL, 16);
+    }
+    else if ( K_NAME == key ) {
+        strncpy(work->name, value, 1024);
         if ( 4 <= Opts.verbose ) {
             printf("Found Playlist Named: [%s]\n", work->name);
         }
+        if ( ! want_list_any(plid, value) ) {
+            work->wanted = 0;
+            return 1;   // set_node stops reading this list
+        }
     }
-    if (0 == str_diffn("Track ID", name, 5) ) {
+    else if ( K_TRACK_ID == key ) {
         if ( work->wanted ) {
-            int v = atoi(value);
-            utarray_push_back(work->trid, &v);
+            listAppend(work, (uint32_t)atoi(value));
         }
     }
     return 0;
 }
 
 
+/****************************************************************************
+ * Count, then place, each list's members by track slot (struct listindex).
+ * Both passes walk the member pool once; a track named twice in one list
+ * is only counted once, since a list's members are walked together and
+ * seen[] remembers the last list that counted each slot.
+ */
+static void
+_list_index()
+{
+    struct listindex *idx = &list_index;
+    struct list      *curlst, *ltmp;
+    uint32_t         *refs = NULL;
+    uint32_t         *seen = NULL;
+    uint32_t         *fill = NULL;
+    uint32_t          lx   = 0;
+    uint32_t          sum  = 0;
+    uint32_t          cnt  = 0;
+
+    idx->tracks = track.count;
+    idx->start  = calloc(( track.count + 1 ), sizeof(uint32_t));
+    seen = calloc(( track.count + 1 ), sizeof(uint32_t));
+    if ( ( NULL == idx->start ) || ( NULL == seen ) ) {
+        mydebug("listSeal:Unable to allocate %ld bytes of space: %s\n",
+                ( track.count + 1 ) * sizeof(uint32_t), strerror(errno));
+        exit(2);
+    }
+
+    // Pass one, how many lists hold each slot (start[slot + 1], for now)
+    HASH_ITER(hh, playlist, curlst, ltmp) {
+        lx++;
+        refs = listRefs(curlst);
+        for ( uint32_t cx = 0; cx < curlst->count; cx++ ) {
+            if ( lx != seen[refs[cx]] ) {
+                seen[refs[cx]] = lx;
+                idx->start[refs[cx] + 1]++;
+            }
+        }
+    }
+    for ( uint32_t cx = 0; cx < track.count; cx++ ) {
+        cnt = idx->start[cx + 1];
+        idx->start[cx + 1] = sum + cnt;
+        sum += cnt;
+    }
+    idx->used = sum;
+    if ( NULL == ( idx->list = malloc(( sum ? sum : 1 )
+                    * sizeof(struct list *)) ) ) {
+        mydebug("listSeal:Unable to allocate %ld bytes of space: %s\n",
+                sum * sizeof(struct list *), strerror(errno));
+        exit(2);
+    }
+
+    // Pass two, seen[] is reused as each slot's next free entry
+    fill = seen;
+    memcpy(fill, idx->start, track.count * sizeof(uint32_t));
+    HASH_ITER(hh, playlist, curlst, ltmp) {
+        refs = listRefs(curlst);
+        for ( uint32_t cx = 0; cx < curlst->count; cx++ ) {
+            if (   ( fill[refs[cx]] == idx->start[refs[cx]] )
+                || ( curlst != idx->list[fill[refs[cx]] - 1] ) ) {
+                idx->list[fill[refs[cx]]++] = curlst;
+            }
+        }
+    }
+    free(seen);
+}
+
+/****************************************************************************
+ * The kept playlist named name, or NULL.
+ */
+static struct list *
+_list_named(const char *name)
+{
+    struct wantname *want = NULL;
+    struct list     *work = NULL;
+
+    HASH_FIND_STR(wantnames, name, want);
+    if ( ( NULL == want ) || ( 0 == want->plid ) ) {
+        return NULL;
+    }
+    HASH_FIND_INT(playlist, &want->plid, work);
+    return work;
+}
+
+/****************************************************************************
+ * Build the composite list lo (see parseListEntry) from the playlists it
+ * names, after storageSeal().  Each operand is a bitset over track slots
+ * (COL_BIT, COL_SET and COL_CLR, as for the columns), combined left to
+ * right a word at a time.  The members are then taken in order from the
+ * first operand and from each one joined by '|'; a track is in the result
+ * once, where it first appears.  Its members go at the end of
+ * list_members, the list itself lives in parse_region.
+ */
+struct list *
+listCompose(struct listopts *lo)
+{
+    struct list *work  = NULL;
+    struct list *src   = NULL;
+    const char  *expr  = NULL;
+    uint64_t    *have  = NULL;
+    uint64_t    *with  = NULL;
+    uint32_t    *refs  = NULL;
+    uint32_t     words = ( track.count + 63 ) / 64;
+    char         name[1025];
+    char         op    = 0;
+
+    // Zeroed, given back with the first line written (_write_list)
+    have = regionAlloc(&render_region, ( words + 1 ) * sizeof(uint64_t));
+    with = regionAlloc(&render_region, ( words + 1 ) * sizeof(uint64_t));
+
+    expr = lo->compose;
+    while ( 0 < composeNext(&expr, &op, name, sizeof(name)) ) {
+        if ( NULL == ( src = _list_named(name) ) ) {
+            mywarning("listCompose: %s uses %s, which was not found.\n"
+                    , lo->name, name);
+        }
+        memset(with, 0, words * sizeof(uint64_t));
+        if ( src ) {
+            refs = listRefs(src);
+            for ( uint32_t cx = 0; cx < src->count; cx++ ) {
+                COL_SET(with, refs[cx]);
+            }
+        }
+        for ( uint32_t wx = 0; wx < words; wx++ ) {
+            switch ( op ) {
+                case '&':
+                    have[wx] &= with[wx];
+                    break;
+                case '-':
+                    have[wx] &= ~with[wx];
+                    break;
+                default:    // '|', and the first operand
+                    have[wx] |= with[wx];
+                    break;
+            }
+        }
+    }
+
+    work = regionAlloc(&parse_region, sizeof(struct list));
+    work->id     = -1;
+    work->wanted = 1;
+    strncpy(work->name, lo->name, sizeof(work->name) - 1);
+    work->name[sizeof(work->name) - 1] = '\0';
+
+    // Emptied as it goes, so each track is taken once
+    expr = lo->compose;
+    while ( 0 < composeNext(&expr, &op, name, sizeof(name)) ) {
+        if (   ( ( 0 != op ) && ( '|' != op ) )
+            || ( NULL == ( src = _list_named(name) ) ) ) {
+            continue;
+        }
+        for ( uint32_t cx = 0; cx < src->count; cx++ ) {
+            refs = listRefs(src);   // listAppend() may move the pool
+            if ( COL_BIT(have, refs[cx]) ) {
+                COL_CLR(have, refs[cx]);
+                listAppend(work, refs[cx]);
+            }
+        }
+    }
+    extradebug("listCompose: %s = %s, %u tracks\n"
+            , work->name, lo->compose, work->count);
+    return work;
+}
+
+/****************************************************************************
+ * Track IDs to track slots, see storageSeal().  A Track ID with no track
+ * is dropped (with a warning) here, once, not for every device.
+ */
+void
+listSeal()
+{
+    struct list *curlst, *ltmp;
+    uint32_t    *refs = NULL;
+    uint32_t     out  = 0;
+    int          slot = -1;
+
+    HASH_ITER(hh, playlist, curlst, ltmp) {
+        refs = listRefs(curlst);
+        out  = 0;
+        for ( uint32_t cx = 0; cx < curlst->count; cx++ ) {
+            if ( 0 > ( slot = trackSlot((int)refs[cx]) ) ) {
+                mywarning("Track ID %i Referenced in playlist, but not found.\n"
+                        , (int)refs[cx]);
+                continue;
+            }
+            refs[out++] = (uint32_t)slot;
+        }
+        curlst->count = out;
+    }
+    _list_index();
+}
+
+/****************************************************************************
+ * The lists holding track slot, and how many (count), see listSeal().
+ */
+struct list **
+listsOf(uint32_t slot, uint32_t *count)
+{
+    if ( slot >= list_index.tracks ) {
+        *count = 0;
+        return NULL;
+    }
+    *count = list_index.start[slot + 1] - list_index.start[slot];
+    return list_index.list + list_index.start[slot];
+}
+
+
 void
 listInfo()
 {
@@ -90,17 +508,17 @@ listInfo()
         return;
     }
 
+    mydebug("lI: Index: %u memberships over %u tracks, %ld KB\n"
+            , list_index.used, list_index.tracks
+            , (long)( ( ( list_index.tracks + 1 ) * sizeof(uint32_t)
+                + list_index.used * sizeof(struct list *) ) / 1024 ));
+
     HASH_ITER(hh, playlist, curlst, ltmp) {
-        cx = 0;
+        cx = (int)curlst->count;
         if ( curlst->wanted ) {
             mydebug("lI: %s (id:%i)"
                 , curlst->name, curlst->id
                 );
-            for (int *trackid = (int *) utarray_front(curlst->trid)
-                ; NULL != trackid
-                ; trackid = (int *) utarray_next(curlst->trid, trackid)
-                  , cx++ ) {
-            }
             if (cx) {
                 mydebug("\twith %i track%s\n", cx, (1<cx?"s":""));
             }
@@ -112,17 +530,20 @@ listInfo()
 }
 
 
+/****************************************************************************
+ * The lists and names themselves are in parse_region, only the hash
+ * tables and the member pool are let go here.
+ */
 void
 listFree()
 {
-    struct list *curlst, *ltmp;
-    HASH_ITER(hh, playlist, curlst, ltmp) {
-        if (curlst->trid) {
-            utarray_free(curlst->trid);
-        }
-        HASH_DEL(playlist, curlst);
-        free(curlst);
-    }
+    HASH_CLEAR(hh, wantnames);
+    HASH_CLEAR(hh, playlist);
+    free(list_members.ref);
+    memset(&list_members, 0, sizeof(struct listpool));
+    free(list_index.start);
+    free(list_index.list);
+    memset(&list_index, 0, sizeof(struct listindex));
 }
 
 /**
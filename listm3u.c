@@ -8,31 +8,75 @@
  */
 #define LISTM3U_C 1
 #include <stdio.h>
+#include <stdlib.h>      // calloc, exit
+#include <sys/stat.h>    // stat
 #include <sys/errno.h>   // errno
 #include <string.h>      // strerror
 #include "utils.h"       // string manipulation stuff
-#include "storage.h"     // struct list *playlist, struct trackmap *track
+#include "storage.h"     // struct list *playlist, struct tracktab track
 #include "options.h"     // struct options Opts
 #include "listm3u.h"     // Probably not needed.
+#include "cache.h"       // cacheListUnchanged
+#include "region.h"      // render_region
 
 
-char * _mk_list_filename(char *filepath, struct list *work, size_t pathsz);
-struct trackmap * _get_track        (int trackid);
-char            * _fix_track_path   (int trackid, char *trackpath, size_t tpsz);
-int               _fprintM3UExtended(FILE *fh, int trackid);
+char * _mk_list_filename(struct options *opts, struct listopts *lo
+                        , char *filepath, struct list *work, size_t pathsz);
+char            * _fix_track_path   (struct options *opts
+                                        , struct list *list, uint32_t slot
+                                        , char *trackpath, size_t tpsz);
+int               _fprintM3UExtended(FILE *fh, struct trackmap *work);
 FILE            * _open_list_file   (char *filepath);
-void              _write_list       (struct list *work);
+void              _write_list       (struct options *opts
+                                        , struct listopts *lo
+                                        , struct list *work);
+
+/****
+ * --verify, for one device at a time: what came of looking for each track
+ * slot's file, so that a track in several lists is looked for (and warned
+ * about) once.
+ */
+enum verdict {
+    V_UNKNOWN = 0,
+    V_FOUND,
+    V_MISSING
+};
+static char *verified = NULL;
 
 
+/****************************************************************************
+ * Write every list that the device configuration (opts) asked for.
+ * Called once per device, all devices share the parsed playlist table.
+ * A list named more than once under [lists] is written once per entry,
+ * each with its own overrides.
+ */
 void
-createLists()
+createLists(struct options *opts)
 {
     struct list *curlst, *ltmp = NULL;
 
+    if ( ( opts->verify ) && ( NULL == ( verified
+                    = calloc(( track.count ? track.count : 1 ), 1) ) ) ) {
+        mydebug("createLists:Unable to allocate %ld bytes of space: %s\n",
+                (long)track.count, strerror(errno));
+        exit(2);
+    }
+
     HASH_ITER(hh, playlist, curlst, ltmp) {
-        if ( curlst->wanted ) {
-            if ( 0 < utarray_len( curlst->trid ) ) {
-                _write_list(curlst);
+        if ( ! curlst->wanted ) {
+            continue;
+        }
+        for ( struct listopts * lo
+                = (struct listopts *) utarray_front(opts->playlist)
+            ; lo != NULL
+            ; lo = (struct listopts *) utarray_next(opts->playlist, lo)
+            ) {
+            if (   ( strlen(lo->compose) )
+                || ( str_diffn(curlst->name, lo->name, 1024) ) ) {
+                continue;
+            }
+            if ( 0 < curlst->count ) {
+                _write_list(opts, lo, curlst);
             }
             else {
                 mywarning("createLists: Requested list %s has no tracks.\n"
@@ -40,6 +84,29 @@ createLists()
             }
         }
     }
+
+    // Composite lists, made from the playlists above (listCompose)
+    for ( struct listopts * lo
+            = (struct listopts *) utarray_front(opts->playlist)
+        ; lo != NULL
+        ; lo = (struct listopts *) utarray_next(opts->playlist, lo)
+        ) {
+        if ( 0 == strlen(lo->compose) ) {
+            continue;
+        }
+        curlst = listCompose(lo);
+        if ( 0 < curlst->count ) {
+            _write_list(opts, lo, curlst);
+        }
+        else {
+            mywarning("createLists: Requested list %s has no tracks.\n"
+                    , curlst->name);
+        }
+        regionReset(&render_region);
+    }
+    regionFree(&render_region);
+    free(verified);
+    verified = NULL;
 }
 
 /****************************************************************************
@@ -47,10 +114,11 @@ createLists()
  * That means we're substituting or skipping invalid characters.
  */
 char *
-_mk_list_filename(char *filepath, struct list *work, size_t pathsz)
+_mk_list_filename(struct options *opts, struct listopts *lo
+                    , char *filepath, struct list *work, size_t pathsz)
 {
     char filebase[1024] = "\0\0\0\0\0\0";
-    char * tmp;
+    char * extension = opts->extension;
     // I'm using this to track utf8 expected, but I'm not actually doing
     // anything with an error, since I'm killing anything over 127 anyway.
     char utf8step = 0;
@@ -139,11 +207,14 @@ _mk_list_filename(char *filepath, struct list *work, size_t pathsz)
                 cx--;
             }
         } /* END ** for ( cx < size of filebase ) */
-        if ( '.' != Opts.extension[0] ) {
+        if ( strlen(lo->extension) ) {
+            extension = lo->extension;
+        }
+        if ( '.' != extension[0] ) {
             strncpy(filebase + strlen(filebase), "."
                     , ( 1024 - strlen(filebase)) );
         }
-        strncpy(filebase + strlen(filebase), Opts.extension
+        strncpy(filebase + strlen(filebase), extension
                 , ( 1024 - strlen(filebase)) );
         mydebug("List %s will be created as filebase [%s]\n"
                 , work->name, filebase);
@@ -154,7 +225,7 @@ _mk_list_filename(char *filepath, struct list *work, size_t pathsz)
         return NULL;
     }
 
-    strncpy(filepath, Opts.output_path, pathsz);
+    strncpy(filepath, opts->output_path, pathsz);
     if ( '/' != filepath[strlen(filepath)-1] ) {
         strncpy(filepath + strlen(filepath), "/", pathsz - strlen(filepath));
     }
@@ -166,66 +237,90 @@ _mk_list_filename(char *filepath, struct list *work, size_t pathsz)
     return filepath;
 }
 
-struct trackmap *
-_get_track(int trackid)
+/****************************************************************************
+ * Name every list of this device that holds the track in slot, once its
+ * file is found missing (see listsOf).  A composite list isn't indexed,
+ * so if the track is only in one of those, list (being written) is named.
+ */
+static void
+_warn_lists(struct options *opts, struct list *list, uint32_t slot)
 {
-    struct trackmap *work = NULL;
-
-    HASH_FIND_INT(track, &trackid, work);
-    if ( NULL == work ) {
-        mywarning("Track ID %i Referenced in playlist, but not found.\n"
-                , trackid);
-        return NULL;
+    struct list **lists = NULL;
+    uint32_t      count = 0;
+    uint32_t      named = 0;
+    size_t        size  = 1;
+    char         *names = NULL;
+
+    lists = listsOf(slot, &count);
+    for ( uint32_t cx = 0; cx < count; cx++ ) {
+        if ( want_list(opts, lists[cx]->id, lists[cx]->name) ) {
+            size += strlen(lists[cx]->name) + 2;
+        }
+    }
+    // Zeroed, given back after the line is written (_write_list)
+    names = (char *)regionAlloc(&render_region, size);
+    for ( uint32_t cx = 0; cx < count; cx++ ) {
+        if ( want_list(opts, lists[cx]->id, lists[cx]->name) ) {
+            if ( named++ ) {
+                strcat(names, ", ");
+            }
+            strcat(names, lists[cx]->name);
+        }
+    }
+    if ( 0 == named ) {
+        names = list->name;
+        named = 1;
     }
-    return work;
+    mywarning("Missing file affects list%s %s\n"
+            , ( 1 < named ? "s" : "" ), names);
 }
 
-
 char *
-_fix_track_path(int trackid, char *trackpath, size_t tpsz)
+_fix_track_path(struct options *opts, struct list *list, uint32_t slot
+                    , char *trackpath, size_t tpsz)
 {
-    struct  trackmap  *work = NULL;
+    struct trackmap   *work = trackAt(slot);
+    struct stat     statbuf;
     char              *find = NULL;
     char               *ret = NULL;
 
-    if ( NULL == ( work = _get_track(trackid) ) ) {
-        return NULL;
-    }
-    strncpy(trackpath, work->file, tpsz);
+    strncpy(trackpath, trackStr(work->file), tpsz);
 
     if ( 0 == removeString(trackpath, "file://localhost", tpsz) ) {
         removeString(trackpath, "file://", tpsz);
     }
-    removeString(trackpath, Opts.itune_path, tpsz);
+    removeString(trackpath, opts->itune_path, tpsz);
 
-    prependString(trackpath, Opts.replace_path, tpsz);
+    prependString(trackpath, opts->replace_path, tpsz);
 
-    if (Opts.verify) {
-        if ( strlen( Opts.verify_path ) ) {
-            find = (char *)malloc( tpsz+1 );
-            if ( NULL == find ) {
-                myfatal("Out of memory.\n");
-                exit(2);
-            }
-            memset(find, 0, tpsz+1);
-            strncpy(find, work->file, tpsz);
+    if ( ( opts->verify ) && ( V_FOUND != verified[slot] ) ) {
+        if ( V_MISSING == verified[slot] ) {
+            return NULL;
+        }
+        if ( strlen( opts->verify_path ) ) {
+            // Zeroed, given back after the line is written (_write_list)
+            find = (char *)regionAlloc(&render_region, tpsz+1);
+            strncpy(find, trackStr(work->file), tpsz);
             if ( 0 == removeString(find, "file://localhost", tpsz) ) {
                 removeString(find, "file://", tpsz);
             }
-            removeString(find, Opts.itune_path, tpsz);
-            prependString(find, Opts.verify_path, tpsz);
+            removeString(find, opts->itune_path, tpsz);
+            prependString(find, opts->verify_path, tpsz);
         }
         else {
             find = trackpath;
         }
 
-        ret = checkFileExists(find, tpsz);
-        if ( find != trackpath ) {
-            free(find);
+        if ( 0 == stat(find, &statbuf) ) {
+            verified[slot] = V_FOUND;
         }
-        if ( NULL == ret ) {
+        else if ( NULL == ( ret = checkFileExists(find, tpsz) ) ) {
+            verified[slot] = V_MISSING;
+            _warn_lists(opts, list, slot);
             return NULL;
         }
+        // Else found with its letter case repaired, which may have changed
+        // trackpath, so it is looked for again in the next list.
     }
 
     superdebug("_fix_track_path: [%s]\n", trackpath);
@@ -248,31 +343,49 @@ _open_list_file(char *filepath)
 
 
 int
-_fprintM3UExtended(FILE *fh, int trackid)
+_fprintM3UExtended(FILE *fh, struct trackmap *work)
 {
     int       time = 0;
-    struct trackmap *work;
-
-    if ( NULL == ( work = _get_track(trackid) ) ) {
-        return 0;
-    }
 
     time = (int)( work->time / 1000 );
 
     return fprintf(fh, "#EXTINF:%i, %s - %s\n"
-                , time, work->artist, work->name );
+                , time, trackSym(work->artist), trackStr(work->name) );
 }
 
 
 void
-_write_list(struct list *work)
+_write_list(struct options *opts, struct listopts *lo, struct list *work)
 {
     char  filepath[2048] = "\0\0\0\0\0\0\0\0";
     char trackpath[2048] = "\0\0\0\0\0\0\0\0";
+    struct stat  statbuf;
+    uint32_t   *refs = listRefs(work);
+    UT_array *shuffled = NULL;
+    struct trackmap *trk = NULL;
+    int    randomize = opts->randomize;
+    int  m3uextended = opts->m3uextended;
     FILE *fh;
-    int cx = 0;
+    uint32_t cx = 0;
 
-    if ( NULL == _mk_list_filename(filepath, work, 2048) ) {
+    // Per list overrides from [lists]
+    if ( -1 != lo->randomize ) {
+        randomize = lo->randomize;
+    }
+    if ( -1 != lo->m3uextended ) {
+        m3uextended = lo->m3uextended;
+    }
+
+    if ( NULL == _mk_list_filename(opts, lo, filepath, work, 2048) ) {
+        return;
+    }
+
+    // --incremental: the same tracks would be written the same way.
+    if (   ( ! randomize ) && ( ! opts->verify )
+        && ( cacheListUnchanged(work) )
+        && ( 0 == stat(filepath, &statbuf) ) ) {
+        mydebug("List %s is unchanged, not writing %s\n"
+                , work->name, filepath);
         return;
     }
 
@@ -280,29 +393,40 @@ _write_list(struct list *work)
         return;
     }
 
-    if ( Opts.randomize ) {
-        randomUTarray(work->trid);
+    if ( ( randomize ) && ( work->count ) ) {
+        // Shuffle a copy, other devices still need the original order.
+        utarray_new(shuffled, &ut_int_icd);
+        utarray_reserve(shuffled, work->count);
+        for ( cx = 0; cx < work->count; cx++ ) {
+            utarray_push_back(shuffled, &refs[cx]);
+        }
+        randomUTarray(shuffled);
+        refs = (uint32_t *) utarray_front(shuffled);
     }
 
-    if ( Opts.m3uextended ) {
+    if ( m3uextended ) {
         fprintf(fh, "#EXTM3U\n");
     }
 
-    for (int *trackid = (int *) utarray_front(work->trid)
-            ; NULL != trackid
-            ; trackid = (int *) utarray_next(work->trid, trackid), cx++
-        ) {
+    // Track slots (see storageSeal), every one a stored track.
+    for ( cx = 0; cx < work->count; cx++ ) {
+        trk = trackAt(refs[cx]);
         mydebug("_write_list: List %s (%i), Track ID %i\n"
-                , work->name, work->id, *trackid);
-        if ( NULL != _fix_track_path(*trackid, trackpath, 2048) ) {
-            if ( Opts.m3uextended ) {
-                _fprintM3UExtended(fh, *trackid);
+                , work->name, work->id, trk->id);
+        if ( NULL != _fix_track_path(opts, work, refs[cx], trackpath, 2048) ) {
+            if ( m3uextended ) {
+                _fprintM3UExtended(fh, trk);
             }
             fprintf(fh, "%s\n", trackpath);
         }
+        regionReset(&render_region);
     }
 
     fclose(fh);
+
+    if ( shuffled ) {
+        utarray_free(shuffled);
+    }
 }
 
 
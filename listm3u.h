@@ -12,7 +12,8 @@
 #define LISTM3U_H 1
 #include "utils.h"
 
-void createLists();
+struct options;
+void createLists(struct options *opts);
 
 #endif /* LISTM3U_H */
 /**
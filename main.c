@@ -9,37 +9,114 @@
  * Licence to use, see LICENSE file in this distribution.
  */
 #define MAIN_C 1
+#include <string.h>       // strlen
 #include "utils.h"
 #include "reader1.h"
 #include "options.h"
 #include "storage.h"
 #include "listm3u.h"
+#include "cache.h"
+#include "stamp.h"
 
 
 int
 main(int argc, char **argv)
 {
+    struct options *dev   = NULL;
+    struct options *other = NULL;
+    int               dx  = 0;
+    int               ox  = 0;
+    int              seen = 0;
+    int          complete = 1;
+    int            parsed = 0;
+    int            status = 0;
+
     initUtils();
 
     parseOpts(argc, argv);
 
-    storageInit();
+    if ( stampUnchanged() ) {
+        OptsFree();
+        mydebug("Nothing changed since the last run, normal exit\n");
+        return(0);
+    }
+
+    /****
+     * Each distinct XML file is parsed only once, then every device
+     * configuration that points at it is written from the same tables.
+     */
+    for ( dx = 0; dx < utarray_len(Devices); dx++ ) {
+        dev = (struct options *) utarray_eltptr(Devices, dx);
+        seen = 0;
+        for ( ox = 0; ox < dx; ox++ ) {
+            other = (struct options *) utarray_eltptr(Devices, ox);
+            if ( 0 == str_diffn(other->itunes_xml_file
+                        , dev->itunes_xml_file, 1025) ) {
+                seen = 1;
+                break;
+            }
+        }
+        if ( seen ) {
+            continue;
+        }
+
+        // Half an XML would write half the playlists, over good ones.
+        if ( xmlPreflight(dev) ) {
+            complete = 0;
+            status   = 1;
+            continue;
+        }
 
-    streamFile(Opts.itunes_xml_file);
+        storageEstimate(dev->itunes_xml_file, dev->prescan);
+        storageInit();
 
-    // The whole point of this program!
-    createLists();
+        /****
+         * The first device naming this XML decides the cache settings.
+         */
+        parsed = 0;
+        if ( cacheLoad(dev) ) {
+            if ( 0 == streamFile(dev->itunes_xml_file, dev->parser
+                        , dev->threads) ) {
+                parsed = 1;
+            }
+            else {
+                complete = 0;
+                status = 1;
+            }
+        }
+        storageSeal();
+        if ( parsed ) {
+            cacheReport(dev);
+            cacheSave(dev);
+        }
 
-    // storage.c test output...
-    if (3 <= Opts.verbose) {
-        storageInfo();
+        // The whole point of this program!
+        for ( ox = dx; ox < utarray_len(Devices); ox++ ) {
+            other = (struct options *) utarray_eltptr(Devices, ox);
+            if ( 0 == str_diffn(other->itunes_xml_file
+                        , dev->itunes_xml_file, 1025) ) {
+                mydebug("Writing lists for %s\n"
+                        , (strlen(other->config)?other->config:"command line"));
+                createLists(other);
+            }
+        }
+
+        // storage.c test output...
+        if (3 <= Opts.verbose) {
+            storageInfo(dev->itunes_xml_file);
+        }
+
+        storageFree();
+        cacheFree();
     }
 
-    storageFree();
+    if ( complete ) {
+        stampSave();
+    }
 
     OptsFree();
     mydebug("Normal exit\n");
-    return(0);
+    return(status);
 }
 
 
@@ -19,8 +19,12 @@
 #include "options.h"
 
 struct options Opts;
+UT_array     * Devices = NULL;
 int            OptsInit = 0;
 
+static const UT_icd device_icd = { sizeof(struct options), NULL, NULL, NULL };
+static const UT_icd list_icd = { sizeof(struct listopts), NULL, NULL, NULL };
+
 void
 dohelp()
 {
@@ -38,7 +42,8 @@ dohelp()
     printf("\n");
     printf("\n");
     printf("-c --config\n");
-    printf("\tConfiguration File.\n");
+    printf("\tConfiguration File (can use multiple times, one per device).\n");
+    printf("\t  The XML is parsed once, shared by every configuration.\n");
     if ( strlen(Opts.config) ) {
         printf("\t\tValue: %s\n", Opts.config);
     }
@@ -67,8 +72,77 @@ dohelp()
     printf("\tRandomize m3u ouput.\n");
     printf("\t\tValue: %s\n", (Opts.randomize?"Yes":"No"));
     printf("\n");
+    printf("--parser (libxml|fast)\n");
+    printf("\tXML reader.  fast memory maps the file and scans the iTunes\n");
+    printf("\tplist subset directly, falling back to libxml if it finds\n");
+    printf("\tanything it does not expect.\n");
+    printf("\t\tValue: %s\n", (PARSER_FAST==Opts.parser?"fast":"libxml"));
+    printf("\n");
+    printf("--threads <n>\n");
+    printf("\tWith --parser fast, read the Tracks section of the XML with\n");
+    printf("\tn threads (0 is one per CPU).  Playlists are read by one.\n");
+    printf("\tWith libxml, any n but 1 stores what is read on a second\n");
+    printf("\tthread, while the first keeps reading.\n");
+    printf("\t\tValue: %i\n", Opts.threads);
+    printf("\n");
+    printf("--no-cache\n");
+    printf("--rebuild-cache\n");
+    printf("\tAfter a parse, the tracks and lists read are saved in a\n");
+    printf("\tsnapshot (XML file name + .plcache), and later runs load\n");
+    printf("\tthat instead while the XML is unchanged.  --no-cache never\n");
+    printf("\treads or writes one, --rebuild-cache always parses.\n");
+    printf("\t\tValue: %s\n", (CACHE_OFF==Opts.cache?"Off"
+                :(CACHE_REBUILD==Opts.cache?"Rebuild":"On")));
+    printf("\n");
+    printf("--cache_dir <path>\n");
+    printf("\tPut the snapshot here instead of beside the XML.\n");
+    if ( strlen(Opts.cache_dir) ) {
+        printf("\t\tValue: %s\n", Opts.cache_dir);
+    }
+    printf("\n");
+    printf("--incremental\n");
+    printf("\tWhen the XML changed since the snapshot, tracks whose\n");
+    printf("\tPersistent ID and Date Modified match it are copied from\n");
+    printf("\tthe snapshot instead of decoded, added, changed and removed\n");
+    printf("\ttracks and lists are reported, and a list whose tracks are\n");
+    printf("\tall unchanged is not rewritten (unless random or verify).\n");
+    printf("\t\tValue: %s\n", (Opts.incremental?"Yes":"No"));
+    printf("\n");
+    printf("--skip-unchanged\n");
+    printf("\tRemember each complete run in a small .playlister-*.stamp\n");
+    printf("\tfile in the output directory, and do nothing at all while\n");
+    printf("\tthe settings and the XML file(s) are the same.  With several\n");
+    printf("\tconfigs, skip_unchanged in any one of them applies to the\n");
+    printf("\twhole run, and the stamp is kept in the first one's\n");
+    printf("\toutput directory.\n");
+    printf("\t\tValue: %s\n", (Opts.skip_unchanged?"Yes":"No"));
+    printf("\n");
+    printf("--settle <seconds>\n");
+    printf("\tAn XML that does not end with </plist> is never parsed.\n");
+    printf("\tWith seconds, also wait until its size and time stop\n");
+    printf("\tchanging (for an XML that is still being copied).\n");
+    printf("\t\tValue: %i\n", Opts.settle);
+    printf("\n");
+    printf("--prescan\n");
+    printf("\tCount the tracks and playlists of an uncompressed XML with a\n");
+    printf("\tquick pass before parsing it, so the tables are made the\n");
+    printf("\tright size up front (otherwise the size is guessed from\n");
+    printf("\tthe file size).\n");
+    printf("\t\tValue: %s\n", (Opts.prescan?"Yes":"No"));
+    printf("\n");
+    printf("--capture <keys>\n");
+    printf("\tAlso keep these track keys (comma separated, as iTunes\n");
+    printf("\tnames them: Genre, Year, Play Count, Has Video...), each\n");
+    printf("\tin a column of its own.  Runs that capture always parse.\n");
+    if ( strlen(Opts.capture) ) {
+        printf("\t\tValue: %s\n", Opts.capture);
+    }
+    printf("\n");
     printf("-x --xml <file>\n");
-    printf("\tiTunes XML file.\n");
+    printf("\tiTunes XML file.  May be gzip or zstd compressed (if built\n");
+    printf("\twith HAS_ZLIB / HAS_ZSTD), or - to read from stdin.\n");
+    printf("\tA binary plist (plutil -convert binary1) is read directly,\n");
+    printf("\tso is an unencrypted Music.app Library.musicdb.\n");
     if ( strlen(Opts.itunes_xml_file) ) {
         printf("\t\tValue: %s\n", Opts.itunes_xml_file);
     }
@@ -102,16 +176,31 @@ dohelp()
     printf("\n");
     printf("-l --list\n");
     printf("\tPlaylist to include (can use multiple times).\n");
+    printf("\t  Per list overrides may follow the name, see --help_config.\n");
     if ( utarray_len(Opts.playlist) ) {
         int once = 1;
-        for ( char ** list = (char **) utarray_front(Opts.playlist)
+        for ( struct listopts * list
+                = (struct listopts *) utarray_front(Opts.playlist)
             ; list != NULL
-            ; list = (char **) utarray_next(Opts.playlist, list) ) {
+            ; list = (struct listopts *) utarray_next(Opts.playlist, list) ) {
             if ( once ) {
                 printf("\t\tValue(s):\n");
                 once = 0;
             }
-            printf("\t\t    %s\n", *list);
+            printf("\t\t    %s", list->name);
+            if ( strlen(list->compose) ) {
+                printf(" = %s", list->compose);
+            }
+            if ( -1 != list->randomize ) {
+                printf(" ; random=%s", (list->randomize?"Y":"N"));
+            }
+            if ( -1 != list->m3uextended ) {
+                printf(" ; format=%s", (list->m3uextended?"extm3u":"m3u"));
+            }
+            if ( strlen(list->extension) ) {
+                printf(" ; extension=%s", list->extension);
+            }
+            printf("\n");
         }
     }
     printf("\n");
@@ -147,12 +236,27 @@ dohelpconf()
             BUFSIZ-1);
     printf(" * Any path that exceeds 1024 characters will be truncated.\n");
     printf(" * random and verify can accept y, Y, or 1 to mean yes.\n");
+    printf(" * cache is y, n, or rebuild (see --no-cache in --help).\n");
+    printf(" * skip_unchanged, incremental and prescan are y or n,\n");
+    printf("   settle is seconds (see --help).  skip_unchanged in any\n");
+    printf("   config skips (or runs) every config given together.\n");
+    printf(" * capture is a comma separated list of track keys.\n");
     printf(" * format is either m3u or extm3u.\n");
     printf(" * extension does not need a prefixed period.\n");
     printf(" * location_replace can \"= .\", if"
            " the target player accepts it.\n");
     printf(" * if verify_dir isn't specified, location_replace is used.\n");
     printf("   * verify_dir implies verify=Y\n");
+    printf(" * [LISTS] entries can override random, format and extension\n");
+    printf("   for that one list, separated from the name by ';'.\n");
+    printf("   The same list may be named twice (shuffled and ordered),\n");
+    printf("   give each its own extension so the files don't collide.\n");
+    printf(" * A [LISTS] entry can also be made from other playlists,\n");
+    printf("   Name = \"A\" | \"B\" (in either), \"A\" & \"B\" (in both)\n");
+    printf("   or \"A\" - \"B\" (in A, not in B), read left to right.\n");
+    printf("   Tracks keep the order of the first list they are in.\n");
+    printf(" * If iTunes has two playlists with the same name, the first\n");
+    printf("   one is used.  Reading stops once every listed name is found.\n");
     printf("\n");
     printf("\n");
     printf("CONFIGURATION FILE SAMPLE\n");
@@ -164,12 +268,24 @@ dohelpconf()
     printf("extension = m3u8\n");
     printf("random = Y\n");
     printf("verify = Y\n");
+    printf("parser = fast\n");
+    printf("threads = 4\n");
+    printf("cache = Y\n");
+    printf("cache_dir = /var/cache/playlister\n");
+    printf("incremental = Y\n");
+    printf("skip_unchanged = Y\n");
+    printf("settle = 5\n");
+    printf("prescan = Y\n");
+    printf("capture = Genre, Year, Play Count, Rating\n");
     printf("location_remove = C:\\path\\to\\iTunes\\iTunes Media\\\n");
     printf("location_replace = /path/on/destination\n");
     printf("\n");
     printf("[LISTS]\n");
     printf("Favorite Playlist\n");
     printf("Smart One\n");
+    printf("Workout ; random=Y ; format=extm3u ; extension=rnd.m3u8\n");
+    printf("Road Trip Clean = \"Road Trip\" - \"Explicit\"\n");
+    printf("All Workouts = \"Run\" | \"Lift\" | \"Bike\" ; random=Y\n");
     printf("\n");
 }
 
@@ -212,6 +328,7 @@ initOpts(char *me)
     }
     memset(&Opts, 0, sizeof(struct options));
     Opts.verbose = 3;       // INFO
+    Opts.threads = 1;       // see _resetDeviceOpts()
     if (   ( strlen(me)   )
         && ( idx = rindex(me, '/') )
         && ( 1 < strlen(idx) )
@@ -231,7 +348,7 @@ initOpts(char *me)
         strncpy(Opts.dist_version, "Unknown", 64);
     }
     strncpy(Opts.extension, "m3u", 4);
-    utarray_new(Opts.playlist, &ut_str_icd);
+    utarray_new(Opts.playlist, &list_icd);
     OptsInit = 1;
 }
 
@@ -471,6 +588,101 @@ parseConfigOption(char *line)
             myfatal("random config option with no value.\n");
             exit(1);
         }
+    }
+    else if ( 0 == str_diffn("parser", buffer1, 6) ) {
+        if ( 0 > ( Opts.parser = parserType(buffer2) ) ) {
+            myfatal("Unknown parser request: %s\n", buffer2);
+            exit(1);
+        }
+    }
+    else if ( 0 == str_diffn("cache_dir", buffer1, 7) ) {
+        if ( strlen(buffer2) ) {
+            strncpy(Opts.cache_dir, buffer2, sizeof(Opts.cache_dir) - 1);
+            Opts.cache_dir[sizeof(Opts.cache_dir) - 1] = '\0';
+        }
+        else {
+            myfatal("cache_dir config option with no value.\n");
+            exit(1);
+        }
+    }
+    else if ( 0 == str_diffn("cache", buffer1, 6) ) {
+        if ( 0 > ( Opts.cache = cacheMode(buffer2) ) ) {
+            myfatal("Unknown cache request: %s\n", buffer2);
+            exit(1);
+        }
+    }
+    else if ( 0 == str_diffn("threads", buffer1, 7) ) {
+        if ( 0 > ( Opts.threads = threadCount(buffer2) ) ) {
+            myfatal("Bad threads request: %s\n", buffer2);
+            exit(1);
+        }
+    }
+    else if ( 0 == str_diffn("skip_unchanged", buffer1, 14) ) {
+        if ( strlen(buffer2) ) {
+            if (   ( 'y' == buffer2[0] )
+                || ( 'Y' == buffer2[0] )
+                || ( '1' == buffer2[0] )
+                ) {
+                Opts.skip_unchanged = 1;
+            }
+            else {
+                Opts.skip_unchanged = 0;
+            }
+        }
+        else {
+            myfatal("skip_unchanged config option with no value.\n");
+            exit(1);
+        }
+    }
+    else if ( 0 == str_diffn("incremental", buffer1, 11) ) {
+        if ( strlen(buffer2) ) {
+            if (   ( 'y' == buffer2[0] )
+                || ( 'Y' == buffer2[0] )
+                || ( '1' == buffer2[0] )
+                ) {
+                Opts.incremental = 1;
+            }
+            else {
+                Opts.incremental = 0;
+            }
+        }
+        else {
+            myfatal("incremental config option with no value.\n");
+            exit(1);
+        }
+    }
+    else if ( 0 == str_diffn("settle", buffer1, 6) ) {
+        if ( 0 > ( Opts.settle = settleSeconds(buffer2) ) ) {
+            myfatal("Bad settle request: %s\n", buffer2);
+            exit(1);
+        }
+    }
+    else if ( 0 == str_diffn("capture", buffer1, 8) ) {
+        if ( strlen(buffer2) ) {
+            strncpy(Opts.capture, buffer2, sizeof(Opts.capture) - 1);
+            Opts.capture[sizeof(Opts.capture) - 1] = '\0';
+        }
+        else {
+            myfatal("capture config option with no value.\n");
+            exit(1);
+        }
+    }
+    else if ( 0 == str_diffn("prescan", buffer1, 7) ) {
+        if ( strlen(buffer2) ) {
+            if (   ( 'y' == buffer2[0] )
+                || ( 'Y' == buffer2[0] )
+                || ( '1' == buffer2[0] )
+                ) {
+                Opts.prescan = 1;
+            }
+            else {
+                Opts.prescan = 0;
+            }
+        }
+        else {
+            myfatal("prescan config option with no value.\n");
+            exit(1);
+        }
     } else {
         myfatal("Unrecognized option line: %s = %s\n",
                 buffer1, buffer2 );
@@ -480,6 +692,230 @@ parseConfigOption(char *line)
 }
 
 
+/****************************************************************************
+ * Trim leading and trailing whitespace in place.
+ */
+char *
+_trimSpace(char *str)
+{
+    size_t len   = strlen(str);
+    size_t start = 0;
+
+    while ( ( len ) && ( 0x20 >= str[len-1] ) ) {
+        str[--len] = '\0';
+    }
+    while ( ( start < len ) && ( 0x20 >= str[start] ) ) {
+        start++;
+    }
+    if ( start ) {
+        memmove(str, str + start, len - start + 1);
+    }
+    return str;
+}
+
+
+/****************************************************************************
+ * The next operand of a composite list (see _composeSplit): an operator,
+ * '|' (union), '&' (both) or '-' (difference), then a quoted playlist
+ * name.  The first operand has no operator (op is 0).  1 with an operand,
+ * 0 at the end, -1 if expr can't be read.
+ */
+int
+composeNext(const char **expr, char *op, char *name, size_t size)
+{
+    const char *cx  = *expr;
+    const char *end = NULL;
+    size_t      len = 0;
+
+    while ( ( ' ' == *cx ) || ( '\t' == *cx ) ) {
+        cx++;
+    }
+    if ( '\0' == *cx ) {
+        return 0;
+    }
+    *op = 0;
+    if ( ( '|' == *cx ) || ( '&' == *cx ) || ( '-' == *cx ) ) {
+        *op = *cx++;
+        while ( ( ' ' == *cx ) || ( '\t' == *cx ) ) {
+            cx++;
+        }
+    }
+    if (   ( '"' != *cx )
+        || ( NULL == ( end = index(cx + 1, '"') ) ) ) {
+        return -1;
+    }
+    len = end - ( cx + 1 );
+    if ( len >= size ) {
+        len = size - 1;
+    }
+    memcpy(name, cx + 1, len);
+    name[len] = '\0';
+    *expr = end + 1;
+    return 1;
+}
+
+
+/****************************************************************************
+ * A composite list is made from other playlists by name:
+ *     Road Trip Clean = "Road Trip" - "Explicit" ; format=extm3u
+ * If the first '=' (before any ';') is followed by a quote, the line is
+ * one; the name and expression go to lo, and next is left at any
+ * overrides (after a ';' outside of quotes).
+ */
+static int
+_composeSplit(char *buffer, struct listopts *lo, char **next)
+{
+    char       *eq     = index(buffer, '=');
+    char       *semi   = index(buffer, ';');
+    char       *cx     = NULL;
+    const char *expr   = NULL;
+    char        name[1025];
+    char        op     = 0;
+    int         quoted = 0;
+    int         terms  = 0;
+    int         ret    = 0;
+
+    if ( ( NULL == eq ) || ( ( semi ) && ( semi < eq ) ) ) {
+        return 0;
+    }
+    for ( cx = eq + 1; ( ' ' == *cx ) || ( '\t' == *cx ); cx++ ) {
+        ;
+    }
+    if ( '"' != *cx ) {
+        return 0;
+    }
+    *next = NULL;
+    for ( ; *cx; cx++ ) {
+        if ( '"' == *cx ) {
+            quoted = ! quoted;
+        }
+        else if ( ( ';' == *cx ) && ( ! quoted ) ) {
+            *cx   = '\0';
+            *next = cx + 1;
+            break;
+        }
+    }
+    *eq = '\0';
+    strncpy(lo->name, _trimSpace(buffer), 1024);
+    strncpy(lo->compose, _trimSpace(eq + 1), 1024);
+
+    expr = lo->compose;
+    while ( 0 < ( ret = composeNext(&expr, &op, name, sizeof(name)) ) ) {
+        if ( ( terms++ ) ? ( 0 == op ) : ( 0 != op ) ) {
+            ret = -1;
+            break;
+        }
+    }
+    if ( ( 0 > ret ) || ( 0 == terms ) || ( 0 == strlen(lo->name) ) ) {
+        myfatal("Unable to read composite list %s = %s\n"
+                , lo->name, lo->compose);
+        exit(1);
+    }
+    return 1;
+}
+
+
+/****************************************************************************
+ * A [lists] line (or --list argument) is a playlist name, optionally
+ * followed by overrides for that one list:
+ *     Workout ; random=y ; format=extm3u ; extension=m3u8
+ * If anything after a ';' is not a known override, the whole line is
+ * taken as the name instead (playlist names may contain ';').
+ */
+void
+parseListEntry(const char *line, struct listopts *lo)
+{
+    char   buffer[BUFSIZ] = "\0";
+    char        *segment = NULL;
+    char           *next = NULL;
+    char          *value = NULL;
+    struct listopts work;
+
+    memset(lo, 0, sizeof(struct listopts));
+    lo->randomize   = -1;
+    lo->m3uextended = -1;
+    strncpy(lo->name, line, 1024);
+
+    strncpy(buffer, line, BUFSIZ-1);
+    if ( _composeSplit(buffer, lo, &next) ) {
+        memcpy(&work, lo, sizeof(struct listopts));
+    }
+    else if ( NULL == ( next = index(buffer, ';') ) ) {
+        return;
+    }
+    else {
+        memcpy(&work, lo, sizeof(struct listopts));
+        *next++ = '\0';
+        strncpy(work.name, _trimSpace(buffer), 1024);
+    }
+
+    while ( next ) {
+        segment = next;
+        if ( ( next = index(segment, ';') ) ) {
+            *next++ = '\0';
+        }
+        if ( NULL == ( value = index(segment, '=') ) ) {
+            if ( work.compose[0] ) {
+                myfatal("List %s has a bad override: %s\n"
+                        , work.name, _trimSpace(segment));
+                exit(1);
+            }
+            extradebug("List [%s] has no override, using as name\n", line);
+            return;
+        }
+        *value++ = '\0';
+        _trimSpace(segment);
+        _trimSpace(value);
+        if ( 0 == str_diffn("random", segment, 6) ) {
+            if (   ( 'y' == value[0] )
+                || ( 'Y' == value[0] )
+                || ( '1' == value[0] )
+                ) {
+                work.randomize = 1;
+            }
+            else {
+                work.randomize = 0;
+            }
+        }
+        else if ( 0 == str_diffn("format", segment, 4) ) {
+            if ( 0 == strncasecmp(value, "extm3u", 5) ) {
+                work.m3uextended = 1;
+            }
+            else if ( 0 == strncasecmp(value, "m3uext", 5) ) {
+                work.m3uextended = 1;
+            }
+            else if ( 0 == strncasecmp(value, "m3u", 4) ) {
+                work.m3uextended = 0;
+            }
+            else {
+                myfatal("Unknown format request for list %s: %s\n"
+                        , work.name, value);
+                exit(1);
+            }
+        }
+        else if ( 0 == str_diffn("extension", segment, 3) ) {
+            strncpy(work.extension, value, 64);
+        }
+        else if ( work.compose[0] ) {
+            // A composite line can't be a name, "Name = ..." is not one.
+            myfatal("List %s has an unknown override: %s\n"
+                    , work.name, segment);
+            exit(1);
+        }
+        else {
+            extradebug("List [%s] unknown override [%s], using as name\n"
+                    , line, segment);
+            return;
+        }
+    }
+
+    memcpy(lo, &work, sizeof(struct listopts));
+    extradebug("List [%s] random=%i format=%i extension=[%s] compose=[%s]\n"
+            , lo->name, lo->randomize, lo->m3uextended, lo->extension
+            , lo->compose);
+}
+
+
 void
 readConfigFile()
 {
@@ -591,8 +1027,10 @@ readConfigFile()
                 }
             }
             else if ( 1 == lists ) {
+                struct listopts lo;
                 // printf("Playlist: %s\n", linebuffer);
-                utarray_push_back(Opts.playlist, &linebuffer);
+                parseListEntry(linebuffer, &lo);
+                utarray_push_back(Opts.playlist, &lo);
             }
         }
     }
@@ -620,45 +1058,112 @@ _helpBeat(int useError)
 }
 
 
-void
-parseOpts(int argc, char **argv)
+int
+parserType(const char *value)
 {
-    initOpts(argv[0]);
+    if ( 0 == strncasecmp(value, "fast", 5) ) {
+        return PARSER_FAST;
+    }
+    else if ( 0 == strncasecmp(value, "libxml", 7) ) {
+        return PARSER_LIBXML;
+    }
+    else if ( 0 == strncasecmp(value, "xml", 4) ) {
+        return PARSER_LIBXML;
+    }
+    return -1;
+}
 
-    if (   ( NULL != argv[1] )
-        && ( argv[1][0] != '-' )
-        && ( 2 == argc )
-        ) {
-        strncpy(Opts.itunes_xml_file, argv[1], 1024);
-        return;
+
+int
+cacheMode(const char *value)
+{
+    if ( 0 == strncasecmp(value, "rebuild", 8) ) {
+        return CACHE_REBUILD;
+    }
+    else if ( ( 'y' == value[0] ) || ( 'Y' == value[0] )
+            || ( '1' == value[0] ) ) {
+        return CACHE_ON;
     }
+    else if ( ( 'n' == value[0] ) || ( 'N' == value[0] )
+            || ( '0' == value[0] ) ) {
+        return CACHE_OFF;
+    }
+    return -1;
+}
 
-    /* Pass 1, Configuration file/verbosity only. */
-    for ( int cx = 1; cx < argc; cx++ ) {
-        if ( config(argv[cx]) ) {
-            if ( ( cx+1 ) < argc ) {
-                cx++;
-                strncpy(Opts.config, argv[cx], 1024);
-                Opts.config_requested = 1;
-            }
-        }
-        else if ( verbose(argv[cx]) ) {
-            Opts.verbose++;
-        }
-        else if ( quiet(argv[cx]) ) {
-            Opts.verbose--;
-        }
-        else if ( argabout(argv[cx]) ) {
-            doabout();
-            // Always exits
-        }
+
+/****************************************************************************
+ * 0 (one per CPU) through 64 worker threads, or -1.
+ */
+int
+threadCount(const char *value)
+{
+    char *stop = NULL;
+    long count = strtol(value, &stop, 10);
+
+    if ( ( stop == value ) || ( '\0' != *stop ) ) {
+        return -1;
+    }
+    if ( ( 0 > count ) || ( 64 < count ) ) {
+        return -1;
     }
+    return (int)count;
+}
 
-    /* VERBOSITY IS SET, so we can use debug statements from here. */
 
-    readConfigFile();
+/****************************************************************************
+ * 0 through 3600 seconds, or -1.
+ */
+int
+settleSeconds(const char *value)
+{
+    char *stop = NULL;
+    long count = strtol(value, &stop, 10);
 
-    /* Pass 2, CMDLINE options override Configuration File options */
+    if ( ( stop == value ) || ( '\0' != *stop ) ) {
+        return -1;
+    }
+    if ( ( 0 > count ) || ( 3600 < count ) ) {
+        return -1;
+    }
+    return (int)count;
+}
+
+
+/****************************************************************************
+ * Everything a configuration file (or the command line, pass 2) can set
+ * is put back to default before the next device configuration is read.
+ */
+void
+_resetDeviceOpts()
+{
+    Opts.randomize   = 0;
+    Opts.verify      = 0;
+    Opts.m3uextended = 0;
+    Opts.parser      = PARSER_LIBXML;
+    Opts.threads     = 1;
+    Opts.cache       = CACHE_ON;
+    Opts.skip_unchanged = 0;
+    Opts.incremental = 0;
+    Opts.settle      = 0;
+    Opts.prescan     = 0;
+    Opts.wantHelp    = 0;
+    Opts.needHelp    = 0;
+    Opts.itunes_xml_file[0] = '\0';
+    Opts.itune_path[0]      = '\0';
+    Opts.replace_path[0]    = '\0';
+    Opts.verify_path[0]     = '\0';
+    Opts.output_path[0]     = '\0';
+    Opts.cache_dir[0]       = '\0';
+    Opts.capture[0]         = '\0';
+    strncpy(Opts.extension, "m3u", 4);
+    utarray_new(Opts.playlist, &list_icd);
+}
+
+
+void
+_parseCmdLine(int argc, char **argv)
+{
     for ( int cx = 1; cx < argc; cx++ ) {
         if ( config(argv[cx]) ) {
             // Pulled above
@@ -752,6 +1257,97 @@ parseOpts(int argc, char **argv)
         else if ( randomize(argv[cx]) ) {
             Opts.randomize = 1;
         }
+        else if ( argparser(argv[cx]) ) {
+            char *value = index(argv[cx], '=');
+            if ( NULL != value ) {
+                value++;
+            }
+            else if ( ( cx+1 ) < argc ) {
+                value = argv[++cx];
+            }
+            if ( NULL == value ) {
+                myerror("%s passed with no data.\n", argv[cx]);
+                _helpBeat(1);
+            }
+            else if ( 0 > ( Opts.parser = parserType(value) ) ) {
+                myerror("Unknown parser request: %s\n", value);
+                Opts.parser = PARSER_LIBXML;
+                _helpBeat(1);
+            }
+        }
+        else if ( argnocache(argv[cx]) ) {
+            Opts.cache = CACHE_OFF;
+        }
+        else if ( argrebuild(argv[cx]) ) {
+            Opts.cache = CACHE_REBUILD;
+        }
+        else if ( argincremental(argv[cx]) ) {
+            Opts.incremental = 1;
+        }
+        else if ( argskipunch(argv[cx]) ) {
+            Opts.skip_unchanged = 1;
+        }
+        else if ( argprescan(argv[cx]) ) {
+            Opts.prescan = 1;
+        }
+        else if ( argcapture(argv[cx]) ) {
+            if ( ( cx+1 ) < argc ) {
+                cx++;
+                strncpy(Opts.capture, argv[cx], sizeof(Opts.capture) - 1);
+                Opts.capture[sizeof(Opts.capture) - 1] = '\0';
+            }
+            else {
+                myerror("%s passed with no data.\n", argv[cx]);
+                _helpBeat(1);
+            }
+        }
+        else if ( argsettle(argv[cx]) ) {
+            char *value = index(argv[cx], '=');
+            if ( NULL != value ) {
+                value++;
+            }
+            else if ( ( cx+1 ) < argc ) {
+                value = argv[++cx];
+            }
+            if ( NULL == value ) {
+                myerror("%s passed with no data.\n", argv[cx]);
+                _helpBeat(1);
+            }
+            else if ( 0 > ( Opts.settle = settleSeconds(value) ) ) {
+                myerror("Bad settle request: %s\n", value);
+                Opts.settle = 0;
+                _helpBeat(1);
+            }
+        }
+        else if ( argcachedir(argv[cx]) ) {
+            if ( ( cx+1 ) < argc ) {
+                cx++;
+                strncpy(Opts.cache_dir, argv[cx], sizeof(Opts.cache_dir) - 1);
+                Opts.cache_dir[sizeof(Opts.cache_dir) - 1] = '\0';
+            }
+            else {
+                myerror("%s passed with no data.\n", argv[cx]);
+                _helpBeat(1);
+            }
+        }
+        else if ( argthreads(argv[cx]) ) {
+            char *value = index(argv[cx], '=');
+            if ( NULL != value ) {
+                value++;
+            }
+            else if ( ( cx+1 ) < argc ) {
+                value = argv[++cx];
+            }
+            if ( NULL == value ) {
+                myerror("%s passed with no data.\n", argv[cx]);
+                _helpBeat(1);
+            }
+            else if ( 0 > ( Opts.threads = threadCount(value) ) ) {
+                myerror("Bad threads request: %s\n", value);
+                Opts.threads = 1;
+                _helpBeat(1);
+            }
+        }
         else if ( extension(argv[cx]) ) {
             if ( ( cx+1 ) < argc ) {
                 cx++;
@@ -765,8 +1361,10 @@ parseOpts(int argc, char **argv)
         else if ( arglist(argv[cx]) ) {
             if ( ( cx+1 ) < argc ) {
                 cx++;
+                struct listopts lo;
                 /* TODO : Handle comma separated listnames */
-                utarray_push_back(Opts.playlist, &argv[cx]);
+                parseListEntry(argv[cx], &lo);
+                utarray_push_back(Opts.playlist, &lo);
             }
             else {
                 myerror("%s passed with no data.\n", argv[cx]);
@@ -775,7 +1373,7 @@ parseOpts(int argc, char **argv)
         }
         else if ( 0 == str_diffn(argv[cx], "--nolist", 9) ) {
             utarray_free(Opts.playlist);
-            utarray_new(Opts.playlist, &ut_str_icd);
+            utarray_new(Opts.playlist, &list_icd);
         }
         else if ( arghelp(argv[cx]) ) {
             if ( arghelpconf(argv[cx]) ) {
@@ -791,6 +1389,12 @@ parseOpts(int argc, char **argv)
         }
     }
 
+}
+
+
+void
+_checkOpts()
+{
     mydebug("Options           Program Name = %s\n", Opts.self);
     mydebug("Options     configuration file = %s\n"
         , (strlen(Opts.config)?Opts.config:"NONE"));
@@ -805,6 +1409,21 @@ parseOpts(int argc, char **argv)
     mydebug("Options Playlist output format = %s\n"
             , (Opts.m3uextended?"M3U Extended":"M3U standard"));
     mydebug("Options     Playlist extension = %s\n", Opts.extension);
+    mydebug("Options             XML parser = %s\n"
+            , (PARSER_FAST==Opts.parser?"fast":"libxml"));
+    mydebug("Options         Tracks threads = %i\n", Opts.threads);
+    mydebug("Options         Snapshot cache = %s %s\n"
+            , (CACHE_OFF==Opts.cache?"Off"
+                :(CACHE_REBUILD==Opts.cache?"Rebuild":"On"))
+            , (strlen(Opts.cache_dir)?Opts.cache_dir:""));
+    mydebug("Options     Incremental update = %s\n"
+            , (Opts.incremental?"Yes":"No"));
+    mydebug("Options  Skip unchanged/settle = %s %i\n"
+            , (Opts.skip_unchanged?"Yes":"No"), Opts.settle);
+    mydebug("Options        Prescan the XML = %s\n"
+            , (Opts.prescan?"Yes":"No"));
+    mydebug("Options    Captured track keys = %s\n"
+            , (strlen(Opts.capture)?Opts.capture:"None"));
 
     if ( Opts.wantHelp ) {
         if ( 2 == Opts.wantHelp ) {
@@ -837,12 +1456,116 @@ parseOpts(int argc, char **argv)
 }
 
 
+void
+parseOpts(int argc, char **argv)
+{
+    UT_array *configs = NULL;
+    struct options *dev = NULL;
+    int            dx = 0;
+
+    initOpts(argv[0]);
+    utarray_new(Devices, &device_icd);
+
+    if (   ( NULL != argv[1] )
+        && ( argv[1][0] != '-' )
+        && ( 2 == argc )
+        ) {
+        strncpy(Opts.itunes_xml_file, argv[1], 1024);
+        utarray_push_back(Devices, &Opts);
+        return;
+    }
+
+    utarray_new(configs, &ut_str_icd);
+
+    /* Pass 1, Configuration file(s)/verbosity only. */
+    for ( int cx = 1; cx < argc; cx++ ) {
+        if ( config(argv[cx]) ) {
+            if ( ( cx+1 ) < argc ) {
+                cx++;
+                utarray_push_back(configs, &argv[cx]);
+                Opts.config_requested = 1;
+            }
+        }
+        else if ( verbose(argv[cx]) ) {
+            Opts.verbose++;
+        }
+        else if ( quiet(argv[cx]) ) {
+            Opts.verbose--;
+        }
+        else if ( argabout(argv[cx]) ) {
+            doabout();
+            // Always exits
+        }
+    }
+
+    /* VERBOSITY IS SET, so we can use debug statements from here. */
+
+    if ( 0 == utarray_len(configs) ) {
+        // No -c given, search for the default (see readConfigFile).
+        char *defconf = Opts.config;
+        utarray_push_back(configs, &defconf);
+    }
+
+    /****
+     * One device context per configuration file.  Each one starts from
+     * defaults, reads its own file, then gets the command line applied
+     * on top (pass 2), so command line options apply to every device.
+     */
+    for ( char ** conf = (char **) utarray_front(configs)
+        ; conf != NULL
+        ; conf = (char **) utarray_next(configs, conf), dx++
+        ) {
+        if ( dx ) {
+            _resetDeviceOpts();
+        }
+        strncpy(Opts.config, *conf, 1024);
+        readConfigFile();
+
+        /* Pass 2, CMDLINE options override Configuration File options */
+        _parseCmdLine(argc, argv);
+
+        mydebug("Options                 Device = %i of %i\n"
+                , dx + 1, utarray_len(configs));
+        _checkOpts();
+
+        // The device now owns Opts.playlist
+        utarray_push_back(Devices, &Opts);
+        Opts.playlist = NULL;
+    }
+    utarray_free(configs);
+
+    /****
+     * Opts mirrors the first device, for anything that only cares about
+     * invocation-wide settings (verbosity, help output).  The playlist
+     * array is borrowed from that device, OptsFree() will not free it twice.
+     */
+    if ( NULL == ( dev = (struct options *) utarray_front(Devices) ) ) {
+        myfatal("No device configuration was read.\n");
+        exit(1);
+    }
+    memcpy(&Opts, dev, sizeof(struct options));
+}
+
+
 void
 OptsFree()
 {
-    if ( Opts.playlist ) {
-        utarray_free(Opts.playlist);
+    struct options *dev = NULL;
+
+    if ( NULL == Devices ) {
+        return;
+    }
+    for ( dev = (struct options *) utarray_front(Devices)
+        ; dev != NULL
+        ; dev = (struct options *) utarray_next(Devices, dev)
+        ) {
+        if ( dev->playlist ) {
+            utarray_free(dev->playlist);
+        }
     }
+    utarray_free(Devices);
+    Devices = NULL;
+    Opts.playlist = NULL;
 }
 
 /**
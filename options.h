@@ -15,12 +15,55 @@
 void  parseOpts  (int argc, char **argv);
 void  OptsFree   (void);
 
+/****
+ * One struct options per device configuration (-c may be given more than
+ * once).  Opts itself mirrors the first device after parseOpts().
+ */
+
+/****
+ * One entry per requested playlist ([lists] section or --list).
+ * Overrides of -1 (or an empty extension) fall back to the device setting.
+ */
+struct listopts {
+    char       name[1025];   // iTunes playlist name
+    int        randomize;    // ; random=y
+    int        m3uextended;  // ; format=extm3u
+    char       extension[65]; // ; extension=m3u8
+    char       compose[1025]; // = "Run" | "Lift", see listCompose()
+};
+
+void  parseListEntry(const char *line, struct listopts *lo);
+int   composeNext(const char **expr, char *op, char *name, size_t size);
+int   parserType(const char *value);
+int   threadCount(const char *value);
+int   settleSeconds(const char *value);
+
+enum parserType {
+    PARSER_LIBXML,  // reader1.c, xmlTextReader
+    PARSER_FAST     // reader2.c, mmap scanner (falls back to libxml)
+};
+
+int   cacheMode(const char *value);
+
+enum cacheMode {
+    CACHE_ON,       // cache.c, load the snapshot if it fits, else save one
+    CACHE_OFF,      // --no-cache
+    CACHE_REBUILD   // --rebuild-cache, parse and save regardless
+};
+
 struct options {
     int        config_requested;
     int        verbose;
     int        randomize;
     int        verify;
     int        m3uextended;
+    int        parser; // --parser, enum parserType
+    int        threads; // --threads, 0 = CPUs (reader1.c, reader2.c)
+    int        cache;  // --no-cache --rebuild-cache, enum cacheMode
+    int        skip_unchanged; // --skip-unchanged (stamp.c)
+    int        incremental; // --incremental, match the last snapshot (cache.c)
+    int        settle; // --settle, seconds the XML must hold still
+    int        prescan; // --prescan, count tracks to presize (storage.c)
     char       self[1025]; // argv[0]
     char       config[1025]; // -c --con... config()
     char       itunes_xml_file[1025]; // -x --xml itunesxml()
@@ -29,15 +72,18 @@ struct options {
     char       verify_path[1025]; // -o --output output()
     char       output_path[1025]; // -o --output output()
     char       extension[65]; // -X --extension extension()
+    char       cache_dir[1025]; // --cache_dir, "" is beside the XML
+    char       capture[1025]; // --capture, track keys kept as columns
     char       dist_version[65]; // Software version string.
     int        wantHelp;
     int        needHelp;
-    UT_array * playlist;
+    UT_array * playlist; // struct listopts
 };
 
 #ifndef OPTIONS_C
 // Loaded for everything EXCEPT options.c
 extern struct options Opts;
+extern UT_array     * Devices;  // struct options, one per config file
 #else
 // Only LOADED For options.c
 #define itunesxml(a) ( (0==str_diffn("--xml", (a), 6) ) \
@@ -66,6 +112,19 @@ extern struct options Opts;
         || (0==str_diffn("-?", (a), 3)) \
         || (0==str_diffn("-h", (a), 3)) )
 #define arghelpconf(a) (0==str_diffn("--help_c", (a), 8) )
+#define argparser(a)   (0==str_diffn("--pars", (a), 6) )
+#define argthreads(a)  (0==str_diffn("--thr", (a), 5) )
+#define argnocache(a)  (0==str_diffn("--no-c", (a), 6) \
+        || (0==str_diffn("--no_c", (a), 6) ) )
+#define argrebuild(a)  (0==str_diffn("--reb", (a), 5) )
+#define argskipunch(a) ( (0==str_diffn("--skip_u", (a), 8) ) \
+        || (0==str_diffn("--skip-u", (a), 8) ) )
+#define argsettle(a)   (0==str_diffn("--sett", (a), 6) )
+#define argincremental(a) (0==str_diffn("--inc", (a), 5) )
+#define argprescan(a)  (0==str_diffn("--pres", (a), 6) )
+#define argcapture(a)  (0==str_diffn("--capt", (a), 6) )
+#define argcachedir(a) ( (0==str_diffn("--cache_d", (a), 9) ) \
+        || (0==str_diffn("--cache-d", (a), 9) ) )
 #define argverify(a)   (0==str_diffn("--veri", (a), 6) )
 #define argverifypath(a)  ( (0==str_diffn("--verify_p", (a), 10) ) \
         || (0==str_diffn("--verify_d", (a), 10) ) \
@@ -10,15 +10,22 @@
  */
 #define READER1_C 1
 #include <stdio.h>
+#include <string.h>      // memcmp
 #include <libxml/xmlreader.h>
 #include "utils.h"
 #include "storage.h"
+#include "options.h"
 #include "reader1.h"
+#include "reader2.h"
+#include "reader3.h"
+#include "reader4.h"
+#include "source.h"
+#include "ring.h"
 
 #ifndef LIBXML_READER_ENABLED
 
-void
-streamFile(const char *filename) {
+int
+streamFile(const char *filename, int parser, int threads) {
     fprintf(stderr, "XInclude support not compiled in\n");
     exit(1);
 }
@@ -28,11 +35,15 @@ streamFile(const char *filename) {
 /**
  * _processNode:
  * @reader: the xmlReader
+ * @ring: the storage thread's queue, or NULL to call set_node here
  *
  * Dump information about the current node
+ * Returns set_node's enum nodeAction.  Through the ring that is only ever
+ * NODE_STOP (once storage has raised it) or NODE_NEXT, the storage thread
+ * drops skipped subtrees itself.
  */
-static void
-_processNode(xmlTextReaderPtr reader) {
+static int
+_processNode(xmlTextReaderPtr reader, struct nodering *ring) {
     const xmlChar *name, *value;
 
     name = xmlTextReaderConstName(reader);
@@ -61,8 +72,18 @@ _processNode(xmlTextReaderPtr reader) {
         }
     }
 
+    if ( NULL != ring ) {
+        return ( ringPush( ring,
+                    xmlTextReaderDepth(reader),
+                    xmlTextReaderNodeType(reader),
+                    (const char*)name,
+                    xmlTextReaderIsEmptyElement(reader),
+                    xmlTextReaderHasValue(reader),
+                    (const char*)value ) ? NODE_STOP : NODE_NEXT );
+    }
+
     // storage.c addition...
-    set_node( xmlTextReaderDepth(reader),
+    return set_node( xmlTextReaderDepth(reader),
 	    xmlTextReaderNodeType(reader),
         (char*)name,
 	    xmlTextReaderIsEmptyElement(reader),
@@ -70,16 +91,158 @@ _processNode(xmlTextReaderPtr reader) {
         (char*)value );
 }
 
+static int
+_readCallback(void *context, char *buffer, int len)
+{
+    return sourceRead((struct source *)context, buffer, len);
+}
+
+static int
+_closeCallback(void *context)
+{
+    // The source belongs to streamFile, which closes it.
+    return 0;
+}
+
+/**
+ * _libxmlStream:
+ * @reader: an open xmlReader
+ * @threads: more than one (or 0, one per CPU) runs storage on its own
+ *           thread, fed through ring.c
+ *
+ * Feed every node to storage, stepping over subtrees it doesn't want.
+ * Returns 0 when the document was read (or storage stopped it early).
+ */
+static int
+_libxmlStream(xmlTextReaderPtr reader, const char *filename, int threads)
+{
+    int ret;
+    int action = NODE_NEXT;
+    struct nodering *ring = NULL;
+
+    // Only when asked for, --threads 0 or 2 and up
+    if ( ( 0 == threads ) || ( 1 < threads ) ) {
+        ring = ringStart();
+    }
+
+    ret = xmlTextReaderRead(reader);
+    while (ret == 1) {
+        action = _processNode(reader, ring);
+        if ( NODE_STOP == action ) {
+            mydebug("%s : every requested playlist read, stopped early\n"
+                    , filename);
+            ret = 0;
+            break;
+        }
+        else if ( NODE_SKIP == action ) {
+            ret = xmlTextReaderNext(reader);
+        }
+        else {
+            ret = xmlTextReaderRead(reader);
+        }
+    }
+    if ( NULL != ring ) {
+        ringFinish(ring, filename);
+    }
+    xmlFreeTextReader(reader);
+    if (ret != 0) {
+        mywarning("%s : failed to parse\n", filename);
+        return -1;
+    }
+    return 0;
+}
+
 /**
  * function: streamFile
- * filename: the file name to parse
+ * filename: the file name to parse, "-" for stdin
+ * parser: enum parserType, PARSER_FAST tries reader2.c first
+ * threads: for reader2.c, see fastStreamBuffer; for libxml, see
+ *          _libxmlStream
  *
  * Parse and print information about an XML file.
+ * Compressed (gzip/zstd) files and stdin come in through source.c.
+ * A binary plist goes to reader3.c whichever parser was asked for, a
+ * Music.app database to reader4.c.
+ * Returns 0 if storage holds the whole (needed part of the) library.
  */
-void
-streamFile(const char *filename) {
+int
+streamFile(const char *filename, int parser, int threads) {
     xmlTextReaderPtr reader;
-    int ret;
+    struct source *src;
+    char *buf = NULL;
+    size_t len = 0;
+    int ret = -1;
+    char magic[8];
+
+    if ( NULL == ( src = sourceOpen(filename) ) ) {
+        return -1;
+    }
+
+    // A Music.app database goes to reader4.c, which refuses encrypted ones.
+    if ( SOURCE_MUSICDB == sourceKind(src) ) {
+        if ( ! sourceIsStdin(src) ) {
+            sourceClose(src);
+            return musicdbStreamFile(filename);
+        }
+        if ( NULL == ( buf = sourceSlurp(src, &len) ) ) {
+            mywarning("%s : unable to read\n", filename);
+            sourceClose(src);
+            return -1;
+        }
+        sourceClose(src);
+        ret = musicdbStreamBuffer(filename, buf, len);
+        free(buf);
+        return ret;
+    }
+
+    // A compressed binary plist only shows itself once inflated.
+    if (   ( SOURCE_BPLIST == sourceKind(src) )
+        || ( ( SOURCE_PLAIN != sourceKind(src) )
+          && ( 8 == sourcePeek(src, magic, 8) )
+          && ( 0 == memcmp(magic, BPLIST_MAGIC, 8) ) ) ) {
+        if ( ( SOURCE_BPLIST == sourceKind(src) ) && ( ! sourceIsStdin(src) ) ) {
+            sourceClose(src);
+            return bplistStreamFile(filename);
+        }
+        if ( NULL == ( buf = sourceSlurp(src, &len) ) ) {
+            mywarning("%s : unable to read\n", filename);
+            sourceClose(src);
+            return -1;
+        }
+        sourceClose(src);
+        ret = bplistStreamBuffer(filename, buf, len);
+        free(buf);
+        return ret;
+    }
+
+    if ( PARSER_FAST == parser ) {
+        if ( ( SOURCE_PLAIN == sourceKind(src) ) && ( ! sourceIsStdin(src) ) ) {
+            // A plain file is cheaper to mmap than to copy.
+            sourceClose(src);
+            src = NULL;
+            if ( 0 == fastStreamFile(filename, threads) ) {
+                return 0;
+            }
+        }
+        else {
+            // Stdin and compressed input can't be mapped, fill a buffer.
+            if ( NULL == ( buf = sourceSlurp(src, &len) ) ) {
+                mywarning("%s : unable to read\n", filename);
+                sourceClose(src);
+                return -1;
+            }
+            sourceClose(src);
+            src = NULL;
+            if ( 0 == fastStreamBuffer(filename, buf, len, threads) ) {
+                free(buf);
+                return 0;
+            }
+        }
+        // Whatever the fast parser stored may be partial, start over.
+        mywarning("%s : fast parser gave up, using libxml\n", filename);
+        storageFree();
+        storageInit();
+    }
 
     /*
      * this initialize the library and check potential ABI mismatches
@@ -88,20 +251,23 @@ streamFile(const char *filename) {
      */
     LIBXML_TEST_VERSION
 
-    reader = xmlReaderForFile(filename, NULL, 0);
+    if ( NULL != buf ) {
+        reader = xmlReaderForMemory(buf, len, filename, NULL, 0);
+    }
+    else if ( NULL != src ) {
+        reader = xmlReaderForIO(_readCallback, _closeCallback, src
+                , filename, NULL, 0);
+    }
+    else {
+        reader = xmlReaderForFile(filename, NULL, 0);
+    }
     if (reader != NULL) {
-        ret = xmlTextReaderRead(reader);
-        while (ret == 1) {
-            _processNode(reader);
-            ret = xmlTextReaderRead(reader);
-        }
-        xmlFreeTextReader(reader);
-        if (ret != 0) {
-            mywarning("%s : failed to parse\n", filename);
-        }
+        ret = _libxmlStream(reader, filename, threads);
     } else {
         mywarning("Unable to open file [%s].\n", filename);
     }
+    sourceClose(src);
+    free(buf);
 
     /*
      * Cleanup function for the XML library.
@@ -110,6 +276,7 @@ streamFile(const char *filename) {
     /****
      * xmlMemoryDump was previously called here, but that function is gone.
      */
+    return ret;
 }
 
 #endif
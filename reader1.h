@@ -10,7 +10,7 @@
 #define READER1_H 1
 #include "utils.h"
 
-void streamFile(const char *filename);
+int  streamFile(const char *filename, int parser, int threads);
 
 #endif /* READER1_H */
 /**
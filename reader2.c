@@ -0,0 +1,1013 @@
+/****************************************************************************
+ * reader2.c
+ *
+ * Parse an iTunes XML file with a memory mapped, hand-rolled scanner.
+ *
+ * The iTunes export is a very regular plist dialect, so this only knows
+ * enough XML for that: elements without namespaces, the five predefined
+ * entities, character references, and a prolog of <?xml?> plus a
+ * DOCTYPE without an internal subset.  It produces the same set_node()
+ * events that reader1.c gets from xmlTextReader (element open, text,
+ * element close; blank text is dropped, just as set_node ignores it).
+ *
+ * Anything else (CDATA, other entities, non UTF-8, mismatched tags)
+ * returns an error so the caller can fall back to libxml.
+ *
+ * With more than one thread, the Tracks dict is cut into slices at
+ * <key>NNN</key><dict> envelopes.  Each worker parses one slice into its
+ * own (thread local) track table, starting from the set_node state the
+ * main thread has at that point.  The main thread reads the first slice
+ * itself, waits for the workers and merges their tables at the end of it,
+ * then jumps to the Tracks </dict> and reads the playlists as before.
+ *
+ * Copyright (c) 2019-2024, Gary Allen Vollink.  http://voll.ink/playlister
+ * All rights reserved.
+ *
+ * Licence to use, see LICENSE file in this distribution.
+ */
+#define READER2_C 1
+#include <stdio.h>
+#include <stdlib.h>      // malloc, realloc
+#include <string.h>      // memchr, strerror
+#include <strings.h>     // strncasecmp
+#include <fcntl.h>       // open
+#include <unistd.h>      // close
+#include <sys/mman.h>    // mmap
+#include <sys/stat.h>    // fstat
+#include <sys/errno.h>   // errno
+#include <pthread.h>     // pthread_create, pthread_join
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+#include "utils.h"
+#include "strkern.h"
+#include "storage.h"
+#include "reader2.h"
+
+#define FAST_MAX_DEPTH 64
+#define FAST_MAX_NAME  64
+#define FAST_MAX_SLICES 64
+#define FAST_MIN_SLICE (16 * 1024)  // smaller isn't worth a thread
+
+/****
+ * One worker's share of the Tracks dict.
+ */
+struct fastslice {
+    pthread_t   thread;
+    const char *base;    // document base, for messages
+    const char *start;   // a <key>NNN</key><dict> envelope
+    const char *end;     // the next slice, or the Tracks </dict>
+    double      share;   // of the Tracks dict, for storageThreadInit
+    int         started;
+    int         ret;
+    long        failat;  // byte offset, when ret
+    long        nodes;
+    long        skipped;
+    struct storagepart part;
+};
+
+struct fastscan {
+    const char *start;   // document base
+    const char *end;     // one past the last byte
+    const char *p;       // current position
+    int         depth;   // element nesting, same numbering as libxml
+    int         rootdone;
+    char        stack[FAST_MAX_DEPTH][FAST_MAX_NAME];
+    char        name[FAST_MAX_NAME];
+    char       *text;    // decoded text, reused for every text node
+    size_t      textsz;
+    long        nodes;
+    long        skipped; // subtrees stepped over for NODE_SKIP
+    int         stopped; // set_node said NODE_STOP
+    const char *jump;    // the workers' slices start here...
+    const char *jumpto;  // ...and the main thread resumes here
+    struct fastslice *slices;
+    int         nslices;
+    int         slicefail; // a worker already said where
+};
+
+static int _join_slices(struct fastscan *fs);
+
+/****************************************************************************
+ * Find the first '<' or '&' at or after p, or end.
+ * Text runs in the library are short, but Location values and the
+ * whitespace between elements make a vector compare worth it.
+ */
+static const char *
+_scan_lt_amp(const char *p, const char *end)
+{
+#if defined(__SSE2__)
+    const __m128i lt  = _mm_set1_epi8('<');
+    const __m128i amp = _mm_set1_epi8('&');
+
+    while ( 16 <= ( end - p ) ) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)p);
+        int mask = _mm_movemask_epi8(
+                    _mm_or_si128( _mm_cmpeq_epi8(chunk, lt)
+                                , _mm_cmpeq_epi8(chunk, amp) ) );
+        if ( mask ) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const uint8x16_t lt  = vdupq_n_u8('<');
+    const uint8x16_t amp = vdupq_n_u8('&');
+
+    while ( 16 <= ( end - p ) ) {
+        uint8x16_t chunk = vld1q_u8((const uint8_t *)p);
+        uint8x16_t hit   = vorrq_u8( vceqq_u8(chunk, lt)
+                                   , vceqq_u8(chunk, amp) );
+        if ( vmaxvq_u8(hit) ) {
+            break;      // the tail loop below pins down the byte
+        }
+        p += 16;
+    }
+#endif
+    while ( ( p < end ) && ( '<' != *p ) && ( '&' != *p ) ) {
+        p++;
+    }
+    return p;
+}
+
+
+static int
+_is_blank(const char *p, const char *end)
+{
+    for ( ; p < end; p++ ) {
+        if (   ( ' '  != *p ) && ( '\t' != *p )
+            && ( '\n' != *p ) && ( '\r' != *p ) ) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+static int
+_text_reserve(struct fastscan *fs, size_t need)
+{
+    char *grow = NULL;
+
+    if ( need <= fs->textsz ) {
+        return 0;
+    }
+    if ( NULL == ( grow = realloc(fs->text, need + 1024) ) ) {
+        mywarning("fast parser: Unable to allocate %ld bytes: %s\n"
+                , need + 1024, strerror(errno));
+        return -1;
+    }
+    fs->text   = grow;
+    fs->textsz = need + 1024;
+    return 0;
+}
+
+
+/****************************************************************************
+ * Append the UTF-8 encoding of a character reference.
+ */
+static char *
+_put_utf8(char *out, unsigned long cp)
+{
+    if ( cp < 0x80 ) {
+        *out++ = (char)cp;
+    }
+    else if ( cp < 0x800 ) {
+        *out++ = (char)( 0xC0 | ( cp >> 6 ) );
+        *out++ = (char)( 0x80 | ( cp & 0x3F ) );
+    }
+    else if ( cp < 0x10000 ) {
+        *out++ = (char)( 0xE0 | ( cp >> 12 ) );
+        *out++ = (char)( 0x80 | ( ( cp >> 6 ) & 0x3F ) );
+        *out++ = (char)( 0x80 | ( cp & 0x3F ) );
+    }
+    else {
+        *out++ = (char)( 0xF0 | ( cp >> 18 ) );
+        *out++ = (char)( 0x80 | ( ( cp >> 12 ) & 0x3F ) );
+        *out++ = (char)( 0x80 | ( ( cp >> 6 ) & 0x3F ) );
+        *out++ = (char)( 0x80 | ( cp & 0x3F ) );
+    }
+    return out;
+}
+
+
+/****************************************************************************
+ * Copy text [p, end) into fs->text, decoding entities and folding line
+ * ends the way an XML parser must.  Returns -1 on anything unexpected.
+ */
+static int
+_decode_text(struct fastscan *fs, const char *p, const char *end)
+{
+    char *out = NULL;
+    const char *amp = NULL;
+
+    // An entity never grows when decoded, nor does \r\n folding.
+    if ( _text_reserve(fs, ( end - p ) + 1) ) {
+        return -1;
+    }
+    out = fs->text;
+
+    while ( p < end ) {
+        amp = memchr(p, '&', end - p);
+        if ( NULL == amp ) {
+            amp = end;
+        }
+        while ( p < amp ) {
+            if ( '\r' == *p ) {
+                *out++ = '\n';
+                p++;
+                if ( ( p < amp ) && ( '\n' == *p ) ) {
+                    p++;
+                }
+            }
+            else {
+                *out++ = *p++;
+            }
+        }
+        if ( p >= end ) {
+            break;
+        }
+        // *p is '&'
+        if ( ( 5 <= ( end - p ) ) && ( 0 == memcmp(p, "&amp;", 5) ) ) {
+            *out++ = '&';
+            p += 5;
+        }
+        else if ( ( 4 <= ( end - p ) ) && ( 0 == memcmp(p, "&lt;", 4) ) ) {
+            *out++ = '<';
+            p += 4;
+        }
+        else if ( ( 4 <= ( end - p ) ) && ( 0 == memcmp(p, "&gt;", 4) ) ) {
+            *out++ = '>';
+            p += 4;
+        }
+        else if ( ( 6 <= ( end - p ) ) && ( 0 == memcmp(p, "&quot;", 6) ) ) {
+            *out++ = '"';
+            p += 6;
+        }
+        else if ( ( 6 <= ( end - p ) ) && ( 0 == memcmp(p, "&apos;", 6) ) ) {
+            *out++ = '\'';
+            p += 6;
+        }
+        else if ( ( 3 <= ( end - p ) ) && ( '#' == p[1] ) ) {
+            const char *semi = memchr(p, ';', end - p);
+            char       *stop = NULL;
+            unsigned long cp = 0;
+
+            if ( ( NULL == semi ) || ( 12 < ( semi - p ) ) ) {
+                return -1;
+            }
+            if ( ( 'x' == p[2] ) || ( 'X' == p[2] ) ) {
+                cp = strtoul(p + 3, &stop, 16);
+            }
+            else {
+                cp = strtoul(p + 2, &stop, 10);
+            }
+            if (   ( stop != semi ) || ( 0 == cp ) || ( 0x10FFFF < cp )
+                || ( ( 0xD800 <= cp ) && ( 0xDFFF >= cp ) ) ) {
+                return -1;
+            }
+            out = _put_utf8(out, cp);
+            p = semi + 1;
+        }
+        else {
+            // Some entity this scanner doesn't know.
+            return -1;
+        }
+    }
+    *out = '\0';
+    return 0;
+}
+
+
+static int
+_name_char(char c)
+{
+    return (   ( ( 'a' <= c ) && ( 'z' >= c ) )
+            || ( ( 'A' <= c ) && ( 'Z' >= c ) )
+            || ( ( '0' <= c ) && ( '9' >= c ) )
+            || ( '_' == c ) || ( '-' == c ) || ( '.' == c ) || ( ':' == c ) );
+}
+
+
+/****************************************************************************
+ * Read an element name at fs->p into fs->name.
+ */
+static int
+_read_name(struct fastscan *fs)
+{
+    const char *p = fs->p;
+    size_t    len = 0;
+
+    while ( ( p < fs->end ) && ( _name_char(*p) ) ) {
+        p++;
+    }
+    len = p - fs->p;
+    if ( ( 0 == len ) || ( FAST_MAX_NAME <= len ) ) {
+        return -1;
+    }
+    memcpy(fs->name, fs->p, len);
+    fs->name[len] = '\0';
+    fs->p = p;
+    return 0;
+}
+
+
+/****************************************************************************
+ * Skip past the first occurrence of needle, or fail.
+ */
+static int
+_skip_past(struct fastscan *fs, const char *needle)
+{
+    size_t nlen = strlen(needle);
+    const char *p = fs->p;
+
+    while ( ( p = memchr(p, needle[0], fs->end - p) ) ) {
+        if ( ( nlen <= ( fs->end - p ) ) && ( 0 == memcmp(p, needle, nlen) ) ) {
+            fs->p = p + nlen;
+            return 0;
+        }
+        p++;
+    }
+    return -1;
+}
+
+
+/****************************************************************************
+ * set_node doesn't want anything inside the element just opened (named in
+ * fs->name).  Step over it, up to and including its end tag, with no
+ * events and no text decoding, the scanner's xmlTextReaderNext.
+ */
+static int
+_skip_element(struct fastscan *fs)
+{
+    char        open[FAST_MAX_NAME];
+    const char *p     = NULL;
+    int         depth = 1;
+    char        quote = 0;
+
+    memcpy(open, fs->name, FAST_MAX_NAME);
+    while ( fs->p < fs->end ) {
+        if ( NULL == ( p = memchr(fs->p, '<', fs->end - fs->p) ) ) {
+            return -1;
+        }
+        fs->p = p + 1;
+        if ( fs->p >= fs->end ) {
+            return -1;
+        }
+        if ( '/' == *fs->p ) {
+            fs->p++;
+            if ( _read_name(fs) ) {
+                return -1;
+            }
+            while ( ( fs->p < fs->end ) && ( 0x20 >= *fs->p ) ) {
+                fs->p++;
+            }
+            if ( ( fs->p >= fs->end ) || ( '>' != *fs->p ) ) {
+                return -1;
+            }
+            fs->p++;
+            if ( 0 == --depth ) {
+                // Only the outer end tag is matched by name.
+                return ( strcmp(open, fs->name) ? -1 : 0 );
+            }
+        }
+        else if ( '!' == *fs->p ) {
+            fs->p--;
+            if (   ( 4 <= ( fs->end - fs->p ) )
+                && ( 0 == memcmp(fs->p, "<!--", 4) ) ) {
+                if ( _skip_past(fs, "-->") ) {
+                    return -1;
+                }
+            }
+            else {
+                return -1;
+            }
+        }
+        else if ( '?' == *fs->p ) {
+            if ( _skip_past(fs, "?>") ) {
+                return -1;
+            }
+        }
+        else {
+            // A start tag, nested unless it closes itself.
+            for ( quote = 0; fs->p < fs->end; fs->p++ ) {
+                if ( quote ) {
+                    if ( quote == *fs->p ) {
+                        quote = 0;
+                    }
+                }
+                else if ( ( '"' == *fs->p ) || ( '\'' == *fs->p ) ) {
+                    quote = *fs->p;
+                }
+                else if ( '>' == *fs->p ) {
+                    break;
+                }
+            }
+            if ( fs->p >= fs->end ) {
+                return -1;
+            }
+            if ( '/' != fs->p[-1] ) {
+                depth++;
+            }
+            fs->p++;
+        }
+    }
+    return -1;
+}
+
+
+/****************************************************************************
+ * fs->p is just past '<', at a start tag name.
+ */
+static int
+_start_tag(struct fastscan *fs)
+{
+    int  empty = 0;
+    char quote = 0;
+    int action = NODE_NEXT;
+
+    if ( _read_name(fs) ) {
+        return -1;
+    }
+    // Attributes (only <plist version="1.0"> in practice), skip them.
+    while ( fs->p < fs->end ) {
+        if ( quote ) {
+            if ( quote == *fs->p ) {
+                quote = 0;
+            }
+        }
+        else if ( ( '"' == *fs->p ) || ( '\'' == *fs->p ) ) {
+            quote = *fs->p;
+        }
+        else if ( '>' == *fs->p ) {
+            break;
+        }
+        else if ( ( '/' == *fs->p )
+                && ( ( fs->p + 1 ) < fs->end ) && ( '>' == fs->p[1] ) ) {
+            empty = 1;
+            fs->p++;
+            break;
+        }
+        fs->p++;
+    }
+    if ( fs->p >= fs->end ) {
+        return -1;
+    }
+    fs->p++;    // past '>'
+
+    if ( ( 0 == fs->depth ) && ( fs->rootdone ) ) {
+        return -1;      // A second root element
+    }
+    superdebug("%d %d %s %d %d\n", fs->depth, 1, fs->name, empty, 0);
+    action = set_node(fs->depth, 1, fs->name, empty, 0, NULL);
+    fs->nodes++;
+
+    if ( ( NODE_SKIP == action ) && ( ! empty ) ) {
+        fs->skipped++;
+        return _skip_element(fs);
+    }
+    if ( ( empty ) && ( 0 == fs->depth ) ) {
+        fs->rootdone = 1;
+    }
+    else if ( ! empty ) {
+        if ( FAST_MAX_DEPTH <= ( fs->depth + 1 ) ) {
+            return -1;
+        }
+        memcpy(fs->stack[fs->depth], fs->name, FAST_MAX_NAME);
+        fs->depth++;
+    }
+    return 0;
+}
+
+
+/****************************************************************************
+ * fs->p is just past '</'.
+ */
+static int
+_end_tag(struct fastscan *fs)
+{
+    if ( _read_name(fs) ) {
+        return -1;
+    }
+    while ( ( fs->p < fs->end ) && ( 0x20 >= *fs->p ) ) {
+        fs->p++;
+    }
+    if ( ( fs->p >= fs->end ) || ( '>' != *fs->p ) ) {
+        return -1;
+    }
+    fs->p++;
+    if ( 0 == fs->depth ) {
+        return -1;
+    }
+    fs->depth--;
+    if ( strcmp(fs->stack[fs->depth], fs->name) ) {
+        return -1;
+    }
+    if ( 0 == fs->depth ) {
+        fs->rootdone = 1;
+    }
+    superdebug("%d %d %s %d %d\n", fs->depth, 15, fs->name, 0, 0);
+    if ( NODE_STOP == set_node(fs->depth, 15, fs->name, 0, 0, NULL) ) {
+        fs->stopped = 1;
+    }
+    fs->nodes++;
+    return 0;
+}
+
+
+/****************************************************************************
+ * Everything before the root element: BOM, <?xml?>, comments, DOCTYPE.
+ */
+static int
+_prolog(struct fastscan *fs)
+{
+    const char *decl = NULL;
+
+    if (   ( 3 <= ( fs->end - fs->p ) )
+        && ( 0 == memcmp(fs->p, "\xEF\xBB\xBF", 3) ) ) {
+        fs->p += 3;
+    }
+    while ( fs->p < fs->end ) {
+        while ( ( fs->p < fs->end ) && ( 0x20 >= *fs->p ) ) {
+            fs->p++;
+        }
+        if ( ( fs->end - fs->p ) < 2 ) {
+            return -1;
+        }
+        if ( '<' != fs->p[0] ) {
+            return -1;
+        }
+        if ( '?' == fs->p[1] ) {
+            decl = fs->p;
+            if ( _skip_past(fs, "?>") ) {
+                return -1;
+            }
+            // Only UTF-8 (or no declared encoding) is handled here.
+            for ( const char *e = decl; e + 9 < fs->p; e++ ) {
+                if ( 0 == memcmp(e, "encoding", 8) ) {
+                    e = memchr(e, '=', fs->p - e);
+                    if ( NULL == e ) {
+                        return -1;
+                    }
+                    while ( ( e < fs->p ) && ( '"' != *e ) && ( '\'' != *e ) ) {
+                        e++;
+                    }
+                    if (   ( ( fs->p - e ) < 6 )
+                        || ( strncasecmp(e + 1, "UTF-8", 5) ) ) {
+                        return -1;
+                    }
+                    break;
+                }
+            }
+        }
+        else if ( ( 4 <= ( fs->end - fs->p ) )
+                && ( 0 == memcmp(fs->p, "<!--", 4) ) ) {
+            if ( _skip_past(fs, "-->") ) {
+                return -1;
+            }
+        }
+        else if ( ( 9 <= ( fs->end - fs->p ) )
+                && ( 0 == memcmp(fs->p, "<!DOCTYPE", 9) ) ) {
+            const char *gt = memchr(fs->p, '>', fs->end - fs->p);
+            if (   ( NULL == gt )
+                || ( memchr(fs->p, '[', gt - fs->p) ) ) {
+                return -1;
+            }
+            fs->p = gt + 1;
+        }
+        else {
+            return 0;   // Root element
+        }
+    }
+    return -1;
+}
+
+
+/****************************************************************************
+ * The element content loop, from fs->p to fs->end at fs->depth.
+ */
+static int
+_scan_body(struct fastscan *fs)
+{
+    const char *mark = NULL;
+
+    while ( fs->p < fs->end ) {
+        if ( fs->p == fs->jump ) {
+            // The workers have read up to fs->jumpto.
+            if ( _join_slices(fs) ) {
+                return -1;
+            }
+            fs->p = fs->jumpto;
+            continue;
+        }
+        if ( '<' != *fs->p ) {
+            // Text up to the next tag.
+            mark  = fs->p;
+            fs->p = _scan_lt_amp(fs->p, fs->end);
+            while ( ( fs->p < fs->end ) && ( '&' == *fs->p ) ) {
+                fs->p = _scan_lt_amp(fs->p + 1, fs->end);
+            }
+            if ( 0 == fs->depth ) {
+                // Only blanks may follow the root element.
+                if ( ! _is_blank(mark, fs->p) ) {
+                    return -1;
+                }
+                continue;
+            }
+            if ( _is_blank(mark, fs->p) ) {
+                continue;
+            }
+            if ( _decode_text(fs, mark, fs->p) ) {
+                return -1;
+            }
+            superdebug("%d %d %s %d %d %.80s\n"
+                    , fs->depth, 3, "#text", 0, 1, fs->text);
+            set_node(fs->depth, 3, "#text", 0, 1, fs->text);
+            fs->nodes++;
+            continue;
+        }
+
+        if ( ( fs->end - fs->p ) < 2 ) {
+            return -1;
+        }
+        fs->p++;
+        if ( '/' == *fs->p ) {
+            fs->p++;
+            if ( _end_tag(fs) ) {
+                return -1;
+            }
+            if ( fs->stopped ) {
+                return 0;   // The rest of the document is not needed.
+            }
+        }
+        else if ( '!' == *fs->p ) {
+            fs->p--;
+            if (   ( 4 <= ( fs->end - fs->p ) )
+                && ( 0 == memcmp(fs->p, "<!--", 4) ) ) {
+                if ( _skip_past(fs, "-->") ) {
+                    return -1;
+                }
+            }
+            else {
+                // CDATA, or markup declarations outside the prolog.
+                return -1;
+            }
+        }
+        else if ( '?' == *fs->p ) {
+            if ( _skip_past(fs, "?>") ) {
+                return -1;
+            }
+        }
+        else {
+            if ( _start_tag(fs) ) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+
+static int
+_scan(struct fastscan *fs)
+{
+    if ( _prolog(fs) ) {
+        return -1;
+    }
+    if ( _scan_body(fs) ) {
+        return -1;
+    }
+    if ( fs->stopped ) {
+        return 0;
+    }
+
+    // Every element must have been closed.
+    return ( fs->depth ? -1 : 0 );
+}
+
+
+/****************************************************************************
+ * Is p at a <key>NNN</key><dict> track envelope?
+ */
+static int
+_is_envelope(const char *p, const char *end)
+{
+    if ( ( 5 > ( end - p ) ) || ( memcmp(p, "<key>", 5) ) ) {
+        return 0;
+    }
+    p += 5;
+    if ( ( p >= end ) || ( '0' > *p ) || ( '9' < *p ) ) {
+        return 0;
+    }
+    while ( ( p < end ) && ( '0' <= *p ) && ( '9' >= *p ) ) {
+        p++;
+    }
+    if ( ( 6 > ( end - p ) ) || ( memcmp(p, "</key>", 6) ) ) {
+        return 0;
+    }
+    p += 6;
+    while ( ( p < end ) && ( 0x20 >= *p ) ) {
+        p++;
+    }
+    return ( ( 6 <= ( end - p ) ) && ( 0 == memcmp(p, "<dict>", 6) ) );
+}
+
+
+/****************************************************************************
+ * Find the inside of the Tracks dict, [*first, *last), where *last is its
+ * </dict>.  Markup can't appear in text (a '<' there is &lt;), so the
+ * first <key>Tracks</key> and <key>Playlists</key> are the top level ones.
+ */
+static int
+_tracks_region(const char *buf, size_t len
+        , const char **first, const char **last)
+{
+    const char *end = buf + len;
+    const char   *p = NULL;
+    const char   *q = NULL;
+
+    if ( NULL == ( p = strkStr(buf, len, "<key>Tracks</key>", 17) ) ) {
+        return -1;
+    }
+    p += 17;
+    while ( ( p < end ) && ( 0x20 >= *p ) ) {
+        p++;
+    }
+    if ( ( 6 > ( end - p ) ) || ( memcmp(p, "<dict>", 6) ) ) {
+        return -1;
+    }
+    p += 6;
+    if ( NULL == ( q = strkStr(p, end - p, "<key>Playlists</key>", 20) ) ) {
+        return -1;
+    }
+    while ( ( q > p ) && ( 0x20 >= q[-1] ) ) {
+        q--;
+    }
+    if ( ( 7 > ( q - p ) ) || ( memcmp(q - 7, "</dict>", 7) ) ) {
+        return -1;
+    }
+    *first = p;
+    *last  = q - 7;
+    return 0;
+}
+
+
+/****************************************************************************
+ * Replay what set_node sees up to the inside of the Tracks dict, then
+ * scan one slice at depth 3, the depth of the track envelopes.
+ */
+static void *
+_slice_worker(void *arg)
+{
+    struct fastslice *sl = (struct fastslice *)arg;
+    struct fastscan   fs;
+
+    memset(&fs, 0, sizeof(struct fastscan));
+    fs.start = sl->base;
+    fs.p     = sl->start;
+    fs.end   = sl->end;
+
+    storageThreadInit(sl->share);
+    set_node(0, 1, "plist", 0, 0, NULL);
+    set_node(1, 1, "dict", 0, 0, NULL);
+    set_node(2, 1, "key", 0, 0, NULL);
+    set_node(3, 3, "#text", 0, 1, "Tracks");
+    set_node(2, 15, "key", 0, 0, NULL);
+    set_node(2, 1, "dict", 0, 0, NULL);
+    strncpy(fs.stack[0], "plist", FAST_MAX_NAME);
+    strncpy(fs.stack[1], "dict", FAST_MAX_NAME);
+    strncpy(fs.stack[2], "dict", FAST_MAX_NAME);
+    fs.depth = 3;
+
+    sl->ret = _scan_body(&fs);
+    if ( ( 0 == sl->ret ) && ( 3 != fs.depth ) ) {
+        sl->ret = -1;   // A track dict runs past the slice
+    }
+    sl->failat  = (long)( fs.p - fs.start );
+    sl->nodes   = fs.nodes;
+    sl->skipped = fs.skipped;
+    free(fs.text);
+    storageThreadDone(&sl->part);
+    return NULL;
+}
+
+
+/****************************************************************************
+ * Cut the Tracks dict into up to threads slices and start a worker on all
+ * but the first.  Sets fs->jump and fs->jumpto for _scan_body.
+ */
+static void
+_start_slices(struct fastscan *fs, const char *filename, int threads)
+{
+    const char *first = NULL;
+    const char *last  = NULL;
+    const char *cut   = NULL;
+    size_t      span  = 0;
+    int         cx    = 0;
+    int         count = 0;
+
+    if ( 0 == threads ) {
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if ( FAST_MAX_SLICES < threads ) {
+        threads = FAST_MAX_SLICES;
+    }
+    if ( 2 > threads ) {
+        return;
+    }
+    if ( _tracks_region(fs->start, fs->end - fs->start, &first, &last) ) {
+        mydebug("%s : no Tracks dict found, reading with one thread\n"
+                , filename);
+        return;
+    }
+    span = last - first;
+    if ( ( span / FAST_MIN_SLICE ) < (size_t)threads ) {
+        threads = (int)( span / FAST_MIN_SLICE );
+        if ( 2 > threads ) {
+            return;
+        }
+    }
+    fs->slices = calloc(threads, sizeof(struct fastslice));
+    if ( NULL == fs->slices ) {
+        mywarning("fast parser: Unable to allocate %ld bytes: %s\n"
+                , threads * sizeof(struct fastslice), strerror(errno));
+        return;
+    }
+
+    // Slice cx (cx >= 1) begins at the first envelope past cx/threads.
+    for ( cx = 1; cx < threads; cx++ ) {
+        cut = first + ( span / threads ) * cx;
+        if ( ( count ) && ( cut < fs->slices[count - 1].start ) ) {
+            cut = fs->slices[count - 1].start + 1;
+        }
+        while ( ( cut < last )
+            && ( NULL != ( cut = strkStr(cut, last - cut, "<key>", 5) ) )
+            && ( ! _is_envelope(cut, last) ) ) {
+            cut++;
+        }
+        if ( ( NULL == cut ) || ( cut >= last ) ) {
+            break;
+        }
+        fs->slices[count].base  = fs->start;
+        fs->slices[count].start = cut;
+        fs->slices[count].end   = last;
+        if ( count ) {
+            fs->slices[count - 1].end = cut;
+        }
+        count++;
+    }
+    if ( 0 == count ) {
+        free(fs->slices);
+        fs->slices = NULL;
+        return;
+    }
+
+    strkInit();
+    fs->jump   = fs->slices[0].start;
+    fs->jumpto = last;
+    for ( cx = 0; cx < count; cx++ ) {
+        fs->slices[cx].share = (double)( fs->slices[cx].end
+                - fs->slices[cx].start ) / span;
+        if ( pthread_create(&fs->slices[cx].thread, NULL
+                    , _slice_worker, &fs->slices[cx]) ) {
+            // The main thread reads whatever wasn't handed out.
+            mywarning("fast parser: Unable to start thread %d: %s\n"
+                    , cx + 1, strerror(errno));
+            fs->jumpto = fs->slices[cx].start;
+            break;
+        }
+        fs->slices[cx].started = 1;
+    }
+    fs->nslices = cx;
+    mydebug("%s : Tracks (%ld bytes) read by %d threads\n"
+            , filename, (long)span, fs->nslices + 1);
+}
+
+
+/****************************************************************************
+ * Wait for every worker, merge their tracks in file order.  Safe to call
+ * again, later calls do nothing.  Any failed slice fails the whole parse.
+ */
+static int
+_join_slices(struct fastscan *fs)
+{
+    int ret = 0;
+
+    for ( int cx = 0; cx < fs->nslices; cx++ ) {
+        struct fastslice *sl = &fs->slices[cx];
+        if ( ! sl->started ) {
+            continue;
+        }
+        pthread_join(sl->thread, NULL);
+        sl->started = 0;
+        storageMerge(&sl->part);
+        fs->nodes   += sl->nodes;
+        fs->skipped += sl->skipped;
+        if ( sl->ret ) {
+            mywarning("fast parser: thread %d, unexpected input at byte %ld\n"
+                    , cx + 1, sl->failat);
+            fs->slicefail = 1;
+            ret = -1;
+        }
+        extradebug("fast parser: thread %d, %ld nodes, %ld subtrees skipped\n"
+                , cx + 1, sl->nodes, sl->skipped);
+    }
+    fs->jump = NULL;
+    return ret;
+}
+
+
+/**
+ * function: fastStreamBuffer
+ * filename: name of the input, for messages
+ * buf, len: the whole document
+ * threads: Tracks dict readers, 0 for one per CPU, 1 for no workers
+ *
+ * Returns 0 when the whole buffer was parsed.  Non-zero means the caller
+ * should reset storage and parse with libxml instead.
+ */
+int
+fastStreamBuffer(const char *filename, const char *buf, size_t len
+        , int threads)
+{
+    struct fastscan fs;
+    int             ret = 0;
+
+    memset(&fs, 0, sizeof(struct fastscan));
+    fs.start = buf;
+    fs.end   = fs.start + len;
+    fs.p     = fs.start;
+
+    _start_slices(&fs, filename, threads);
+    ret = _scan(&fs);
+    if ( _join_slices(&fs) ) {
+        ret = -1;   // Only reached when the main thread never got to the jump
+    }
+    if ( ( ret ) && ( ! fs.slicefail ) ) {
+        mywarning("fast parser: %s unexpected input at byte %ld\n"
+                , filename, (long)( fs.p - fs.start ));
+    }
+    else {
+        if ( fs.stopped ) {
+            mydebug("%s : every requested playlist read, stopped at byte %ld of %ld\n"
+                    , filename, (long)( fs.p - fs.start ), (long)len);
+        }
+        extradebug("fast parser: %s, %ld nodes, %ld subtrees skipped\n"
+                , filename, fs.nodes, fs.skipped);
+    }
+
+    free(fs.text);
+    free(fs.slices);
+    return ret;
+}
+
+
+/**
+ * function: fastStreamFile
+ * filename: the file name to parse
+ * threads: see fastStreamBuffer
+ *
+ * Map the file and hand it to fastStreamBuffer.
+ */
+int
+fastStreamFile(const char *filename, int threads)
+{
+    struct stat     statbuf;
+    void           *map = NULL;
+    int              fd = -1;
+    int             ret = 0;
+
+    if ( 0 > ( fd = open(filename, O_RDONLY) ) ) {
+        mywarning("Unable to open file [%s]: %s\n"
+                , filename, strerror(errno));
+        return -1;
+    }
+    if ( ( fstat(fd, &statbuf) ) || ( 0 == statbuf.st_size ) ) {
+        mywarning("fast parser: Unable to stat file [%s]\n", filename);
+        close(fd);
+        return -1;
+    }
+    map = mmap(NULL, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if ( MAP_FAILED == map ) {
+        mywarning("fast parser: Unable to map file [%s]: %s\n"
+                , filename, strerror(errno));
+        return -1;
+    }
+#ifdef MADV_SEQUENTIAL
+    madvise(map, statbuf.st_size, MADV_SEQUENTIAL);
+#endif
+
+    ret = fastStreamBuffer(filename, (const char *)map, statbuf.st_size
+            , threads);
+
+    munmap(map, statbuf.st_size);
+    return ret;
+}
+
+/**
+ * vim: sw=4 ts=4 expandtab
+ * EOF: reader2.c
+ */
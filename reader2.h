@@ -0,0 +1,22 @@
+/****************************************************************************
+ * File: reader2.h
+ *
+ * Copyright (c) 2019-2024, Gary Allen Vollink.  http://voll.ink/playlister
+ * All rights reserved.
+ *
+ * Licence to use, see LICENSE file in this distribution.
+ */
+#ifndef READER2_H
+#define READER2_H 1
+#include <stddef.h>
+#include "utils.h"
+
+int fastStreamFile  (const char *filename, int threads);
+int fastStreamBuffer(const char *filename, const char *buf, size_t len
+                    , int threads);
+
+#endif /* READER2_H */
+/**
+vim: sw=4 ts=4 expandtab
+ * EOF: reader2.h
+ */
@@ -0,0 +1,599 @@
+/****************************************************************************
+ * reader3.c
+ *
+ * Read a binary property list (bplist00, plutil -convert binary1).
+ *
+ * A binary plist is a flat table of typed objects, found by number
+ * through an offset table; a dict is a list of key and value object
+ * numbers.  This walks the object graph from the top object and hands
+ * set_node() the events reader1.c would get for the same plist as XML:
+ * <plist>, <dict>, <key>, <string> and friends, with their text.  Nothing
+ * needs tokenizing or entity decoding, strings are ASCII or UTF-16 as
+ * stored.
+ *
+ * CFDictionary does not keep key order, so a binary plist may list
+ * "Name" before "Playlist ID", or "Playlists" before "Tracks".  set_node
+ * relies on the order iTunes writes XML in, so each dict is sent Track ID
+ * and Playlist ID first, then everything else, then Playlists and
+ * Playlist Items last.
+ *
+ * Copyright (c) 2019-2024, Gary Allen Vollink.  http://voll.ink/playlister
+ * All rights reserved.
+ *
+ * Licence to use, see LICENSE file in this distribution.
+ */
+#define READER3_C 1
+#include <stdio.h>
+#include <stdlib.h>      // malloc, realloc
+#include <stdint.h>      // uint64_t
+#include <string.h>      // memcmp, strerror
+#include <time.h>        // gmtime_r, strftime
+#include <fcntl.h>       // open
+#include <unistd.h>      // close
+#include <sys/mman.h>    // mmap
+#include <sys/stat.h>    // fstat
+#include <sys/errno.h>   // errno
+#include "utils.h"
+#include "storage.h"
+#include "reader3.h"
+
+#define BPLIST_TRAILER   32
+#define BPLIST_MAX_DEPTH 64
+#define BPLIST_EPOCH     978307200.0   // 2001-01-01T00:00:00Z, in Unix time
+
+struct bpscan {
+    const unsigned char *start;    // document base
+    size_t               len;
+    const unsigned char *offsets;  // offset table
+    int                  offsz;    // bytes per offset table entry
+    int                  refsz;    // bytes per object reference
+    uint64_t             nobjects;
+    uint64_t             top;
+    char                *text;     // converted text, reused for every value
+    size_t               textsz;
+    long                 nodes;
+    long                 skipped;  // subtrees not sent for NODE_SKIP
+    int                  stopped;  // set_node said NODE_STOP
+};
+
+
+/****************************************************************************
+ * Big endian unsigned integer of n (1 to 8) bytes.
+ */
+static uint64_t
+_uint(const unsigned char *p, int n)
+{
+    uint64_t v = 0;
+
+    while ( n-- ) {
+        v = ( v << 8 ) | *p++;
+    }
+    return v;
+}
+
+
+static int
+_text_reserve(struct bpscan *bs, size_t need)
+{
+    char *grow = NULL;
+
+    if ( need <= bs->textsz ) {
+        return 0;
+    }
+    if ( NULL == ( grow = realloc(bs->text, need + 1024) ) ) {
+        mywarning("bplist: Unable to allocate %ld bytes: %s\n"
+                , need + 1024, strerror(errno));
+        return -1;
+    }
+    bs->text   = grow;
+    bs->textsz = need + 1024;
+    return 0;
+}
+
+
+/****************************************************************************
+ * Object number ref, or NULL if it is not inside the document.
+ */
+static const unsigned char *
+_object(struct bpscan *bs, uint64_t ref)
+{
+    uint64_t off = 0;
+
+    if ( ref >= bs->nobjects ) {
+        return NULL;
+    }
+    off = _uint(bs->offsets + ( ref * bs->offsz ), bs->offsz);
+    if ( ( 8 > off ) || ( off >= (uint64_t)( bs->offsets - bs->start ) ) ) {
+        return NULL;
+    }
+    return bs->start + off;
+}
+
+
+/****************************************************************************
+ * Element count of an object (low nibble, or 0xF and an integer object
+ * after the marker) and where its data starts.  unit is the size of one
+ * element, so the data can be checked against the end of the objects.
+ */
+static int
+_count(struct bpscan *bs, const unsigned char *obj, size_t unit
+        , uint64_t *count, const unsigned char **data)
+{
+    const unsigned char *limit = bs->offsets;
+    int                  isz   = 0;
+
+    *count = obj[0] & 0x0F;
+    *data  = obj + 1;
+    if ( 0x0F == *count ) {
+        if ( ( obj + 2 > limit ) || ( 0x10 != ( obj[1] & 0xF0 ) ) ) {
+            return -1;
+        }
+        isz = 1 << ( obj[1] & 0x0F );
+        if ( ( 8 < isz ) || ( obj + 2 + isz > limit ) ) {
+            return -1;
+        }
+        *count = _uint(obj + 2, isz);
+        *data  = obj + 2 + isz;
+    }
+    if ( ( unit ) && ( *count > (uint64_t)( limit - *data ) / unit ) ) {
+        return -1;
+    }
+    return 0;
+}
+
+
+/****************************************************************************
+ * A string object (ASCII or UTF-16) as UTF-8 in bs->text.
+ */
+static int
+_string(struct bpscan *bs, const unsigned char *obj, size_t *len)
+{
+    const unsigned char *data = NULL;
+    uint64_t            count = 0;
+    unsigned long          cp = 0;
+    unsigned long          lo = 0;
+    char                 *out = NULL;
+
+    if ( 0x50 == ( obj[0] & 0xF0 ) ) {
+        if (   ( _count(bs, obj, 1, &count, &data) )
+            || ( _text_reserve(bs, count + 1) ) ) {
+            return -1;
+        }
+        memcpy(bs->text, data, count);
+        bs->text[count] = '\0';
+        *len = count;
+        return 0;
+    }
+    if ( 0x60 != ( obj[0] & 0xF0 ) ) {
+        return -1;
+    }
+    if (   ( _count(bs, obj, 2, &count, &data) )
+        || ( _text_reserve(bs, ( count * 3 ) + 1) ) ) {
+        return -1;
+    }
+    out = bs->text;
+    for ( uint64_t cx = 0; cx < count; cx++ ) {
+        cp = _uint(data + ( cx * 2 ), 2);
+        if ( ( 0xD800 <= cp ) && ( 0xDBFF >= cp ) && ( cx + 1 < count ) ) {
+            lo = _uint(data + ( ( cx + 1 ) * 2 ), 2);
+            if ( ( 0xDC00 <= lo ) && ( 0xDFFF >= lo ) ) {
+                cp = 0x10000 + ( ( cp - 0xD800 ) << 10 ) + ( lo - 0xDC00 );
+                cx++;
+            }
+        }
+        if ( cp < 0x80 ) {
+            *out++ = (char)cp;
+        }
+        else if ( cp < 0x800 ) {
+            *out++ = (char)( 0xC0 | ( cp >> 6 ) );
+            *out++ = (char)( 0x80 | ( cp & 0x3F ) );
+        }
+        else if ( cp < 0x10000 ) {
+            *out++ = (char)( 0xE0 | ( cp >> 12 ) );
+            *out++ = (char)( 0x80 | ( ( cp >> 6 ) & 0x3F ) );
+            *out++ = (char)( 0x80 | ( cp & 0x3F ) );
+        }
+        else {
+            *out++ = (char)( 0xF0 | ( cp >> 18 ) );
+            *out++ = (char)( 0x80 | ( ( cp >> 12 ) & 0x3F ) );
+            *out++ = (char)( 0x80 | ( ( cp >> 6 ) & 0x3F ) );
+            *out++ = (char)( 0x80 | ( cp & 0x3F ) );
+        }
+    }
+    *out = '\0';
+    *len = out - bs->text;
+    return 0;
+}
+
+
+/****************************************************************************
+ * <data> text, base64 like the XML (without its line breaks).
+ */
+static int
+_base64(struct bpscan *bs, const unsigned char *data, uint64_t count
+        , size_t *len)
+{
+    static const char digits[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    char    *out = NULL;
+    uint64_t  cx = 0;
+    uint32_t   v = 0;
+
+    if ( _text_reserve(bs, ( ( count + 2 ) / 3 ) * 4 + 1) ) {
+        return -1;
+    }
+    out = bs->text;
+    for ( cx = 0; cx + 2 < count; cx += 3 ) {
+        v = ( data[cx] << 16 ) | ( data[cx + 1] << 8 ) | data[cx + 2];
+        *out++ = digits[( v >> 18 ) & 0x3F];
+        *out++ = digits[( v >> 12 ) & 0x3F];
+        *out++ = digits[( v >> 6 ) & 0x3F];
+        *out++ = digits[v & 0x3F];
+    }
+    if ( cx < count ) {
+        v = data[cx] << 16;
+        if ( cx + 1 < count ) {
+            v |= data[cx + 1] << 8;
+        }
+        *out++ = digits[( v >> 18 ) & 0x3F];
+        *out++ = digits[( v >> 12 ) & 0x3F];
+        *out++ = ( cx + 1 < count ) ? digits[( v >> 6 ) & 0x3F] : '=';
+        *out++ = '=';
+    }
+    *out = '\0';
+    *len = out - bs->text;
+    return 0;
+}
+
+
+/****************************************************************************
+ * One set_node event.
+ */
+static int
+_event(struct bpscan *bs, int depth, int ntype, const char *name
+        , int empty, char *value)
+{
+    int action = NODE_NEXT;
+
+    if ( value ) {
+        superdebug("%d %d %s %d %d %.80s\n", depth, ntype, name, empty, 1
+                , value);
+    }
+    else {
+        superdebug("%d %d %s %d %d\n", depth, ntype, name, empty, 0);
+    }
+    action = set_node(depth, ntype, (char *)name, empty, ( NULL != value )
+            , value);
+    bs->nodes++;
+    if ( NODE_STOP == action ) {
+        bs->stopped = 1;
+    }
+    return action;
+}
+
+
+/****************************************************************************
+ * <name>text</name>, or just the open and close if there is no text.
+ * Returns 1 if storage said stop.
+ */
+static int
+_element(struct bpscan *bs, int depth, const char *name, size_t len)
+{
+    if ( NODE_SKIP == _event(bs, depth, 1, name, 0, NULL) ) {
+        bs->skipped++;
+        return 0;
+    }
+    if ( len ) {
+        _event(bs, depth + 1, 3, "#text", 0, bs->text);
+    }
+    _event(bs, depth, 15, name, 0, NULL);
+    return bs->stopped;
+}
+
+
+static int _emit(struct bpscan *bs, uint64_t ref, int depth);
+
+/****************************************************************************
+ * Where iTunes XML puts this key object: 0 first, 1 anywhere, 2 last.
+ * Looked at in place, the keys that matter are short ASCII strings.
+ */
+static int
+_key_rank(const unsigned char *key)
+{
+    int len = key[0] & 0x0F;
+
+    if ( 0x50 != ( key[0] & 0xF0 ) ) {
+        return 1;
+    }
+    key++;
+    if (   ( ( 8 == len ) && ( 0 == memcmp(key, "Track ID", 8) ) )
+        || ( ( 11 == len ) && ( 0 == memcmp(key, "Playlist ID", 11) ) ) ) {
+        return 0;
+    }
+    if (   ( ( 9 == len ) && ( 0 == memcmp(key, "Playlists", 9) ) )
+        || ( ( 14 == len ) && ( 0 == memcmp(key, "Playlist Items", 14) ) ) ) {
+        return 2;
+    }
+    return 1;
+}
+
+
+static int
+_dict(struct bpscan *bs, const unsigned char *obj, int depth)
+{
+    const unsigned char *refs = NULL;
+    const unsigned char *key  = NULL;
+    uint64_t            count = 0;
+    size_t                len = 0;
+    int                  rank = 0;
+    int                   ret = 0;
+
+    if ( _count(bs, obj, 2 * bs->refsz, &count, &refs) ) {
+        return -1;
+    }
+    if ( NODE_SKIP == _event(bs, depth, 1, "dict", ( 0 == count ), NULL) ) {
+        bs->skipped++;
+        return 0;
+    }
+    if ( 0 == count ) {
+        return 0;
+    }
+    for ( rank = 0; rank <= 2; rank++ ) {
+        for ( uint64_t cx = 0; cx < count; cx++ ) {
+            if ( NULL == ( key = _object(bs
+                        , _uint(refs + ( cx * bs->refsz ), bs->refsz)) ) ) {
+                return -1;
+            }
+            if ( rank != _key_rank(key) ) {
+                continue;
+            }
+            if ( _string(bs, key, &len) ) {
+                return -1;
+            }
+            if ( _element(bs, depth + 1, "key", len) ) {
+                return 1;
+            }
+            ret = _emit(bs, _uint(refs + ( ( count + cx ) * bs->refsz )
+                        , bs->refsz), depth + 1);
+            if ( ret ) {
+                return ret;
+            }
+        }
+    }
+    _event(bs, depth, 15, "dict", 0, NULL);
+    return bs->stopped;
+}
+
+
+static int
+_array(struct bpscan *bs, const unsigned char *obj, int depth)
+{
+    const unsigned char *refs = NULL;
+    uint64_t            count = 0;
+    int                   ret = 0;
+
+    if ( _count(bs, obj, bs->refsz, &count, &refs) ) {
+        return -1;
+    }
+    if ( NODE_SKIP == _event(bs, depth, 1, "array", ( 0 == count ), NULL) ) {
+        bs->skipped++;
+        return 0;
+    }
+    if ( 0 == count ) {
+        return 0;
+    }
+    for ( uint64_t cx = 0; cx < count; cx++ ) {
+        ret = _emit(bs, _uint(refs + ( cx * bs->refsz ), bs->refsz)
+                , depth + 1);
+        if ( ret ) {
+            return ret;
+        }
+    }
+    _event(bs, depth, 15, "array", 0, NULL);
+    return bs->stopped;
+}
+
+
+/****************************************************************************
+ * Send object ref (and everything under it) to storage at depth.
+ * Returns 0, 1 if storage said stop, or -1 on a malformed object.
+ */
+static int
+_emit(struct bpscan *bs, uint64_t ref, int depth)
+{
+    const unsigned char *obj  = _object(bs, ref);
+    const unsigned char *data = NULL;
+    uint64_t            count = 0;
+    size_t                len = 0;
+    int                  size = 0;
+    double                  d = 0.0;
+    uint64_t                u = 0;
+    time_t                  t = 0;
+    struct tm              tm;
+
+    if ( ( NULL == obj ) || ( BPLIST_MAX_DEPTH <= depth ) ) {
+        return -1;
+    }
+    switch ( obj[0] & 0xF0 ) {
+        case 0x00:
+            if ( ( 0x08 != obj[0] ) && ( 0x09 != obj[0] ) ) {
+                return -1;  // null, fill: not in a plist XML
+            }
+            _event(bs, depth, 1, ( 0x09 == obj[0] ) ? "true" : "false", 1
+                    , NULL);
+            return 0;
+        case 0x10:
+            size = 1 << ( obj[0] & 0x0F );
+            if ( ( 16 < size ) || ( obj + 1 + size > bs->offsets ) ) {
+                return -1;
+            }
+            // 16 byte integers hold a 64 bit value in the low half.
+            u = _uint(obj + 1 + ( 16 == size ? 8 : 0 ), ( 16 == size ? 8 : size ));
+            if ( _text_reserve(bs, 24) ) {
+                return -1;
+            }
+            if ( 8 <= size ) {
+                len = snprintf(bs->text, bs->textsz, "%lld", (long long)u);
+            }
+            else {
+                len = snprintf(bs->text, bs->textsz, "%llu"
+                        , (unsigned long long)u);
+            }
+            return _element(bs, depth, "integer", len);
+        case 0x20:
+        case 0x30:
+            size = 1 << ( obj[0] & 0x0F );
+            if (   ( ( 4 != size ) && ( 8 != size ) )
+                || ( ( 0x30 == ( obj[0] & 0xF0 ) ) && ( 0x33 != obj[0] ) )
+                || ( obj + 1 + size > bs->offsets ) ) {
+                return -1;
+            }
+            u = _uint(obj + 1, size);
+            if ( 4 == size ) {
+                float f;
+                uint32_t u32 = (uint32_t)u;
+                memcpy(&f, &u32, 4);
+                d = f;
+            }
+            else {
+                memcpy(&d, &u, 8);
+            }
+            if ( _text_reserve(bs, 64) ) {
+                return -1;
+            }
+            if ( 0x33 == obj[0] ) {
+                t = (time_t)( d + BPLIST_EPOCH );
+                if ( ( d + BPLIST_EPOCH ) < (double)t ) {
+                    t--;    // floor, for dates before 1970
+                }
+                gmtime_r(&t, &tm);
+                len = strftime(bs->text, bs->textsz, "%Y-%m-%dT%H:%M:%SZ", &tm);
+                return _element(bs, depth, "date", len);
+            }
+            len = snprintf(bs->text, bs->textsz, "%.17g", d);
+            return _element(bs, depth, "real", len);
+        case 0x40:
+            if (   ( _count(bs, obj, 1, &count, &data) )
+                || ( _base64(bs, data, count, &len) ) ) {
+                return -1;
+            }
+            return _element(bs, depth, "data", len);
+        case 0x50:
+        case 0x60:
+            if ( _string(bs, obj, &len) ) {
+                return -1;
+            }
+            return _element(bs, depth, "string", len);
+        case 0xA0:
+            return _array(bs, obj, depth);
+        case 0xD0:
+            return _dict(bs, obj, depth);
+        default:
+            return -1;      // UID, set: not in a plist XML
+    }
+}
+
+
+/**
+ * function: bplistStreamBuffer
+ * filename: name of the input, for messages
+ * buf, len: the whole document, starting with "bplist00"
+ *
+ * Returns 0 when the whole plist was read (or storage stopped it early).
+ */
+int
+bplistStreamBuffer(const char *filename, const char *buf, size_t len)
+{
+    const unsigned char *trailer = NULL;
+    struct bpscan        bs;
+    uint64_t             offtab = 0;
+    int                  ret = 0;
+
+    memset(&bs, 0, sizeof(bs));
+    bs.start = (const unsigned char *)buf;
+    bs.len   = len;
+    if (   ( BPLIST_TRAILER + 8 > len )
+        || ( memcmp(buf, BPLIST_MAGIC, 8) ) ) {
+        mywarning("bplist: %s is not a binary plist\n", filename);
+        return -1;
+    }
+    trailer     = bs.start + len - BPLIST_TRAILER;
+    bs.offsz    = trailer[6];
+    bs.refsz    = trailer[7];
+    bs.nobjects = _uint(trailer + 8, 8);
+    bs.top      = _uint(trailer + 16, 8);
+    offtab      = _uint(trailer + 24, 8);
+    if (   ( 1 > bs.offsz ) || ( 8 < bs.offsz )
+        || ( 1 > bs.refsz ) || ( 8 < bs.refsz )
+        || ( 8 > offtab ) || ( offtab > len - BPLIST_TRAILER )
+        || ( bs.nobjects > ( len - BPLIST_TRAILER - offtab ) / bs.offsz ) ) {
+        mywarning("bplist: %s has a damaged trailer\n", filename);
+        return -1;
+    }
+    bs.offsets = bs.start + offtab;
+
+    if ( NODE_SKIP != _event(&bs, 0, 1, "plist", 0, NULL) ) {
+        ret = _emit(&bs, bs.top, 1);
+        if ( 0 == ret ) {
+            _event(&bs, 0, 15, "plist", 0, NULL);
+        }
+    }
+    if ( 0 > ret ) {
+        mywarning("bplist: %s has a damaged object\n", filename);
+    }
+    else {
+        if ( bs.stopped ) {
+            mydebug("%s : every requested playlist read, stopped early\n"
+                    , filename);
+        }
+        extradebug("bplist: %s, %lld objects, %ld nodes, %ld subtrees skipped\n"
+                , filename, (long long)bs.nobjects, bs.nodes, bs.skipped);
+        ret = 0;
+    }
+    free(bs.text);
+    return ret;
+}
+
+
+/**
+ * function: bplistStreamFile
+ * filename: the file name to parse
+ *
+ * Map the file and hand it to bplistStreamBuffer.
+ */
+int
+bplistStreamFile(const char *filename)
+{
+    struct stat     statbuf;
+    void           *map = NULL;
+    int              fd = -1;
+    int             ret = 0;
+
+    if ( 0 > ( fd = open(filename, O_RDONLY) ) ) {
+        mywarning("Unable to open file [%s]: %s\n"
+                , filename, strerror(errno));
+        return -1;
+    }
+    if ( ( fstat(fd, &statbuf) ) || ( 0 == statbuf.st_size ) ) {
+        mywarning("bplist: Unable to stat file [%s]\n", filename);
+        close(fd);
+        return -1;
+    }
+    map = mmap(NULL, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if ( MAP_FAILED == map ) {
+        mywarning("bplist: Unable to map file [%s]: %s\n"
+                , filename, strerror(errno));
+        return -1;
+    }
+
+    ret = bplistStreamBuffer(filename, (const char *)map, statbuf.st_size);
+
+    munmap(map, statbuf.st_size);
+    return ret;
+}
+
+/**
+ * vim: sw=4 ts=4 expandtab
+ * EOF: reader3.c
+ */
@@ -0,0 +1,23 @@
+/****************************************************************************
+ * File: reader3.h
+ *
+ * Copyright (c) 2019-2024, Gary Allen Vollink.  http://voll.ink/playlister
+ * All rights reserved.
+ *
+ * Licence to use, see LICENSE file in this distribution.
+ */
+#ifndef READER3_H
+#define READER3_H 1
+#include <stddef.h>
+#include "utils.h"
+
+#define BPLIST_MAGIC "bplist00"
+
+int bplistStreamFile  (const char *filename);
+int bplistStreamBuffer(const char *filename, const char *buf, size_t len);
+
+#endif /* READER3_H */
+/**
+vim: sw=4 ts=4 expandtab
+ * EOF: reader3.h
+ */
@@ -0,0 +1,771 @@
+/****************************************************************************
+ * reader4.c
+ *
+ * Read a Music.app library database (Library.musicdb) directly.
+ *
+ * The file is an "hfma" header, then the records, usually zlib
+ * compressed.  Music.app also encrypts the start of what follows the
+ * header; the header says how many bytes (offset 84).  An encrypted
+ * library is refused with the same hint as before, export the XML.
+ *
+ * Apple has never documented the layout, so this reads only what public
+ * reverse engineering agrees on, and only what playlister needs.  All
+ * integers are little endian.  Every record starts with a four letter
+ * tag and its header length (offset 4); records follow one another, a
+ * track or playlist record is followed by the records that belong to it:
+ *
+ *     hfma  header: 8 file length, 84 encrypted length (must be 0)
+ *     itma  track: 16 Persistent ID (8 bytes)
+ *     lpma  playlist: 30 Playlist Persistent ID (8 bytes)
+ *     ipfa  playlist item: 24 the track's Persistent ID (8 bytes)
+ *     boma  string: 8 record length (not header), 12 field, 20 encoding
+ *           (1 UTF-16, 2 UTF-8), 24 byte length, 36 the string
+ *
+ * Anything else (hsma sections, ltma and lPma lists, albums, artists) is
+ * stepped over by its header length.  Like reader3.c, the records are
+ * handed to set_node() as the events reader1.c would get for the same
+ * library as XML.  Track and Playlist IDs are not stored in the database,
+ * they are numbered here in the order the records come.
+ *
+ * tests/musicdb-fixture.py writes the test library in this layout.
+ *
+ * Copyright (c) 2019-2024, Gary Allen Vollink.  http://voll.ink/playlister
+ * All rights reserved.
+ *
+ * Licence to use, see LICENSE file in this distribution.
+ */
+#define READER4_C 1
+#include <stdio.h>
+#include <stdlib.h>      // malloc, realloc
+#include <stdint.h>      // uint32_t, uint64_t
+#include <string.h>      // memcmp, memcpy, strerror
+#include <fcntl.h>       // open
+#include <unistd.h>      // close
+#include <sys/mman.h>    // mmap
+#include <sys/stat.h>    // fstat
+#include <sys/errno.h>   // errno
+#include "utils.h"
+#include "storage.h"
+#include "source.h"      // sourceMusicdb
+#include "reader4.h"
+#if 1 == HAS_ZLIB        /* DEFINED (or not) in configure.h */
+#include <zlib.h>
+#endif
+
+#define MUSICDB_HEADER   88     // hfma, through the encrypted length
+#define MUSICDB_CRYPT    84
+#define MUSICDB_STRING   36     // boma, where the string starts
+#define MUSICDB_NAME     0xC8   // boma field: playlist name
+
+/* boma fields of a track, and the XML key for each */
+static const struct {
+    uint32_t    field;
+    const char *key;
+} _track_strings[] = {
+    { 0x02, "Name" },
+    { 0x03, "Album" },
+    { 0x04, "Artist" },
+    { 0x05, "Genre" },
+    { 0x06, "Kind" },
+    { 0x0B, "Location" },
+    { 0x1B, "Album Artist" },
+};
+
+/* A track or playlist, and where its records are */
+struct mdbitem {
+    uint64_t       pid;
+    size_t         from;    // first record after the itma or lpma
+    size_t         to;      // end of its last record
+    int            id;
+    UT_hash_handle hh;
+};
+
+static const UT_icd item_icd = { sizeof(struct mdbitem), NULL, NULL, NULL };
+
+struct mdbscan {
+    const unsigned char *start;    // the records
+    size_t               len;
+    UT_array            *tracks;
+    UT_array            *lists;
+    struct mdbitem      *bypid;    // tracks, by Persistent ID
+    char                *text;     // converted text, reused for every value
+    size_t               textsz;
+    long                 nodes;
+    long                 skipped;  // subtrees not sent for NODE_SKIP
+    long                 dangling; // playlist items with no track
+    int                  stopped;  // set_node said NODE_STOP
+};
+
+
+static uint32_t
+_u32(const unsigned char *p)
+{
+    return ( (uint32_t)p[0] ) | ( (uint32_t)p[1] << 8 )
+        | ( (uint32_t)p[2] << 16 ) | ( (uint32_t)p[3] << 24 );
+}
+
+
+static uint64_t
+_u64(const unsigned char *p)
+{
+    return ( (uint64_t)_u32(p + 4) << 32 ) | _u32(p);
+}
+
+
+static int
+_text_reserve(struct mdbscan *ms, size_t need)
+{
+    char *grow = NULL;
+
+    if ( need <= ms->textsz ) {
+        return 0;
+    }
+    if ( NULL == ( grow = realloc(ms->text, need + 1024) ) ) {
+        mywarning("musicdb: Unable to allocate %ld bytes: %s\n"
+                , need + 1024, strerror(errno));
+        return -1;
+    }
+    ms->text   = grow;
+    ms->textsz = need + 1024;
+    return 0;
+}
+
+
+/**
+ * function: musicdbHeader
+ * head, len: the start of the file
+ * size: the size of the whole file
+ *
+ * Returns the header length of a Library.musicdb that is all there and
+ * not encrypted, or 0 if playlister can not read it.
+ */
+size_t
+musicdbHeader(const char *head, size_t len, uint64_t size)
+{
+    const unsigned char *h = (const unsigned char *)head;
+    uint32_t          hlen = 0;
+
+    if (   ( MUSICDB_HEADER > len )
+        || ( memcmp(head, MUSICDB_MAGIC, 4) ) ) {
+        return 0;
+    }
+    hlen = _u32(h + 4);
+    if (   ( MUSICDB_HEADER > hlen ) || ( hlen > size )
+        || ( _u32(h + 8) != size )
+        || ( 0 != _u32(h + MUSICDB_CRYPT) ) ) {
+        return 0;
+    }
+    return hlen;
+}
+
+
+/****************************************************************************
+ * Length of the record at pos, or 0 if it runs past the end.
+ */
+static size_t
+_record(struct mdbscan *ms, size_t pos)
+{
+    const unsigned char *rec = ms->start + pos;
+    size_t              left = ms->len - pos;
+    size_t               len = 0;
+
+    if ( 12 > left ) {
+        return 0;
+    }
+    len = _u32(rec + ( memcmp(rec, "boma", 4) ? 4 : 8 ));
+    if ( ( 12 > len ) || ( len > left ) ) {
+        return 0;
+    }
+    return len;
+}
+
+
+/****************************************************************************
+ * One pass over the records: every itma and lpma, with the range of the
+ * records that follow it.  Then number the tracks and playlists.
+ */
+static int
+_walk(struct mdbscan *ms)
+{
+    const unsigned char *rec = NULL;
+    struct mdbitem      *dup = NULL;
+    struct mdbitem      *cur = NULL;
+    struct mdbitem      work;
+    UT_array            *in  = NULL;
+    size_t               pos = 0;
+    size_t               len = 0;
+    int                   id = 0;
+
+    while ( pos < ms->len ) {
+        if ( 0 == ( len = _record(ms, pos) ) ) {
+            return -1;
+        }
+        rec = ms->start + pos;
+        if (   ( ( 0 == memcmp(rec, "itma", 4) ) && ( 24 <= len ) )
+            || ( ( 0 == memcmp(rec, "lpma", 4) ) && ( 38 <= len ) ) ) {
+            memset(&work, 0, sizeof(work));
+            work.pid  = _u64(rec + ( 'i' == rec[0] ? 16 : 30 ));
+            work.from = pos + len;
+            work.to   = pos + len;
+            in = ( 'i' == rec[0] ) ? ms->tracks : ms->lists;
+            utarray_push_back(in, &work);
+        }
+        else if (   ( in )
+                 && (   ( 0 == memcmp(rec, "boma", 4) )
+                     || ( 0 == memcmp(rec, "ipfa", 4) ) ) ) {
+            cur = (struct mdbitem *) utarray_back(in);
+            cur->to = pos + len;
+        }
+        else {
+            in = NULL;
+        }
+        pos += len;
+    }
+
+    // Only now, the arrays won't move again.
+    for ( cur = (struct mdbitem *) utarray_front(ms->tracks)
+        ; cur != NULL
+        ; cur = (struct mdbitem *) utarray_next(ms->tracks, cur)
+        ) {
+        cur->id = ++id;
+        HASH_FIND(hh, ms->bypid, &cur->pid, sizeof(uint64_t), dup);
+        if ( NULL == dup ) {
+            HASH_ADD(hh, ms->bypid, pid, sizeof(uint64_t), cur);
+        }
+    }
+    for ( cur = (struct mdbitem *) utarray_front(ms->lists)
+        ; cur != NULL
+        ; cur = (struct mdbitem *) utarray_next(ms->lists, cur)
+        ) {
+        cur->id = ++id;
+    }
+    return 0;
+}
+
+
+/****************************************************************************
+ * The string in a boma record as UTF-8 in ms->text.  Returns 1 for a
+ * field that is not a string this knows.
+ */
+static int
+_string(struct mdbscan *ms, const unsigned char *rec, size_t reclen
+        , size_t *len)
+{
+    const unsigned char *data = rec + MUSICDB_STRING;
+    uint32_t            count = 0;
+    unsigned long          cp = 0;
+    unsigned long          lo = 0;
+    char                 *out = NULL;
+
+    if ( MUSICDB_STRING > reclen ) {
+        return -1;
+    }
+    count = _u32(rec + 24);
+    if ( count > reclen - MUSICDB_STRING ) {
+        return -1;
+    }
+    if ( 2 == _u32(rec + 20) ) {
+        if ( _text_reserve(ms, count + 1) ) {
+            return -1;
+        }
+        memcpy(ms->text, data, count);
+        ms->text[count] = '\0';
+        *len = count;
+        return 0;
+    }
+    if ( 1 != _u32(rec + 20) ) {
+        return 1;
+    }
+    count /= 2;
+    if ( _text_reserve(ms, ( count * 3 ) + 1) ) {
+        return -1;
+    }
+    out = ms->text;
+    for ( uint32_t cx = 0; cx < count; cx++ ) {
+        cp = data[cx * 2] | ( data[( cx * 2 ) + 1] << 8 );
+        if ( ( 0xD800 <= cp ) && ( 0xDBFF >= cp ) && ( cx + 1 < count ) ) {
+            lo = data[( cx + 1 ) * 2] | ( data[( ( cx + 1 ) * 2 ) + 1] << 8 );
+            if ( ( 0xDC00 <= lo ) && ( 0xDFFF >= lo ) ) {
+                cp = 0x10000 + ( ( cp - 0xD800 ) << 10 ) + ( lo - 0xDC00 );
+                cx++;
+            }
+        }
+        if ( cp < 0x80 ) {
+            *out++ = (char)cp;
+        }
+        else if ( cp < 0x800 ) {
+            *out++ = (char)( 0xC0 | ( cp >> 6 ) );
+            *out++ = (char)( 0x80 | ( cp & 0x3F ) );
+        }
+        else if ( cp < 0x10000 ) {
+            *out++ = (char)( 0xE0 | ( cp >> 12 ) );
+            *out++ = (char)( 0x80 | ( ( cp >> 6 ) & 0x3F ) );
+            *out++ = (char)( 0x80 | ( cp & 0x3F ) );
+        }
+        else {
+            *out++ = (char)( 0xF0 | ( cp >> 18 ) );
+            *out++ = (char)( 0x80 | ( ( cp >> 12 ) & 0x3F ) );
+            *out++ = (char)( 0x80 | ( ( cp >> 6 ) & 0x3F ) );
+            *out++ = (char)( 0x80 | ( cp & 0x3F ) );
+        }
+    }
+    *out = '\0';
+    *len = out - ms->text;
+    return 0;
+}
+
+
+/****************************************************************************
+ * One set_node event.
+ */
+static int
+_event(struct mdbscan *ms, int depth, int ntype, const char *name
+        , int empty, char *value)
+{
+    int action = NODE_NEXT;
+
+    if ( value ) {
+        superdebug("%d %d %s %d %d %.80s\n", depth, ntype, name, empty, 1
+                , value);
+    }
+    else {
+        superdebug("%d %d %s %d %d\n", depth, ntype, name, empty, 0);
+    }
+    action = set_node(depth, ntype, (char *)name, empty, ( NULL != value )
+            , value);
+    ms->nodes++;
+    if ( NODE_STOP == action ) {
+        ms->stopped = 1;
+    }
+    return action;
+}
+
+
+/****************************************************************************
+ * <name>text</name> with the text in ms->text, or just the open and close
+ * if there is no text.  Returns 1 if storage said stop.
+ */
+static int
+_element(struct mdbscan *ms, int depth, const char *name, size_t len)
+{
+    if ( NODE_SKIP == _event(ms, depth, 1, name, 0, NULL) ) {
+        ms->skipped++;
+        return 0;
+    }
+    if ( len ) {
+        _event(ms, depth + 1, 3, "#text", 0, ms->text);
+    }
+    _event(ms, depth, 15, name, 0, NULL);
+    return ms->stopped;
+}
+
+
+/****************************************************************************
+ * <name>value</name>, value printed into ms->text.
+ */
+static int
+_value(struct mdbscan *ms, int depth, const char *name, const char *fmt
+        , unsigned long long value)
+{
+    size_t len = 0;
+
+    if ( _text_reserve(ms, 24) ) {
+        return -1;
+    }
+    len = snprintf(ms->text, ms->textsz, fmt, value);
+    return _element(ms, depth, name, len);
+}
+
+
+static int
+_key(struct mdbscan *ms, int depth, const char *key)
+{
+    size_t len = strlen(key);
+
+    if ( _text_reserve(ms, len + 1) ) {
+        return -1;
+    }
+    memcpy(ms->text, key, len + 1);
+    return _element(ms, depth, "key", len);
+}
+
+
+/****************************************************************************
+ * Every boma field of an item that has an XML key (or is the playlist
+ * name), as <key> and <string>.
+ */
+static int
+_strings(struct mdbscan *ms, struct mdbitem *item, int depth, int track)
+{
+    const unsigned char *rec = NULL;
+    const char          *key = NULL;
+    size_t               pos = item->from;
+    size_t            reclen = 0;
+    size_t               len = 0;
+    uint32_t           field = 0;
+    int                  ret = 0;
+
+    for ( ; pos < item->to; pos += reclen ) {
+        rec    = ms->start + pos;
+        reclen = _record(ms, pos);
+        if ( memcmp(rec, "boma", 4) ) {
+            continue;
+        }
+        field = _u32(rec + 12);
+        key   = NULL;
+        if ( track ) {
+            for ( size_t kx = 0
+                ; kx < sizeof(_track_strings) / sizeof(_track_strings[0])
+                ; kx++ ) {
+                if ( field == _track_strings[kx].field ) {
+                    key = _track_strings[kx].key;
+                }
+            }
+        }
+        else if ( MUSICDB_NAME == field ) {
+            key = "Name";
+        }
+        if ( NULL == key ) {
+            continue;
+        }
+        if ( ( ret = _key(ms, depth, key) ) ) {
+            return ret;
+        }
+        if ( 0 > ( ret = _string(ms, rec, reclen, &len) ) ) {
+            return -1;
+        }
+        if ( ( 0 == ret ) && ( _element(ms, depth, "string", len) ) ) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+/****************************************************************************
+ * <key>id</key><dict> ... </dict> for one track, in <dict> Tracks.
+ */
+static int
+_track(struct mdbscan *ms, struct mdbitem *item, int depth)
+{
+    int ret = 0;
+
+    if ( ( ret = _value(ms, depth, "key", "%llu", item->id) ) ) {
+        return ret;
+    }
+    if ( NODE_SKIP == _event(ms, depth, 1, "dict", 0, NULL) ) {
+        ms->skipped++;
+        return 0;
+    }
+    if (   ( ret = _key(ms, depth + 1, "Track ID") )
+        || ( ret = _value(ms, depth + 1, "integer", "%llu", item->id) )
+        || ( ret = _key(ms, depth + 1, "Persistent ID") )
+        || ( ret = _value(ms, depth + 1, "string", "%016llX", item->pid) )
+        || ( ret = _strings(ms, item, depth + 1, 1) ) ) {
+        return ret;
+    }
+    _event(ms, depth, 15, "dict", 0, NULL);
+    return ms->stopped;
+}
+
+
+/****************************************************************************
+ * <dict> ... </dict> for one playlist, in <array> Playlists.
+ */
+static int
+_playlist(struct mdbscan *ms, struct mdbitem *item, int depth)
+{
+    const unsigned char *rec = NULL;
+    struct mdbitem      *trk = NULL;
+    size_t               pos = 0;
+    size_t            reclen = 0;
+    uint64_t             pid = 0;
+    long               items = 0;
+    int                  ret = 0;
+
+    if ( NODE_SKIP == _event(ms, depth, 1, "dict", 0, NULL) ) {
+        ms->skipped++;
+        return 0;
+    }
+    if (   ( ret = _key(ms, depth + 1, "Playlist ID") )
+        || ( ret = _value(ms, depth + 1, "integer", "%llu", item->id) )
+        || ( ret = _key(ms, depth + 1, "Playlist Persistent ID") )
+        || ( ret = _value(ms, depth + 1, "string", "%016llX", item->pid) )
+        || ( ret = _strings(ms, item, depth + 1, 0) ) ) {
+        return ret;
+    }
+    for ( pos = item->from; pos < item->to; pos += _record(ms, pos) ) {
+        items += ( 0 == memcmp(ms->start + pos, "ipfa", 4) );
+    }
+    if ( items ) {
+        if ( ( ret = _key(ms, depth + 1, "Playlist Items") ) ) {
+            return ret;
+        }
+        if ( NODE_SKIP == _event(ms, depth + 1, 1, "array", 0, NULL) ) {
+            ms->skipped++;
+            items = 0;
+        }
+    }
+    for ( pos = item->from; ( items ) && ( pos < item->to ); pos += reclen ) {
+        rec    = ms->start + pos;
+        reclen = _record(ms, pos);
+        if ( memcmp(rec, "ipfa", 4) ) {
+            continue;
+        }
+        trk = NULL;
+        if ( 32 <= reclen ) {
+            pid = _u64(rec + 24);
+            HASH_FIND(hh, ms->bypid, &pid, sizeof(uint64_t), trk);
+        }
+        if ( NULL == trk ) {
+            ms->dangling++;
+            continue;
+        }
+        if ( NODE_SKIP == _event(ms, depth + 2, 1, "dict", 0, NULL) ) {
+            ms->skipped++;
+            continue;
+        }
+        if (   ( ret = _key(ms, depth + 3, "Track ID") )
+            || ( ret = _value(ms, depth + 3, "integer", "%llu", trk->id) ) ) {
+            return ret;
+        }
+        _event(ms, depth + 2, 15, "dict", 0, NULL);
+        if ( ms->stopped ) {
+            return 1;
+        }
+    }
+    if ( items ) {
+        _event(ms, depth + 1, 15, "array", 0, NULL);
+    }
+    _event(ms, depth, 15, "dict", 0, NULL);
+    return ms->stopped;
+}
+
+
+/****************************************************************************
+ * The whole library, as <plist><dict> Tracks, then Playlists.
+ */
+static int
+_emit(struct mdbscan *ms)
+{
+    struct mdbitem *item = NULL;
+    int              ret = 0;
+
+    if ( NODE_SKIP == _event(ms, 0, 1, "plist", 0, NULL) ) {
+        return 0;
+    }
+    if ( NODE_SKIP == _event(ms, 1, 1, "dict", 0, NULL) ) {
+        return 0;
+    }
+    if ( ( ret = _key(ms, 2, "Tracks") ) ) {
+        return ret;
+    }
+    if ( 0 == utarray_len(ms->tracks) ) {
+        _event(ms, 2, 1, "dict", 1, NULL);
+    }
+    else if ( NODE_SKIP == _event(ms, 2, 1, "dict", 0, NULL) ) {
+        ms->skipped++;
+    }
+    else {
+        for ( item = (struct mdbitem *) utarray_front(ms->tracks)
+            ; item != NULL
+            ; item = (struct mdbitem *) utarray_next(ms->tracks, item)
+            ) {
+            if ( ( ret = _track(ms, item, 3) ) ) {
+                return ret;
+            }
+        }
+        _event(ms, 2, 15, "dict", 0, NULL);
+    }
+    if ( ( ret = _key(ms, 2, "Playlists") ) ) {
+        return ret;
+    }
+    if ( 0 == utarray_len(ms->lists) ) {
+        _event(ms, 2, 1, "array", 1, NULL);
+    }
+    else if ( NODE_SKIP == _event(ms, 2, 1, "array", 0, NULL) ) {
+        ms->skipped++;
+    }
+    else {
+        for ( item = (struct mdbitem *) utarray_front(ms->lists)
+            ; item != NULL
+            ; item = (struct mdbitem *) utarray_next(ms->lists, item)
+            ) {
+            if ( ( ret = _playlist(ms, item, 3) ) ) {
+                return ret;
+            }
+        }
+        _event(ms, 2, 15, "array", 0, NULL);
+    }
+    _event(ms, 1, 15, "dict", 0, NULL);
+    _event(ms, 0, 15, "plist", 0, NULL);
+    return ms->stopped;
+}
+
+
+#if 1 == HAS_ZLIB
+/****************************************************************************
+ * Inflate the zlib compressed records into one malloc()ed buffer.
+ */
+static unsigned char *
+_inflate(const char *filename, const unsigned char *in, size_t inlen
+        , size_t *outlen)
+{
+    unsigned char *out  = NULL;
+    unsigned char *grow = NULL;
+    size_t         size = ( inlen * 4 ) + 65536;
+    z_stream         zs;
+    int            zret = Z_OK;
+
+    memset(&zs, 0, sizeof(zs));
+    if ( Z_OK != inflateInit(&zs) ) {
+        mywarning("%s : zlib: unable to initialize\n", filename);
+        return NULL;
+    }
+    zs.next_in  = (Bytef *)in;
+    zs.avail_in = inlen;
+    while ( Z_STREAM_END != zret ) {
+        if ( ( NULL == out ) || ( 0 == zs.avail_out ) ) {
+            if ( out ) {
+                size *= 2;
+            }
+            if ( NULL == ( grow = realloc(out, size) ) ) {
+                mywarning("musicdb: Unable to allocate %ld bytes: %s\n"
+                        , size, strerror(errno));
+                free(out);
+                inflateEnd(&zs);
+                return NULL;
+            }
+            out          = grow;
+            zs.next_out  = out + zs.total_out;
+            zs.avail_out = size - zs.total_out;
+        }
+        zret = inflate(&zs, Z_NO_FLUSH);
+        if (   ( Z_STREAM_END != zret ) && ( Z_OK != zret )
+            && ( ( Z_BUF_ERROR != zret ) || ( 0 == zs.avail_in ) ) ) {
+            mywarning("%s : zlib: %s\n", filename
+                    , ( zs.msg ? zs.msg : "damaged or cut short" ) );
+            free(out);
+            inflateEnd(&zs);
+            return NULL;
+        }
+    }
+    *outlen = zs.total_out;
+    inflateEnd(&zs);
+    return out;
+}
+#endif /* HAS_ZLIB */
+
+
+/**
+ * function: musicdbStreamBuffer
+ * filename: name of the input, for messages
+ * buf, len: the whole file, starting with "hfma"
+ *
+ * Returns 0 when the whole library was read (or storage stopped it early).
+ */
+int
+musicdbStreamBuffer(const char *filename, const char *buf, size_t len)
+{
+    const unsigned char *records = NULL;
+    unsigned char       *inflated = NULL;
+    struct mdbscan       ms;
+    size_t               hlen = 0;
+    int                  ret = 0;
+
+    if ( 0 == ( hlen = musicdbHeader(buf, len, len) ) ) {
+        sourceMusicdb(filename);
+        return -1;
+    }
+    memset(&ms, 0, sizeof(ms));
+    records = (const unsigned char *)buf + hlen;
+    ms.len  = len - hlen;
+    if ( ( ms.len ) && ( 0x78 == records[0] ) ) {
+#if 1 == HAS_ZLIB
+        if ( NULL == ( inflated = _inflate(filename, records, ms.len
+                        , &ms.len) ) ) {
+            return -1;
+        }
+        records = inflated;
+#else
+        mywarning("%s is zlib compressed, %s\n", filename
+                , "playlister was built without HAS_ZLIB (see configure.h)");
+        return -1;
+#endif /* HAS_ZLIB */
+    }
+    ms.start = records;
+    utarray_new(ms.tracks, &item_icd);
+    utarray_new(ms.lists, &item_icd);
+
+    if ( _walk(&ms) ) {
+        mywarning("musicdb: %s has a damaged record\n", filename);
+        ret = -1;
+    }
+    else if ( 0 > ( ret = _emit(&ms) ) ) {
+        mywarning("musicdb: %s has a damaged string\n", filename);
+    }
+    else {
+        if ( ms.stopped ) {
+            mydebug("%s : every requested playlist read, stopped early\n"
+                    , filename);
+        }
+        if ( ms.dangling ) {
+            mywarning("musicdb: %s has %ld playlist items with no track\n"
+                    , filename, ms.dangling);
+        }
+        extradebug("musicdb: %s, %u tracks, %u playlists, %ld nodes,"
+                " %ld subtrees skipped\n", filename, utarray_len(ms.tracks)
+                , utarray_len(ms.lists), ms.nodes, ms.skipped);
+        ret = 0;
+    }
+    HASH_CLEAR(hh, ms.bypid);
+    utarray_free(ms.tracks);
+    utarray_free(ms.lists);
+    free(ms.text);
+    free(inflated);
+    return ret;
+}
+
+
+/**
+ * function: musicdbStreamFile
+ * filename: the file name to parse
+ *
+ * Map the file and hand it to musicdbStreamBuffer.
+ */
+int
+musicdbStreamFile(const char *filename)
+{
+    struct stat     statbuf;
+    void           *map = NULL;
+    int              fd = -1;
+    int             ret = 0;
+
+    if ( 0 > ( fd = open(filename, O_RDONLY) ) ) {
+        mywarning("Unable to open file [%s]: %s\n"
+                , filename, strerror(errno));
+        return -1;
+    }
+    if ( ( fstat(fd, &statbuf) ) || ( 0 == statbuf.st_size ) ) {
+        mywarning("musicdb: Unable to stat file [%s]\n", filename);
+        close(fd);
+        return -1;
+    }
+    map = mmap(NULL, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if ( MAP_FAILED == map ) {
+        mywarning("musicdb: Unable to map file [%s]: %s\n"
+                , filename, strerror(errno));
+        return -1;
+    }
+
+    ret = musicdbStreamBuffer(filename, (const char *)map, statbuf.st_size);
+
+    munmap(map, statbuf.st_size);
+    return ret;
+}
+
+/**
+ * vim: sw=4 ts=4 expandtab
+ * EOF: reader4.c
+ */
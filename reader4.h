@@ -0,0 +1,25 @@
+/****************************************************************************
+ * File: reader4.h
+ *
+ * Copyright (c) 2019-2024, Gary Allen Vollink.  http://voll.ink/playlister
+ * All rights reserved.
+ *
+ * Licence to use, see LICENSE file in this distribution.
+ */
+#ifndef READER4_H
+#define READER4_H 1
+#include <stddef.h>
+#include <stdint.h>      // uint64_t
+#include "utils.h"
+
+#define MUSICDB_MAGIC "hfma"
+
+size_t musicdbHeader      (const char *head, size_t len, uint64_t size);
+int    musicdbStreamFile  (const char *filename);
+int    musicdbStreamBuffer(const char *filename, const char *buf, size_t len);
+
+#endif /* READER4_H */
+/**
+vim: sw=4 ts=4 expandtab
+ * EOF: reader4.h
+ */
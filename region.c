@@ -0,0 +1,168 @@
+/****************************************************************************
+ * File: region.c
+ *
+ * Region (bump) allocation for things that all die together.
+ *
+ * The playlists, the requested names, and the like are small, numerous,
+ * and all freed in the same breath by storageFree().  Rather than one
+ * malloc() and one free() each, they are cut from a few large blocks, and
+ * the blocks are handed back whole.  Blocks come straight from mmap(),
+ * start at REGION_FIRST and double up to REGION_MAX; one of REGION_HUGE
+ * or more is offered to the kernel for transparent huge pages where
+ * madvise() knows about them.
+ *
+ * Copyright (c) 2019-2024, Gary Allen Vollink.  http://voll.ink/playlister
+ * All rights reserved.
+ *
+ * Licence to use, see LICENSE file in this distribution.
+ */
+#define REGION_C 1
+#include <stdio.h>
+#include <stdlib.h>      // exit
+#include <string.h>      // memset, strerror
+#include <sys/mman.h>    // mmap, munmap, madvise
+#include <sys/errno.h>   // errno
+#include "utils.h"
+#include "region.h"
+
+#define REGION_FIRST ( 64 * 1024 )
+#define REGION_MAX   ( 4 * 1024 * 1024 )
+#define REGION_HUGE  ( 2 * 1024 * 1024 )
+#define REGION_ALIGN 16
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+struct regionblk {
+    struct regionblk *prev;
+    size_t            size;     // whole mapping, this header included
+};
+
+// The header, rounded up so the first allocation is aligned too.
+#define REGION_HEAD ( ( sizeof(struct regionblk) + REGION_ALIGN - 1 ) \
+                        & ~( (size_t)REGION_ALIGN - 1 ) )
+
+struct region parse_region  = { "parse" };
+struct region render_region = { "render" };
+
+
+/****************************************************************************
+ * Map a block with room for at least need bytes after its header.
+ */
+static struct regionblk *
+_block_new(struct region *rg, size_t need)
+{
+    struct regionblk *blk  = NULL;
+    size_t            size = REGION_FIRST;
+
+    if ( rg->head ) {
+        size = rg->head->size * 2;
+        if ( size > REGION_MAX ) {
+            size = REGION_MAX;
+        }
+    }
+    while ( size < need + REGION_HEAD ) {
+        size *= 2;
+    }
+
+    blk = mmap(NULL, size, PROT_READ | PROT_WRITE
+            , MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if ( MAP_FAILED == blk ) {
+        myfatal("region %s: Unable to map %ld bytes: %s\n"
+                , rg->name, (long)size, strerror(errno));
+        exit(2);
+    }
+#ifdef MADV_HUGEPAGE
+    if ( REGION_HUGE <= size ) {
+        madvise(blk, size, MADV_HUGEPAGE);
+    }
+#endif
+    blk->prev = rg->head;
+    blk->size = size;
+    rg->head  = blk;
+    rg->used  = REGION_HEAD;
+    rg->blocks++;
+    return blk;
+}
+
+
+/****************************************************************************
+ * size bytes of zeroed memory, good until the region is reset or freed.
+ */
+void *
+regionAlloc(struct region *rg, size_t size)
+{
+    char *ret = NULL;
+
+    size = ( size + REGION_ALIGN - 1 ) & ~( (size_t)REGION_ALIGN - 1 );
+    if ( ( NULL == rg->head ) || ( rg->used + size > rg->head->size ) ) {
+        _block_new(rg, size);
+    }
+    ret = (char *)rg->head + rg->used;
+    rg->used  += size;
+    rg->bytes += size;
+    rg->allocs++;
+    memset(ret, 0, size);
+    return ret;
+}
+
+
+/****************************************************************************
+ * Give back everything handed out, but keep the first block mapped for
+ * the next round.
+ */
+void
+regionReset(struct region *rg)
+{
+    struct regionblk *blk = rg->head;
+
+    while ( ( blk ) && ( blk->prev ) ) {
+        rg->head = blk->prev;
+        munmap(blk, blk->size);
+        rg->blocks--;
+        blk = rg->head;
+    }
+    rg->used   = REGION_HEAD;
+    rg->bytes  = 0;
+    rg->allocs = 0;
+}
+
+
+void
+regionFree(struct region *rg)
+{
+    struct regionblk *blk = rg->head;
+
+    while ( blk ) {
+        rg->head = blk->prev;
+        munmap(blk, blk->size);
+        blk = rg->head;
+    }
+    rg->used   = 0;
+    rg->bytes  = 0;
+    rg->allocs = 0;
+    rg->blocks = 0;
+}
+
+
+void
+regionInfo(struct region *rg)
+{
+    size_t mapped = 0;
+
+    for ( struct regionblk *blk = rg->head; blk; blk = blk->prev ) {
+        mapped += blk->size;
+    }
+    mydebug("rI: Region %s: %ld KB in %ld allocations, %ld KB mapped"
+            " in %ld block%s\n"
+            , rg->name, (long)( rg->bytes / 1024 ), rg->allocs
+            , (long)( mapped / 1024 ), rg->blocks
+            , ( 1 == rg->blocks ? "" : "s" ));
+}
+
+
+/**
+ * vim: sw=4 ts=4 expandtab
+ * EOF: region.c
+ */
@@ -0,0 +1,45 @@
+/****************************************************************************
+ * File: region.h
+ *
+ * Bump allocation with one release per lifetime (region.c).
+ *
+ * Copyright (c) 2019-2024, Gary Allen Vollink.  http://voll.ink/playlister
+ * All rights reserved.
+ *
+ * Licence to use, see LICENSE file in this distribution.
+ */
+#ifndef REGION_H
+#define REGION_H 1
+#include <stddef.h>
+
+struct regionblk;
+
+/****
+ * Memory handed out from a region is never freed one piece at a time,
+ * regionReset() or regionFree() gives it all back at once.  A region
+ * belongs to one thread at a time.
+ */
+struct region {
+    const char       *name;     // for regionInfo()
+    struct regionblk *head;     // newest block
+    size_t            used;     // bytes used in head
+    size_t            bytes;    // bytes handed out since the last reset
+    long              allocs;   // regionAlloc() calls since the last reset
+    long              blocks;   // blocks held
+};
+
+void * regionAlloc(struct region *rg, size_t size);
+void   regionReset(struct region *rg);
+void   regionFree (struct region *rg);
+void   regionInfo (struct region *rg);
+
+#ifndef REGION_C
+extern struct region parse_region;      // storageInit() to storageFree()
+extern struct region render_region;     // one list line, see listm3u.c
+#endif /* REGION_C */
+
+#endif /* REGION_H */
+/**
+ * vim: sw=4 ts=4 expandtab
+ * EOF: region.h
+ */
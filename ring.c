@@ -0,0 +1,303 @@
+/****************************************************************************
+ * File: ring.c
+ *
+ * Node event ring between the libxml reader thread and a storage thread.
+ *
+ * reader1.c pushes one event per node (depth, type, flags, and the name
+ * and value copied into a text arena); the storage thread pops them and
+ * runs set_node, so tokenizing and storage overlap on two cores.  Both
+ * the events and the arena are rings with fixed homes, nothing is
+ * allocated per event.  One side only ever writes head/thead, the other
+ * only tail/ttail, so plain acquire/release loads and stores are enough.
+ *
+ * set_node's answers can't reach the reader in time, so the storage
+ * thread handles them itself: a NODE_SKIP subtree's events are dropped
+ * as they arrive, and NODE_STOP is raised as a flag the reader checks on
+ * every push.
+ *
+ * Copyright (c) 2019-2024, Gary Allen Vollink.  http://voll.ink/playlister
+ * All rights reserved.
+ *
+ * Licence to use, see LICENSE file in this distribution.
+ */
+#define RING_C 1
+#include <stdio.h>
+#include <stdlib.h>      // malloc, realloc
+#include <string.h>      // memcpy, strerror
+#include <sched.h>       // sched_yield
+#include <pthread.h>     // pthread_create, pthread_join
+#include <sys/errno.h>   // errno
+#include "utils.h"
+#include "storage.h"
+#include "ring.h"
+
+#define RING_EVENTS  4096              // power of two
+#define RING_TEXT    ( 256 * 1024 )    // first arena size, grows if needed
+#define RING_SPIN    64                // polls before yielding the CPU
+#define RING_END     -1                // ntype of the last event
+#define RING_NOVALUE ( (size_t)-1 )
+
+struct ringevent {
+    int           depth;
+    int           ntype;
+    int           emptyel;
+    int           hasval;
+    size_t        name;     // arena offset
+    size_t        value;    // arena offset, or RING_NOVALUE
+    unsigned long tend;     // thead once this event's text is in
+};
+
+struct nodering {
+    pthread_t          thread;
+    struct ringevent  *ev;
+    char              *text;
+    size_t             textsz;
+    char               pad0[64];
+    // Reader side
+    unsigned long      head;        // events pushed
+    unsigned long      thead;       // arena bytes handed out
+    long               pushed;
+    long               fullwaits;   // pushes that had to wait for storage
+    long               maxused;     // most events queued at once
+    double             sumused;     // events queued, summed at each push
+    long               grown;       // arena reallocs
+    char               pad1[64];
+    // Storage side
+    unsigned long      tail;        // events done
+    unsigned long      ttail;       // arena bytes given back
+    int                stop;        // set_node said NODE_STOP
+    long               emptywaits;  // pops that had to wait for the reader
+    struct storagepart part;
+};
+
+
+/****************************************************************************
+ * Busy-wait a little, then let the other side have the CPU.
+ */
+static void
+_pause(int spin)
+{
+    if ( RING_SPIN > spin ) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+    else {
+        sched_yield();
+    }
+}
+
+
+static void *
+_storage_thread(void *arg)
+{
+    struct nodering  *ring = (struct nodering *)arg;
+    struct ringevent *ev   = NULL;
+    unsigned long     tail = 0;
+    int          skipdepth = -1;
+    int            stopped = 0;
+    int             action = NODE_NEXT;
+    int               spin = 0;
+
+    storageThreadInit(1.0);
+    for ( ;; ) {
+        for ( spin = 0
+            ; tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)
+            ; spin++ ) {
+            if ( 0 == spin ) {
+                ring->emptywaits++;
+            }
+            _pause(spin);
+        }
+        ev = &ring->ev[tail & ( RING_EVENTS - 1 )];
+        if ( RING_END == ev->ntype ) {
+            break;
+        }
+        if ( stopped ) {
+            ;   // Draining what the reader sent before it saw the flag.
+        }
+        else if ( 0 <= skipdepth ) {
+            // Inside a skipped subtree, up to and including its close.
+            if ( ( skipdepth == ev->depth ) && ( 15 == ev->ntype ) ) {
+                skipdepth = -1;
+            }
+        }
+        else {
+            action = set_node(ev->depth, ev->ntype, ring->text + ev->name
+                    , ev->emptyel, ev->hasval
+                    , ( RING_NOVALUE == ev->value )
+                        ? NULL : ring->text + ev->value );
+            if ( NODE_SKIP == action ) {
+                skipdepth = ev->depth;
+            }
+            else if ( NODE_STOP == action ) {
+                stopped = 1;
+                __atomic_store_n(&ring->stop, 1, __ATOMIC_RELEASE);
+            }
+        }
+        __atomic_store_n(&ring->ttail, ev->tend, __ATOMIC_RELEASE);
+        __atomic_store_n(&ring->tail, ++tail, __ATOMIC_RELEASE);
+    }
+    storageThreadDone(&ring->part);
+    return NULL;
+}
+
+
+/**
+ * function: ringStart
+ *
+ * Allocate a ring and start its storage thread.  NULL if either fails,
+ * the caller then calls set_node itself.
+ */
+struct nodering *
+ringStart(void)
+{
+    struct nodering *ring = calloc(1, sizeof(struct nodering));
+
+    if ( NULL == ring ) {
+        mywarning("ring: Unable to allocate %ld bytes: %s\n"
+                , sizeof(struct nodering), strerror(errno));
+        return NULL;
+    }
+    ring->ev     = malloc(RING_EVENTS * sizeof(struct ringevent));
+    ring->text   = malloc(RING_TEXT);
+    ring->textsz = RING_TEXT;
+    if ( ( NULL == ring->ev ) || ( NULL == ring->text ) ) {
+        mywarning("ring: Unable to allocate %ld bytes: %s\n"
+                , RING_EVENTS * sizeof(struct ringevent) + RING_TEXT
+                , strerror(errno));
+        free(ring->ev);
+        free(ring->text);
+        free(ring);
+        return NULL;
+    }
+    if ( pthread_create(&ring->thread, NULL, _storage_thread, ring) ) {
+        mywarning("ring: Unable to start storage thread: %s\n"
+                , strerror(errno));
+        free(ring->ev);
+        free(ring->text);
+        free(ring);
+        return NULL;
+    }
+    return ring;
+}
+
+
+/**
+ * function: ringPush
+ *
+ * Queue one node for set_node, waiting while the ring is full.
+ * Returns 1 once storage has said NODE_STOP, the reader may quit then.
+ */
+int
+ringPush(struct nodering *ring, int depth, int ntype
+        , const char *name, int emptyel, int hasval, const char *value)
+{
+    struct ringevent *ev = NULL;
+    size_t          nlen = strlen(name);
+    size_t          vlen = ( value ? strlen(value) : 0 );
+    size_t          need = nlen + 1 + ( value ? vlen + 1 : 0 );
+    size_t           pos = 0;
+    size_t           pad = 0;
+    unsigned long   tail = 0;
+    char           *grow = NULL;
+    int             spin = 0;
+
+    if ( need > ring->textsz ) {
+        // Only an empty ring can move its arena.
+        for ( spin = 0
+            ; ring->head != __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)
+            ; spin++ ) {
+            _pause(spin);
+        }
+        if ( NULL == ( grow = realloc(ring->text, need * 2) ) ) {
+            mydebug("ring: Unable to allocate %ld bytes of space: %s\n"
+                    , need * 2, strerror(errno));
+            exit(2);
+        }
+        ring->text   = grow;
+        ring->textsz = need * 2;
+        ring->grown++;
+    }
+
+    // Text is never split, a name or value that won't fit before the end
+    // of the arena starts over at 0 (pad is given back with the event).
+    pos = ring->thead % ring->textsz;
+    if ( pos + need > ring->textsz ) {
+        pad = ring->textsz - pos;
+    }
+    for ( spin = 0; ; spin++ ) {
+        tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        if (   ( RING_EVENTS > ( ring->head - tail ) )
+            && ( ring->textsz >= ( ring->thead + pad + need
+                    - __atomic_load_n(&ring->ttail, __ATOMIC_ACQUIRE) ) ) ) {
+            break;
+        }
+        if ( 0 == spin ) {
+            ring->fullwaits++;
+        }
+        _pause(spin);
+    }
+    if ( pad ) {
+        ring->thead += pad;
+        pos = 0;
+    }
+
+    ev = &ring->ev[ring->head & ( RING_EVENTS - 1 )];
+    ev->depth   = depth;
+    ev->ntype   = ntype;
+    ev->emptyel = emptyel;
+    ev->hasval  = hasval;
+    ev->name    = pos;
+    memcpy(ring->text + pos, name, nlen + 1);
+    ev->value   = RING_NOVALUE;
+    if ( value ) {
+        ev->value = pos + nlen + 1;
+        memcpy(ring->text + ev->value, value, vlen + 1);
+    }
+    ring->thead += need;
+    ev->tend     = ring->thead;
+
+    ring->pushed++;
+    if ( ring->maxused < (long)( ring->head - tail + 1 ) ) {
+        ring->maxused = (long)( ring->head - tail + 1 );
+    }
+    ring->sumused += (double)( ring->head - tail + 1 );
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+
+    return __atomic_load_n(&ring->stop, __ATOMIC_ACQUIRE);
+}
+
+
+/**
+ * function: ringFinish
+ * filename: for the counters report
+ *
+ * Tell storage there is no more, wait for it, take over what it stored,
+ * and free the ring.
+ */
+void
+ringFinish(struct nodering *ring, const char *filename)
+{
+    ringPush(ring, 0, RING_END, "", 0, 0, NULL);
+    pthread_join(ring->thread, NULL);
+    storageMerge(&ring->part);
+
+    mydebug("%s : pipeline %ld events, queue max %ld avg %.1f of %d\n"
+            , filename, ring->pushed - 1, ring->maxused
+            , ( ring->pushed ? ring->sumused / ring->pushed : 0.0 )
+            , RING_EVENTS);
+    mydebug("%s : pipeline reader waited %ld times, storage waited %ld times"
+            ", text arena %ld bytes (grown %ld)\n"
+            , filename, ring->fullwaits, ring->emptywaits
+            , (long)ring->textsz, ring->grown);
+
+    free(ring->ev);
+    free(ring->text);
+    free(ring);
+}
+
+/**
+ * vim: sw=4 ts=4 expandtab
+ * EOF: ring.c
+ */
@@ -0,0 +1,28 @@
+/****************************************************************************
+ * File: ring.h
+ *
+ * Single producer, single consumer node event ring (ring.c), between
+ * a reader thread and a storage thread.
+ *
+ * Copyright (c) 2019-2024, Gary Allen Vollink.  http://voll.ink/playlister
+ * All rights reserved.
+ *
+ * Licence to use, see LICENSE file in this distribution.
+ */
+#ifndef RING_H
+#define RING_H 1
+#include <stddef.h>
+
+struct nodering;
+
+struct nodering * ringStart (void);
+int               ringPush  (struct nodering *ring, int depth, int ntype
+                                , const char *name, int emptyel, int hasval
+                                , const char *value);
+void              ringFinish(struct nodering *ring, const char *filename);
+
+#endif /* RING_H */
+/**
+ * vim: sw=4 ts=4 expandtab
+ * EOF: ring.h
+ */
@@ -0,0 +1,602 @@
+/****************************************************************************
+ * source.c
+ *
+ * Input sources for the XML readers: a file or stdin ("-"), optionally
+ * gzip or zstd compressed (detected by magic number, not by extension).
+ * A binary plist (bplist00) is read as-is and handed to reader3.c, a
+ * Music.app database (hfma) to reader4.c.
+ *
+ * Raw reads happen on a read-ahead thread that fills two buffers in
+ * turn, so waiting on a slow disk (or NFS) overlaps tokenizing.
+ *
+ * Copyright (c) 2019-2024, Gary Allen Vollink.  http://voll.ink/playlister
+ * All rights reserved.
+ *
+ * Licence to use, see LICENSE file in this distribution.
+ */
+#define SOURCE_C 1
+#include <stdio.h>
+#include <stdlib.h>      // malloc, realloc
+#include <string.h>      // memcpy, memcmp, strerror
+#include <fcntl.h>       // open, posix_fadvise
+#include <unistd.h>      // read, close
+#include <pthread.h>
+#include <sys/errno.h>   // errno
+#include "utils.h"
+#include "source.h"
+#if 1 == HAS_ZLIB        /* DEFINED (or not) in configure.h */
+#include <zlib.h>
+#endif
+#if 1 == HAS_ZSTD        /* DEFINED (or not) in configure.h */
+#include <zstd.h>
+#endif
+
+#define SOURCE_CHUNK (1024 * 1024)
+
+struct source {
+    const char     *name;
+    int             fd;
+    int             isstdin;
+    int             kind;
+    /* Read-ahead, buf[] is filled by the thread, drained by sourceRead */
+    int             threaded;
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    char           *buf[2];
+    size_t          fill[2];
+    int             ready[2];
+    int             done;       // producer hit EOF (or error)
+    int             err;
+    int             stop;       // consumer is closing early
+    int             cur;        // buffer the consumer holds, -1 if none
+    int             next;       // buffer the consumer takes next
+    const char     *in;         // unread part of buf[cur]
+    size_t          inlen;
+    char            peek[16];   // sourcePeek() bytes, sourceRead gives back
+    int             peeklen;
+    int             peekpos;
+    /* Counters for -v -v */
+    long long       rawbytes;
+    long long       outbytes;
+    long            stalls;     // consumer waited on the disk
+#if 1 == HAS_ZLIB
+    z_stream        zs;
+#endif
+#if 1 == HAS_ZSTD
+    ZSTD_DStream   *zds;
+#endif
+};
+
+
+static ssize_t
+_fill(struct source *src, char *buf)
+{
+    ssize_t got   = 0;
+    ssize_t total = 0;
+
+    while ( SOURCE_CHUNK > total ) {
+        got = read(src->fd, buf + total, SOURCE_CHUNK - total);
+        if ( 0 > got ) {
+            if ( EINTR == errno ) {
+                continue;
+            }
+            return -1;
+        }
+        if ( 0 == got ) {
+            break;
+        }
+        total += got;
+    }
+    return total;
+}
+
+
+static void *
+_readahead(void *arg)
+{
+    struct source *src = (struct source *)arg;
+    int            idx = 0;
+    ssize_t        got = 0;
+
+    while ( 1 ) {
+        pthread_mutex_lock(&src->lock);
+        while ( ( src->ready[idx] ) || ( src->cur == idx ) ) {
+            if ( src->stop ) {
+                break;
+            }
+            pthread_cond_wait(&src->cond, &src->lock);
+        }
+        if ( src->stop ) {
+            pthread_mutex_unlock(&src->lock);
+            break;
+        }
+        pthread_mutex_unlock(&src->lock);
+
+        got = _fill(src, src->buf[idx]);
+
+        pthread_mutex_lock(&src->lock);
+        if ( 0 > got ) {
+            src->err  = errno;
+            src->done = 1;
+        }
+        else {
+            src->fill[idx]  = got;
+            src->ready[idx] = 1;
+            src->rawbytes  += got;
+            if ( SOURCE_CHUNK > got ) {
+                src->done = 1;
+            }
+        }
+        pthread_cond_broadcast(&src->cond);
+        pthread_mutex_unlock(&src->lock);
+        if ( src->done ) {
+            break;
+        }
+        idx = !idx;
+    }
+    return NULL;
+}
+
+
+/****************************************************************************
+ * Hand the consumer the next raw chunk in src->in / src->inlen.
+ * Returns 1 with data, 0 at end of input, -1 on a read error.
+ */
+static int
+_next_chunk(struct source *src)
+{
+    ssize_t got = 0;
+
+    if ( ! src->threaded ) {
+        if ( src->done ) {
+            return 0;
+        }
+        got = _fill(src, src->buf[0]);
+        if ( 0 > got ) {
+            src->err = errno;
+            return -1;
+        }
+        src->rawbytes += got;
+        if ( SOURCE_CHUNK > got ) {
+            src->done = 1;
+        }
+        src->in    = src->buf[0];
+        src->inlen = got;
+        return ( got ? 1 : 0 );
+    }
+
+    pthread_mutex_lock(&src->lock);
+    if ( 0 <= src->cur ) {
+        // Give the drained buffer back to the read-ahead thread.
+        src->ready[src->cur] = 0;
+        src->cur = -1;
+        pthread_cond_broadcast(&src->cond);
+    }
+    if ( ( ! src->ready[src->next] ) && ( ! src->done ) ) {
+        src->stalls++;
+    }
+    while ( ( ! src->ready[src->next] ) && ( ! src->done ) ) {
+        pthread_cond_wait(&src->cond, &src->lock);
+    }
+    if ( ! src->ready[src->next] ) {
+        pthread_mutex_unlock(&src->lock);
+        return ( src->err ? -1 : 0 );
+    }
+    src->cur   = src->next;
+    src->next  = !src->next;
+    src->in    = src->buf[src->cur];
+    src->inlen = src->fill[src->cur];
+    pthread_mutex_unlock(&src->lock);
+    return ( src->inlen ? 1 : 0 );
+}
+
+
+/****************************************************************************
+ * Uncompressed input, straight out of the read-ahead buffers.
+ */
+static int
+_read_plain(struct source *src, char *buf, int len)
+{
+    int ret = 0;
+    int cpy = 0;
+
+    while ( len > ret ) {
+        if ( 0 == src->inlen ) {
+            int more = _next_chunk(src);
+            if ( 0 > more ) {
+                return -1;
+            }
+            if ( 0 == more ) {
+                break;
+            }
+        }
+        cpy = ( (size_t)( len - ret ) < src->inlen )
+            ? ( len - ret ) : (int)src->inlen;
+        memcpy(buf + ret, src->in, cpy);
+        src->in    += cpy;
+        src->inlen -= cpy;
+        ret        += cpy;
+    }
+    return ret;
+}
+
+
+#if 1 == HAS_ZLIB
+static int
+_read_gzip(struct source *src, char *buf, int len)
+{
+    int zret = Z_OK;
+
+    src->zs.next_out  = (Bytef *)buf;
+    src->zs.avail_out = len;
+
+    while ( src->zs.avail_out ) {
+        if ( 0 == src->inlen ) {
+            int more = _next_chunk(src);
+            if ( 0 > more ) {
+                return -1;
+            }
+            if ( 0 == more ) {
+                break;
+            }
+        }
+        src->zs.next_in  = (Bytef *)src->in;
+        src->zs.avail_in = src->inlen;
+        zret = inflate(&src->zs, Z_NO_FLUSH);
+        src->in    = (const char *)src->zs.next_in;
+        src->inlen = src->zs.avail_in;
+        if ( Z_STREAM_END == zret ) {
+            // Concatenated gzip members are legal, keep going.
+            inflateReset(&src->zs);
+        }
+        else if ( ( Z_OK != zret ) && ( Z_BUF_ERROR != zret ) ) {
+            mywarning("%s : gzip: %s\n", src->name
+                    , ( src->zs.msg ? src->zs.msg : "inflate failed" ) );
+            return -1;
+        }
+    }
+    return ( len - src->zs.avail_out );
+}
+#endif /* HAS_ZLIB */
+
+
+#if 1 == HAS_ZSTD
+static int
+_read_zstd(struct source *src, char *buf, int len)
+{
+    ZSTD_outBuffer out = { buf, len, 0 };
+    ZSTD_inBuffer   in = { NULL, 0, 0 };
+    size_t        zret = 0;
+
+    while ( out.pos < out.size ) {
+        if ( 0 == src->inlen ) {
+            int more = _next_chunk(src);
+            if ( 0 > more ) {
+                return -1;
+            }
+            if ( 0 == more ) {
+                break;
+            }
+        }
+        in.src  = src->in;
+        in.size = src->inlen;
+        in.pos  = 0;
+        zret = ZSTD_decompressStream(src->zds, &out, &in);
+        src->in    += in.pos;
+        src->inlen -= in.pos;
+        if ( ZSTD_isError(zret) ) {
+            mywarning("%s : zstd: %s\n", src->name
+                    , ZSTD_getErrorName(zret));
+            return -1;
+        }
+    }
+    return out.pos;
+}
+#endif /* HAS_ZSTD */
+
+
+/**
+ * function: sourceOpen
+ * filename: path, or "-" for stdin
+ *
+ * Returns NULL (after a warning) if the input can't be read.
+ */
+struct source *
+sourceOpen(const char *filename)
+{
+    struct source *src = NULL;
+    const unsigned char *magic = NULL;
+
+    if ( NULL == ( src = malloc(sizeof(struct source)) ) ) {
+        mywarning("sourceOpen: Unable to allocate %ld bytes: %s\n"
+                , sizeof(struct source), strerror(errno));
+        return NULL;
+    }
+    memset(src, 0, sizeof(struct source));
+    src->name = filename;
+    src->cur  = -1;
+
+    if ( 0 == str_diffn("-", filename, 2) ) {
+        src->fd      = 0;
+        src->isstdin = 1;
+    }
+    else if ( 0 > ( src->fd = open(filename, O_RDONLY) ) ) {
+        mywarning("Unable to open file [%s]: %s\n"
+                , filename, strerror(errno));
+        free(src);
+        return NULL;
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    if ( ! src->isstdin ) {
+        posix_fadvise(src->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+#endif
+
+    src->buf[0] = malloc(SOURCE_CHUNK);
+    src->buf[1] = malloc(SOURCE_CHUNK);
+    if ( ( NULL == src->buf[0] ) || ( NULL == src->buf[1] ) ) {
+        mywarning("sourceOpen: Unable to allocate read buffers: %s\n"
+                , strerror(errno));
+        sourceClose(src);
+        return NULL;
+    }
+
+    pthread_mutex_init(&src->lock, NULL);
+    pthread_cond_init(&src->cond, NULL);
+    if ( 0 == pthread_create(&src->thread, NULL, _readahead, src) ) {
+        src->threaded = 1;
+    }
+    else {
+        extradebug("sourceOpen: no read-ahead thread, reading inline\n");
+    }
+
+    // Sniff the first chunk for a compression magic number.
+    if ( 0 > _next_chunk(src) ) {
+        mywarning("Unable to read [%s]: %s\n", filename, strerror(src->err));
+        sourceClose(src);
+        return NULL;
+    }
+    magic = (const unsigned char *)src->in;
+    if (   ( 2 <= src->inlen )
+        && ( 0x1f == magic[0] ) && ( 0x8b == magic[1] ) ) {
+        src->kind = SOURCE_GZIP;
+    }
+    else if ( ( 4 <= src->inlen )
+        && ( 0x28 == magic[0] ) && ( 0xb5 == magic[1] )
+        && ( 0x2f == magic[2] ) && ( 0xfd == magic[3] ) ) {
+        src->kind = SOURCE_ZSTD;
+    }
+    else if ( ( 8 <= src->inlen ) && ( 0 == memcmp(magic, "bplist00", 8) ) ) {
+        src->kind = SOURCE_BPLIST;
+    }
+    else if ( ( 4 <= src->inlen ) && ( 0 == memcmp(magic, "hfma", 4) ) ) {
+        src->kind = SOURCE_MUSICDB;
+    }
+
+    if ( SOURCE_GZIP == src->kind ) {
+#if 1 == HAS_ZLIB
+        // 15 + 32, zlib window with automatic gzip header detection
+        if ( Z_OK != inflateInit2(&src->zs, 15 + 32) ) {
+            mywarning("%s : gzip: unable to initialize\n", filename);
+            sourceClose(src);
+            return NULL;
+        }
+#else
+        mywarning("%s is gzip compressed, %s\n", filename
+                , "playlister was built without HAS_ZLIB (see configure.h)");
+        sourceClose(src);
+        return NULL;
+#endif /* HAS_ZLIB */
+    }
+    else if ( SOURCE_ZSTD == src->kind ) {
+#if 1 == HAS_ZSTD
+        if (   ( NULL == ( src->zds = ZSTD_createDStream() ) )
+            || ( ZSTD_isError(ZSTD_initDStream(src->zds)) ) ) {
+            mywarning("%s : zstd: unable to initialize\n", filename);
+            sourceClose(src);
+            return NULL;
+        }
+#else
+        mywarning("%s is zstd compressed, %s\n", filename
+                , "playlister was built without HAS_ZSTD (see configure.h)");
+        sourceClose(src);
+        return NULL;
+#endif /* HAS_ZSTD */
+    }
+
+    extradebug("sourceOpen: %s, %s%s\n", filename
+            , ( SOURCE_GZIP == src->kind ? "gzip"
+                : ( SOURCE_ZSTD == src->kind ? "zstd"
+                : ( SOURCE_BPLIST == src->kind ? "binary plist"
+                : ( SOURCE_MUSICDB == src->kind ? "Music.app database"
+                : "plain" ) ) ) )
+            , ( src->threaded ? ", read-ahead" : "" ) );
+    return src;
+}
+
+
+int
+sourceKind(struct source *src)
+{
+    return src->kind;
+}
+
+
+int
+sourceIsStdin(struct source *src)
+{
+    return src->isstdin;
+}
+
+
+/****************************************************************************
+ * Read up to len bytes of (decompressed) XML into buf.
+ * Same contract as an xmlInputReadCallback: bytes read, 0 at end, -1 error.
+ */
+int
+sourceRead(struct source *src, char *buf, int len)
+{
+    int ret = -1;
+
+    if ( ( src->peekpos < src->peeklen ) && ( 0 < len ) ) {
+        ret = src->peeklen - src->peekpos;
+        if ( ret > len ) {
+            ret = len;
+        }
+        memcpy(buf, src->peek + src->peekpos, ret);
+        src->peekpos += ret;
+        return ret;     // already counted in outbytes
+    }
+    switch ( src->kind ) {
+        case SOURCE_PLAIN:
+        case SOURCE_BPLIST:
+        case SOURCE_MUSICDB:
+            ret = _read_plain(src, buf, len);
+            break;
+#if 1 == HAS_ZLIB
+        case SOURCE_GZIP:
+            ret = _read_gzip(src, buf, len);
+            break;
+#endif /* HAS_ZLIB */
+#if 1 == HAS_ZSTD
+        case SOURCE_ZSTD:
+            ret = _read_zstd(src, buf, len);
+            break;
+#endif /* HAS_ZSTD */
+    }
+    if ( 0 < ret ) {
+        src->outbytes += ret;
+    }
+    return ret;
+}
+
+
+/****************************************************************************
+ * Look at the first len (up to 16) bytes of (decompressed) input without
+ * using them up, the next sourceRead starts with them again.  Only before
+ * the first sourceRead.  Returns the bytes available, short at EOF.
+ */
+int
+sourcePeek(struct source *src, char *buf, int len)
+{
+    int got = 0;
+
+    if ( ( (int)sizeof(src->peek) < len ) || ( src->peeklen ) ) {
+        return -1;
+    }
+    src->peekpos = sizeof(src->peek);   // sourceRead: nothing to give back
+    while ( src->peeklen < len ) {
+        got = sourceRead(src, src->peek + src->peeklen, len - src->peeklen);
+        if ( 0 > got ) {
+            return -1;
+        }
+        if ( 0 == got ) {
+            break;
+        }
+        src->peeklen += got;
+    }
+    src->peekpos = 0;
+    memcpy(buf, src->peek, src->peeklen);
+    return src->peeklen;
+}
+
+
+/****************************************************************************
+ * Read everything that is left into one malloc()ed buffer (NUL terminated,
+ * not counted in *len).  For parsers that need the whole document at once.
+ */
+char *
+sourceSlurp(struct source *src, size_t *len)
+{
+    char  *buf  = NULL;
+    char  *grow = NULL;
+    size_t size = SOURCE_CHUNK * 4;
+    size_t used = 0;
+    int     got = 0;
+
+    if ( NULL == ( buf = malloc(size) ) ) {
+        mywarning("sourceSlurp: Unable to allocate %ld bytes: %s\n"
+                , size, strerror(errno));
+        return NULL;
+    }
+    while ( 0 < ( got = sourceRead(src, buf + used, size - used - 1) ) ) {
+        used += got;
+        if ( SOURCE_CHUNK > ( size - used ) ) {
+            size *= 2;
+            if ( NULL == ( grow = realloc(buf, size) ) ) {
+                mywarning("sourceSlurp: Unable to allocate %ld bytes: %s\n"
+                        , size, strerror(errno));
+                free(buf);
+                return NULL;
+            }
+            buf = grow;
+        }
+    }
+    if ( 0 > got ) {
+        free(buf);
+        return NULL;
+    }
+    buf[used] = '\0';
+    *len = used;
+    return buf;
+}
+
+
+/****************************************************************************
+ * Refuse a Music.app database (SOURCE_MUSICDB) that reader4.c can not
+ * read, and say what to read instead.
+ */
+void
+sourceMusicdb(const char *filename)
+{
+    myerror("%s is a Music.app database that is encrypted or cut short,\n"
+            "         which playlister can not read.\n"
+            "         Export the library as XML (File > Library > Export"
+            " Library...),\n"
+            "         then point --xml (or itunesxml =) at the exported"
+            " .xml file.\n", filename);
+}
+
+
+void
+sourceClose(struct source *src)
+{
+    if ( NULL == src ) {
+        return;
+    }
+    if ( src->threaded ) {
+        pthread_mutex_lock(&src->lock);
+        src->stop = 1;
+        pthread_cond_broadcast(&src->cond);
+        pthread_mutex_unlock(&src->lock);
+        pthread_join(src->thread, NULL);
+    }
+    if ( src->buf[0] ) {
+        pthread_mutex_destroy(&src->lock);
+        pthread_cond_destroy(&src->cond);
+    }
+    extradebug("sourceClose: %s, %lld bytes read, %lld bytes out, %ld stalls\n"
+            , src->name, src->rawbytes, src->outbytes, src->stalls);
+#if 1 == HAS_ZLIB
+    if ( SOURCE_GZIP == src->kind ) {
+        inflateEnd(&src->zs);
+    }
+#endif /* HAS_ZLIB */
+#if 1 == HAS_ZSTD
+    if ( src->zds ) {
+        ZSTD_freeDStream(src->zds);
+    }
+#endif /* HAS_ZSTD */
+    if ( ( ! src->isstdin ) && ( 0 <= src->fd ) ) {
+        close(src->fd);
+    }
+    free(src->buf[0]);
+    free(src->buf[1]);
+    free(src);
+}
+
+/**
+ * vim: sw=4 ts=4 expandtab
+ * EOF: source.c
+ */
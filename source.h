@@ -0,0 +1,38 @@
+/****************************************************************************
+ * File: source.h
+ *
+ * source.c, reader1.c
+ *
+ * Copyright (c) 2019-2024, Gary Allen Vollink.  http://voll.ink/playlister
+ * All rights reserved.
+ *
+ * Licence to use, see LICENSE file in this distribution.
+ */
+#ifndef SOURCE_H
+#define SOURCE_H 1
+#include "utils.h"
+
+enum sourceKind {
+    SOURCE_PLAIN,   // uncompressed XML
+    SOURCE_GZIP,    // .xml.gz (needs HAS_ZLIB)
+    SOURCE_ZSTD,    // .xml.zst (needs HAS_ZSTD)
+    SOURCE_BPLIST,  // uncompressed binary plist, see reader3.c
+    SOURCE_MUSICDB  // Music.app Library.musicdb, see reader4.c
+};
+
+struct source;
+
+struct source * sourceOpen   (const char *filename);
+int             sourceKind   (struct source *src);
+int             sourceIsStdin(struct source *src);
+int             sourceRead   (struct source *src, char *buf, int len);
+int             sourcePeek   (struct source *src, char *buf, int len);
+char          * sourceSlurp  (struct source *src, size_t *len);
+void            sourceClose  (struct source *src);
+void            sourceMusicdb(const char *filename);
+
+#endif /* SOURCE_H */
+/**
+vim: sw=4 ts=4 expandtab
+ * EOF: source.h
+ */
@@ -0,0 +1,434 @@
+/****************************************************************************
+ * File: stamp.c
+ *
+ * Skip a run whose inputs have not changed, and never start parsing an
+ * XML that is still being copied.
+ *
+ * The stamp is a short text file in the first device's output directory,
+ * named for a hash of every device's effective settings.  It lists each
+ * XML's size, mtime and a hash of its first and last 64 KB, and is only
+ * written after a run that read every XML.  When --skip-unchanged finds
+ * the same text there, nothing is read and nothing is written.
+ *
+ * The pre-flight check is the same probe: a plain XML must end with
+ * </plist>, and with settle = N its size and mtime must hold still for N
+ * seconds.  Both are retried a few times before giving up.  A Music.app
+ * database reader4.c can not read (encrypted, or cut short) is refused
+ * straight away.
+ *
+ * Copyright (c) 2019-2024, Gary Allen Vollink.  http://voll.ink/playlister
+ * All rights reserved.
+ *
+ * Licence to use, see LICENSE file in this distribution.
+ */
+#define STAMP_C 1
+#include <stdio.h>
+#include <stdlib.h>      // malloc
+#include <stdint.h>      // uint64_t
+#include <string.h>      // memcmp, strerror
+#include <strings.h>     // strcasecmp
+#include <fcntl.h>       // open
+#include <unistd.h>      // pread, close, sleep, unlink, getpid
+#include <sys/stat.h>    // fstat
+#include <sys/errno.h>   // errno
+#include "utils.h"
+#include "strkern.h"
+#include "options.h"
+#include "stamp.h"
+#include "source.h"      // sourceMusicdb
+#include "reader4.h"     // musicdbHeader
+
+#define STAMP_PROBE 65536     // bytes hashed at each end of the XML
+#define STAMP_TRIES 5         // settle waits before giving up
+#define STAMP_MAX   65536     // a stamp file is never bigger
+
+static char stamp_probe[2 * STAMP_PROBE];
+
+
+/****************************************************************************
+ * File size a bplist00 trailer (its last 32 bytes) describes.
+ */
+static uint64_t
+_bplist_end(const char *trailer)
+{
+    const unsigned char *t = (const unsigned char *)trailer;
+    uint64_t nobj = 0;
+    uint64_t offt = 0;
+
+    for ( int cx = 0; cx < 8; cx++ ) {
+        nobj = ( nobj << 8 ) | t[8 + cx];
+        offt = ( offt << 8 ) | t[24 + cx];
+    }
+    return offt + ( nobj * t[6] ) + 32;
+}
+
+
+/****************************************************************************
+ * stat, then hash the first and last STAMP_PROBE bytes of the file.
+ * complete is 1 if it is compressed (nothing to check cheaply), ends
+ * with </plist> (give or take trailing blanks), is a binary plist
+ * whose trailer accounts for the whole file, or is a Music.app database
+ * reader4.c can read.
+ */
+static int
+_probe(const char *filename, struct stat *statbuf, uint64_t *hash
+        , int *complete)
+{
+    size_t  want = 0;
+    ssize_t hlen = 0;
+    ssize_t tlen = 0;
+    const char *end = NULL;
+    int       fd = -1;
+
+    if ( 0 > ( fd = open(filename, O_RDONLY) ) ) {
+        return -1;
+    }
+    if ( ( fstat(fd, statbuf) ) || ( ! S_ISREG(statbuf->st_mode) ) ) {
+        close(fd);
+        return -1;
+    }
+    want = ( STAMP_PROBE < statbuf->st_size )
+            ? STAMP_PROBE : (size_t)statbuf->st_size;
+    hlen = pread(fd, stamp_probe, want, 0);
+    tlen = pread(fd, stamp_probe + want, want, statbuf->st_size - want);
+    close(fd);
+    if ( ( (ssize_t)want != hlen ) || ( (ssize_t)want != tlen ) ) {
+        return -1;
+    }
+    *hash = strkHash(stamp_probe, hlen + tlen);
+
+    *complete = 1;
+    if (   ( 2 <= want )
+        && ( ( 0 == memcmp(stamp_probe, "\x1F\x8B", 2) )
+          || ( ( 4 <= want )
+            && ( 0 == memcmp(stamp_probe, "\x28\xB5\x2F\xFD", 4) ) ) ) ) {
+        return 0;   // gzip or zstd
+    }
+    if ( ( 4 <= want ) && ( 0 == memcmp(stamp_probe, MUSICDB_MAGIC, 4) ) ) {
+        *complete = ( 0 != musicdbHeader(stamp_probe, want
+                    , statbuf->st_size) );
+        return 0;
+    }
+    if ( ( 8 <= want ) && ( 0 == memcmp(stamp_probe, "bplist00", 8) ) ) {
+        // Whole when the offset table ends where the trailer starts.
+        if (   ( 32 > tlen )
+            || ( _bplist_end(stamp_probe + want + tlen - 32)
+                    != (uint64_t)statbuf->st_size ) ) {
+            *complete = 0;
+        }
+        return 0;
+    }
+    end = stamp_probe + want + tlen;
+    while ( ( end > stamp_probe + want ) && ( 0x20 >= end[-1] ) ) {
+        end--;
+    }
+    if (   ( 8 > ( end - ( stamp_probe + want ) ) )
+        || ( memcmp(end - 8, "</plist>", 8) ) ) {
+        *complete = 0;
+    }
+    return 0;
+}
+
+
+/****************************************************************************
+ * A Music.app database, by its hfma header (in stamp_probe, see _probe),
+ * or one too short to have a header that is still named .musicdb.
+ * Only asked about a file _probe did not find complete.
+ */
+static int
+_musicdb(const char *filename, off_t size)
+{
+    size_t len = strlen(filename);
+
+    if ( 4 <= size ) {
+        return ( 0 == memcmp(stamp_probe, "hfma", 4) );
+    }
+    return (   ( 8 <= len )
+            && ( 0 == strcasecmp(filename + len - 8, ".musicdb") ) );
+}
+
+
+/**
+ * function: xmlPreflight
+ * dev: the device configuration about to read its XML
+ *
+ * Returns 0 if the XML looks whole (and, with settle, is not growing),
+ * -1 (after an error message) if it should not be parsed at all.
+ */
+int
+xmlPreflight(struct options *dev)
+{
+    const char *filename = dev->itunes_xml_file;
+    struct stat before, after;
+    uint64_t    hash = 0;
+    int     complete = 0;
+    int        tries = 0;
+
+    if ( 0 == str_diffn(filename, "-", 2) ) {
+        return 0;
+    }
+    for ( tries = 0; tries <= STAMP_TRIES; tries++ ) {
+        if ( _probe(filename, &before, &hash, &complete) ) {
+            myerror("Unable to read %s: %s\n", filename, strerror(errno));
+            return -1;
+        }
+        if ( ( ! complete ) && ( _musicdb(filename, before.st_size) ) ) {
+            sourceMusicdb(filename);
+            return -1;
+        }
+        if ( 0 == dev->settle ) {
+            break;
+        }
+        if ( complete ) {
+            mydebug("%s : waiting %d seconds for it to settle\n"
+                    , filename, dev->settle);
+        }
+        else {
+            mydebug("%s : does not end with </plist>, waiting %d seconds\n"
+                    , filename, dev->settle);
+        }
+        sleep(dev->settle);
+        if ( _probe(filename, &after, &hash, &complete) ) {
+            myerror("Unable to read %s: %s\n", filename, strerror(errno));
+            return -1;
+        }
+        if (   ( complete )
+            && ( before.st_size  == after.st_size )
+            && ( before.st_mtime == after.st_mtime ) ) {
+            return 0;
+        }
+    }
+    if ( ! complete ) {
+        myerror("%s : does not end with </plist> (or is a short binary"
+                " plist), not parsing it\n", filename);
+        return -1;
+    }
+    if ( dev->settle ) {
+        myerror("%s : still changing after %d tries, not parsing it\n"
+                , filename, STAMP_TRIES + 1);
+        return -1;
+    }
+    return 0;
+}
+
+
+/**
+ * function: stampConfig
+ *
+ * Hash of every setting that changes what gets written, for every device.
+ * cache.c keeps it too, so --incremental knows whether an unchanged list
+ * would still be written the same way.
+ */
+uint64_t
+stampConfig()
+{
+    uint64_t h = strkHash(Opts.dist_version, strlen(Opts.dist_version));
+    char   num[64];
+
+#define STAMP_FOLD(s) ( h = ( h * 31 ) + strkHash((s), strlen(s)) )
+    for ( struct options *dev = (struct options *) utarray_front(Devices)
+        ; dev != NULL
+        ; dev = (struct options *) utarray_next(Devices, dev)
+        ) {
+        STAMP_FOLD(dev->config);
+        STAMP_FOLD(dev->itunes_xml_file);
+        STAMP_FOLD(dev->itune_path);
+        STAMP_FOLD(dev->replace_path);
+        STAMP_FOLD(dev->verify_path);
+        STAMP_FOLD(dev->output_path);
+        STAMP_FOLD(dev->extension);
+        snprintf(num, sizeof(num), "%d %d %d"
+                , dev->randomize, dev->verify, dev->m3uextended);
+        STAMP_FOLD(num);
+        for ( struct listopts * lo
+                = (struct listopts *) utarray_front(dev->playlist)
+            ; lo != NULL
+            ; lo = (struct listopts *) utarray_next(dev->playlist, lo)
+            ) {
+            STAMP_FOLD(lo->name);
+            STAMP_FOLD(lo->extension);
+            if ( lo->compose[0] ) {
+                STAMP_FOLD(lo->compose);
+            }
+            snprintf(num, sizeof(num), "%d %d", lo->randomize, lo->m3uextended);
+            STAMP_FOLD(num);
+        }
+    }
+#undef STAMP_FOLD
+    return h;
+}
+
+
+/****************************************************************************
+ * The run is skipped, or not, as a whole: skip_unchanged from any device
+ * (or the command line, which reaches every device) turns it on.
+ */
+static int
+_skip_wanted()
+{
+    for ( struct options *dev = (struct options *) utarray_front(Devices)
+        ; dev != NULL
+        ; dev = (struct options *) utarray_next(Devices, dev)
+        ) {
+        if ( dev->skip_unchanged ) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+/****************************************************************************
+ * Build the stamp path and the text this run would write there.  There is
+ * one stamp per run, not per device; it goes in the first device's output
+ * directory, whatever the others write to.
+ * Returns the text length, 0 if there is no stamp to be had (stdin, an
+ * XML that can't be read).
+ */
+static size_t
+_stamp(char *path, size_t pathsz, char *text, size_t textsz)
+{
+    struct stat statbuf;
+    uint64_t    cfg = stampConfig();
+    uint64_t    hash = 0;
+    size_t      len = 0;
+    int         complete = 0;
+    struct options *dev, *other;
+    const char *dir = NULL;
+
+    dev = (struct options *) utarray_front(Devices);
+    dir = ( strlen(dev->output_path) ? dev->output_path : "." );
+
+    snprintf(path, pathsz, "%s%s.playlister-%016llx.stamp"
+            , dir, ( '/' == dir[strlen(dir) - 1] ? "" : "/" )
+            , (unsigned long long)cfg);
+    len = snprintf(text, textsz, "playlister stamp 1 %016llx\n"
+            , (unsigned long long)cfg);
+
+    for ( dev = (struct options *) utarray_front(Devices)
+        ; dev != NULL
+        ; dev = (struct options *) utarray_next(Devices, dev)
+        ) {
+        // Each XML once, in the order they are read.
+        for ( other = (struct options *) utarray_front(Devices)
+            ; other != dev
+            ; other = (struct options *) utarray_next(Devices, other) ) {
+            if ( 0 == str_diffn(other->itunes_xml_file
+                        , dev->itunes_xml_file, 1025) ) {
+                break;
+            }
+        }
+        if ( other != dev ) {
+            continue;
+        }
+        if (   ( 0 == str_diffn(dev->itunes_xml_file, "-", 2) )
+            || ( _probe(dev->itunes_xml_file, &statbuf, &hash, &complete) ) ) {
+            return 0;
+        }
+        len += snprintf(text + len, textsz - len, "%lld %lld %016llx %s\n"
+                , (long long)statbuf.st_size, (long long)statbuf.st_mtime
+                , (unsigned long long)hash, dev->itunes_xml_file);
+        if ( len >= textsz ) {
+            return 0;
+        }
+    }
+    return len;
+}
+
+
+/**
+ * function: stampUnchanged
+ *
+ * With --skip-unchanged, 1 if the last complete run had the same settings
+ * and the same XML file(s), so there is nothing to do.
+ */
+int
+stampUnchanged()
+{
+    char   path[2100];
+    char  *want = NULL;
+    char  *have = NULL;
+    size_t wlen = 0;
+    size_t hlen = 0;
+    int     ret = 0;
+    FILE   *in  = NULL;
+
+    if ( ! _skip_wanted() ) {
+        return 0;
+    }
+    want = malloc(STAMP_MAX);
+    have = malloc(STAMP_MAX);
+    if ( ( NULL == want ) || ( NULL == have ) ) {
+        mydebug("stamp:Unable to allocate %d bytes of space: %s\n"
+                , STAMP_MAX, strerror(errno));
+        exit(2);
+    }
+    if ( ( wlen = _stamp(path, sizeof(path), want, STAMP_MAX) ) ) {
+        if ( NULL != ( in = fopen(path, "r") ) ) {
+            hlen = fread(have, 1, STAMP_MAX, in);
+            fclose(in);
+            ret = ( ( hlen == wlen ) && ( 0 == memcmp(have, want, wlen) ) );
+        }
+        mydebug("stamp: %s %s\n", path
+                , ( ret ? "matches, nothing to do"
+                    : ( in ? "differs" : "not found" ) ));
+    }
+    free(want);
+    free(have);
+    return ret;
+}
+
+
+/**
+ * function: stampSave
+ *
+ * With --skip-unchanged, record this (complete) run for the next one.
+ */
+void
+stampSave()
+{
+    char   path[2100];
+    char   temp[2200];
+    char  *text = NULL;
+    size_t len  = 0;
+    FILE  *out  = NULL;
+
+    if ( ! _skip_wanted() ) {
+        return;
+    }
+    if ( NULL == ( text = malloc(STAMP_MAX) ) ) {
+        mydebug("stamp:Unable to allocate %d bytes of space: %s\n"
+                , STAMP_MAX, strerror(errno));
+        exit(2);
+    }
+    if ( 0 == ( len = _stamp(path, sizeof(path), text, STAMP_MAX) ) ) {
+        free(text);
+        return;
+    }
+    snprintf(temp, sizeof(temp), "%s.%d", path, (int)getpid());
+    if ( NULL == ( out = fopen(temp, "w") ) ) {
+        mywarning("stamp: Unable to write %s: %s\n", temp, strerror(errno));
+    }
+    else if ( ( len != fwrite(text, 1, len, out) ) || ( fflush(out) ) ) {
+        mywarning("stamp: Unable to write %s: %s\n", temp, strerror(errno));
+        fclose(out);
+        unlink(temp);
+    }
+    else if ( fclose(out) ) {
+        mywarning("stamp: Unable to write %s: %s\n", temp, strerror(errno));
+        unlink(temp);
+    }
+    else if ( rename(temp, path) ) {
+        mywarning("stamp: Unable to rename %s: %s\n", temp, strerror(errno));
+        unlink(temp);
+    }
+    else {
+        mydebug("stamp: saved %s\n", path);
+    }
+    free(text);
+}
+
+/**
+ * vim: sw=4 ts=4 expandtab
+ * EOF: stamp.c
+ */
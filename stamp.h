@@ -0,0 +1,27 @@
+/****************************************************************************
+ * File: stamp.h
+ *
+ * Input fingerprint and XML pre-flight checks (stamp.c).
+ *
+ * Copyright (c) 2019-2024, Gary Allen Vollink.  http://voll.ink/playlister
+ * All rights reserved.
+ *
+ * Licence to use, see LICENSE file in this distribution.
+ */
+#ifndef STAMP_H
+#define STAMP_H 1
+#include <stdint.h>
+#include "utils.h"
+
+struct options;
+
+int  stampUnchanged(void);
+void stampSave     (void);
+int  xmlPreflight  (struct options *dev);
+uint64_t stampConfig(void);
+
+#endif /* STAMP_H */
+/**
+ * vim: sw=4 ts=4 expandtab
+ * EOF: stamp.h
+ */
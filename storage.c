@@ -13,14 +13,51 @@
 #include <stdlib.h> // malloc, realloc
 #include <sys/errno.h> // errno
 #include <string.h> // strerror
-#include <regex.h> // POSIX Regular Expressions
+#include <fcntl.h>  // open
+#include <unistd.h> // read, close
+#include <sys/stat.h> // fstat
+#include <sys/mman.h> // mmap
 #include "utils.h"
+#include "strkern.h"
 #include "options.h"
 #include "storage.h"
+#include "region.h"
+#include "reader3.h"    // BPLIST_MAGIC
+#include "reader4.h"    // MUSICDB_MAGIC
+
+/****
+ * storageEstimate() guesses, per track: bytes of XML, binary plist or
+ * (compressed) Music.app database (low, so the guess errs toward too many
+ * tracks), and bytes of the text a track keeps (Location and Name, artist
+ * and album mostly shared).
+ * With only a size to go on there is no guessing the playlists.
+ */
+#define EST_XML_BYTES     1024
+#define EST_BPLIST_BYTES  256
+#define EST_MUSICDB_BYTES 128
+#define EST_TEXT_BYTES    160
 
 /****************************************************************************
  * MODULE LOCAL DECLARATIONS
  */
+
+/****
+ * Element names set_node cares about.  Only <key> and <dict> change the
+ * state machine, anything else is just "some element".
+ */
+enum elname {
+    EL_NONE = 0,
+    EL_KEY,
+    EL_DICT,
+    EL_OTHER
+};
+
+/****
+ * One entry per XML depth, in node_stack[depth].  Key text is never kept,
+ * it is resolved to key (and id, for <key>123</key><dict> envelopes) as it
+ * arrives.  Value text is copied into text only when the close will hand
+ * it to _set_track or set_list; text/textsz are kept across reuse.
+ */
 struct level {
     int   level;
     int   in_tracks;
@@ -31,67 +68,290 @@ struct level {
     int   skip;
     int   lvl_state;
     int   id;
-    char  open_el[1024];
-    char  open_text[1024];
-    // char  last_key[1024];
+    enum itunesKey key;     // resolved text of the open <key>
+    int   keyid;            // open <key> text as a number, or -1
+    enum elname open_el;
+    enum elname sibling_el;
     int   exptype;
-    char  sibling_el[1024];
-    char  sibling_text[1024];
-    UT_hash_handle hh;
+    char *value;            // sibling text, "" unless committed
+    size_t vlen;
+    char *text;             // value storage, grows, never shrinks
+    size_t textsz;
 };
 
-struct statistics Stats;
+__thread struct statistics Stats;
+struct storagesize storage_size;
 
 /****************************************************************************
- * MODULE GLOBALS
+ * MODULE GLOBALS (one set per thread, see storage.h)
  */
-int            node_depth = 0;
-struct level   *node_tree = NULL;
+__thread int            node_depth = 0;
+__thread struct level  *node_stack = NULL;
+__thread int            node_stacksz = 0;
+__thread char           node_empty[1] = "";
+
+/****************************************************************************
+ * Make sure node_stack[depth] exists.
+ */
+static void
+_stack_reserve(int depth)
+{
+    struct level *grow = NULL;
+    int          newsz = ( node_stacksz ? node_stacksz : 16 );
+
+    if ( depth < node_stacksz ) {
+        return;
+    }
+    while ( depth >= newsz ) {
+        newsz *= 2;
+    }
+    grow = realloc(node_stack, newsz * sizeof(struct level));
+    if ( NULL == grow ) {
+        mydebug("Unable to allocate %ld bytes of space: %s",
+                newsz * sizeof(struct level), strerror(errno));
+        exit(2);
+    }
+    memset((void *)( grow + node_stacksz ), 0
+            , ( newsz - node_stacksz ) * sizeof(struct level));
+    node_stack   = grow;
+    node_stacksz = newsz;
+}
+
+/****************************************************************************
+ * Clear a level for reuse, keeping its text buffer.
+ */
+static void
+_level_clear(struct level *work, int depth)
+{
+    char   *text   = work->text;
+    size_t  textsz = work->textsz;
+
+    memset((void *)work, 0, sizeof(struct level));
+    work->level  = depth;
+    work->keyid  = -1;
+    work->text   = text;
+    work->textsz = textsz;
+    work->value  = node_empty;
+}
 
 /**
  * storageInit
  *
- * based on xml file size, allocate a storage buffer.
+ * based on xml file size (storageEstimate), allocate the storage.
  */
 void
 storageInit()
 {
-    struct level *work;
-    int level = 0;
-    work = malloc( sizeof(struct level) );
-    if ( NULL == work ) {
-        mydebug("Unable to allocate %ld bytes of space: %s",
-                sizeof(struct level), strerror(errno));
-        exit(2);
-    }
-    memset((void *)work, 0, sizeof(struct level));
     memset((void *)&Stats, 0, sizeof(struct statistics));
-    work->level        = level;
-    HASH_ADD_INT(node_tree, level, work);
+    trackProject();
+    listProject();
+    trackReserve(storage_size.tracks, storage_size.strings);
+    listReserve(storage_size.members);
+    _stack_reserve(0);
+    node_depth = 0;
+    _level_clear(&node_stack[0], 0);
 
     return;
 }
 
 
+/****************************************************************************
+ * Count the <key>Track ID</key> (tracks, then Playlist Items after the
+ * Playlists key) and <key>Playlist ID</key> in an XML file of len bytes.
+ */
+static void
+_prescan(const char *map, size_t len, struct storagesize *est)
+{
+    const char *end   = map + len;
+    const char *lists = strkStr(map, len, "<key>Playlists</key>", 20);
+    const char *p     = map;
+    const char *q     = NULL;
+
+    if ( NULL == lists ) {
+        lists = end;
+    }
+    while ( NULL != ( q = strkStr(p, end - p, " ID</key>", 9) ) ) {
+        if (   ( 13 <= q - map )
+            && ( 0 == memcmp(q - 13, "<key>Playlist", 13) ) ) {
+            est->playlists++;
+        }
+        else if (   ( 10 <= q - map )
+                 && ( 0 == memcmp(q - 10, "<key>Track", 10) ) ) {
+            if ( q < lists ) {
+                est->tracks++;
+            }
+            else {
+                est->members++;
+            }
+        }
+        p = q + 9;
+    }
+}
+
+
+/**
+ * storageEstimate
+ *
+ * Guess how many tracks (and how much text) filename holds, for
+ * storageInit() to presize with.  With prescan, an uncompressed XML is
+ * read once, quickly, to count them.  Compressed input and stdin get no
+ * guess, the tables just grow.
+ */
+void
+storageEstimate(const char *filename, int prescan)
+{
+    struct storagesize *est = &storage_size;
+    struct stat statbuf;
+    char        magic[8] = "";
+    void       *map = MAP_FAILED;
+    int         fd  = -1;
+
+    memset(est, 0, sizeof(struct storagesize));
+    if ( 0 == str_diffn(filename, "-", 2) ) {
+        return;
+    }
+    if ( 0 > ( fd = open(filename, O_RDONLY) ) ) {
+        return;
+    }
+    if (   ( fstat(fd, &statbuf) )
+        || ( sizeof(magic) > statbuf.st_size )
+        || ( sizeof(magic) != read(fd, magic, sizeof(magic)) ) ) {
+        close(fd);
+        return;
+    }
+
+    if ( 0 == memcmp(magic, BPLIST_MAGIC, 8) ) {
+        est->tracks = statbuf.st_size / EST_BPLIST_BYTES;
+    }
+    else if ( 0 == memcmp(magic, MUSICDB_MAGIC, 4) ) {
+        est->tracks = statbuf.st_size / EST_MUSICDB_BYTES;
+    }
+    else if ( ( '<' == magic[0] ) || ( '\xef' == magic[0] ) ) {
+        // XML, maybe after a UTF-8 byte order mark
+        if ( prescan ) {
+            map = mmap(NULL, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        if ( MAP_FAILED != map ) {
+#ifdef MADV_SEQUENTIAL
+            madvise(map, statbuf.st_size, MADV_SEQUENTIAL);
+#endif
+            _prescan((const char *)map, statbuf.st_size, est);
+            munmap(map, statbuf.st_size);
+            est->counted = 1;
+            // A count just short would double a table, round it up.
+            est->tracks  += est->tracks / 64 + 64;
+            est->members += est->members / 64 + 64;
+        }
+        else {
+            est->tracks = statbuf.st_size / EST_XML_BYTES;
+        }
+    }
+    close(fd);
+    est->strings = est->tracks * EST_TEXT_BYTES;
+
+    extradebug("%s : expecting %ld tracks, %ld playlists, %ld list items"
+            " (%s)\n", filename, est->tracks, est->playlists, est->members
+            , ( est->counted ? "counted" : "from its size" ));
+}
+
+
+static void
+_stack_free()
+{
+    for ( int cx = 0; cx < node_stacksz; cx++ ) {
+        free(node_stack[cx].text);
+    }
+    free(node_stack);
+    node_stack   = NULL;
+    node_stacksz = 0;
+    node_depth   = 0;
+}
+
+
+/**
+ * storageThreadInit
+ *
+ * A worker thread's empty set_node state, presized for share (0 to 1) of
+ * the tracks.  The projections it reads were made by storageInit() on
+ * the main thread.
+ */
+void
+storageThreadInit(double share)
+{
+    memset((void *)&Stats, 0, sizeof(struct statistics));
+    memset((void *)&track, 0, sizeof(struct tracktab));
+    memset((void *)&track_strings, 0, sizeof(struct strarena));
+    memset((void *)&track_syms, 0, sizeof(struct interntab));
+    memset((void *)&track_cols, 0, sizeof(struct coltab));
+    // A slice is cut by bytes, not tracks, leave it some slack.
+    trackReserve((long)( storage_size.tracks * share * 1.1 )
+            , (size_t)( storage_size.strings * share * 1.1 ));
+    _stack_reserve(0);
+    node_depth = 0;
+    _level_clear(&node_stack[0], 0);
+}
+
+
+/**
+ * storageThreadDone
+ *
+ * Hand this thread's tracks and counts to part, for storageMerge().
+ */
+void
+storageThreadDone(struct storagepart *part)
+{
+    part->track   = track;
+    part->strings = track_strings;
+    part->syms    = track_syms;
+    part->cols    = track_cols;
+    part->stats   = Stats;
+    memset((void *)&track, 0, sizeof(struct tracktab));
+    memset((void *)&track_strings, 0, sizeof(struct strarena));
+    memset((void *)&track_syms, 0, sizeof(struct interntab));
+    memset((void *)&track_cols, 0, sizeof(struct coltab));
+    _stack_free();
+}
+
+
+/**
+ * storageMerge
+ *
+ * Main thread: take over the tracks a worker stored.  Parts are merged in
+ * file order, so the track table iterates as if one thread read it all.
+ */
+void
+storageMerge(struct storagepart *part)
+{
+    int dups = trackMerge(&part->track, &part->strings
+            , &part->syms, &part->cols);
+
+    Stats.tracks    += part->stats.tracks - dups;
+    Stats.playlists += part->stats.playlists;
+    Stats.skipped   += part->stats.skipped;
+}
+
+
 void
 node_init(struct level *work)
 {
-    struct level *prevwork;
+    struct level *prevwork = NULL;
 
     work->in_tracks       = 0;
     work->in_playlists    = 0;
     work->is_key          = 0;
     work->is_trid         = 0;
     work->lvl_state       = 0;
-    work->id            = 0;
-    work->open_el[0]      = '\0';
-    work->open_text[0]    = '\0';
+    work->id              = 0;
+    work->key             = K_UNKNOWN;
+    work->keyid           = -1;
+    work->open_el         = EL_NONE;
     work->exptype         = 0;
-    work->sibling_el[0]   = '\0';
-    work->sibling_text[0] = '\0';
-    prevwork              = work->hh.prev;
+    work->sibling_el      = EL_NONE;
+    work->value           = node_empty;
+    work->vlen            = 0;
 
-    if ( NULL != prevwork ) {
+    if ( 0 < work->level ) {
+        prevwork = &node_stack[work->level - 1];
         // extradebug("node_init: Deep init node level %i from %i\n"
         //         , work->level, prevwork->level);
         if ( 1 == prevwork->in_tracks ) {
@@ -100,14 +360,12 @@ node_init(struct level *work)
         if ( 1 == prevwork->in_playlists ) {
             work->in_playlists = 1;
         }
-        if ( ( 0 == str_diffn( "key"
-                            , prevwork->open_el, 4) )
-                && ( _check_for_id(prevwork->open_text ) )
-                && ( 0 == str_diffn("dict"
-                            , prevwork->sibling_el, 5) )
+        if ( ( EL_KEY == prevwork->open_el )
+                && ( 0 <= prevwork->keyid )
+                && ( EL_DICT == prevwork->sibling_el )
             ) {
             prevwork->is_trid = 1;
-            work->id = atoi(prevwork->open_text);
+            work->id = prevwork->keyid;
         }
     }
 }
@@ -117,34 +375,21 @@ int
 node_alloc(int depth, int ntype)
 {
     int lvl_init = 0;
-    struct level *work = NULL;
 
     if ( node_depth != depth ) {
         if ( depth < node_depth ) {
-            while ( depth < node_depth ) {
-                HASH_FIND_INT(node_tree, &node_depth, work);
-                HASH_DEL(node_tree, work);
-                free(work);
-                node_depth--;
-            }
+            node_depth = depth;
         }
         else if ( depth > node_depth ) {
             if ( 1 != ntype ) {
                 return lvl_init;
             }
+            _stack_reserve(depth);
             while ( depth > node_depth ) {
-                work         = malloc( sizeof(struct level) );
-                if ( NULL == work ) {
-                    mydebug("sn:Unable to allocate %ld bytes of space: %s\n",
-                            sizeof(struct level), strerror(errno));
-                    exit(2);
-                }
-                memset((void *)work, 0, sizeof(struct level));
+                node_depth++;
                 // extradebug("sn:Allocated for level %d\n", depth);
-                work->level = depth;
-                HASH_ADD_INT(node_tree, level, work);
+                _level_clear(&node_stack[node_depth], node_depth);
                 lvl_init++;
-                node_depth++;
             }
         }
     }
@@ -152,114 +397,207 @@ node_alloc(int depth, int ntype)
 }
 
 
-void
+static enum elname
+_elname(const char *name)
+{
+    if ( 0 == str_diffn("key", name, 4) ) {
+        return EL_KEY;
+    }
+    if ( 0 == str_diffn("dict", name, 5) ) {
+        return EL_DICT;
+    }
+    return EL_OTHER;
+}
+
+
+/****************************************************************************
+ * Would closing this sibling hand its text to storage?  Mirrors the
+ * lvl_state 2 branches of set_node, so nothing else is ever copied.
+ */
+static int
+_keeps_value(struct level *work)
+{
+    if ( 1 == work->in_tracks ) {
+        return 1;
+    }
+    if ( 1 == work->in_playlists ) {
+        if ( K_PLAYLIST_ID == work->key ) {
+            return 1;
+        }
+        if ( ( 1 == work->is_plid ) && ( 0 == work->skip ) ) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+/****************************************************************************
+ * Projection: is anything inside the sibling just opened after a <key>
+ * going to be used?  Track fields come from trackProject(), playlists
+ * only need their id, name and (if still wanted) items.  Everything else,
+ * Smart Info blobs, sort and date keys, unselected playlists' items, is
+ * skipped whole by the reader.
+ */
+static int
+_wants_sibling(struct level *work)
+{
+    if ( EL_KEY != work->open_el ) {
+        return 1;       // The <dict>s of an <array>
+    }
+    if ( ( K_TRACKS == work->key ) || ( K_PLAYLISTS == work->key ) ) {
+        return 1;
+    }
+    if ( 1 == work->in_tracks ) {
+        if ( 0 <= work->keyid ) {
+            return 1;   // <key>NNN</key><dict> track envelope
+        }
+        if ( K_TRACK_ID == work->key ) {
+            return 1;
+        }
+        // The rest of a track copied from the last snapshot is not needed,
+        // but captured columns are not in the snapshot.
+        return ( want_track_key(work->key)
+                && ( ( ! trackReused(work->id) )
+                    || ( 0 <= columnIndex(work->key) ) ) );
+    }
+    if ( 1 == work->in_playlists ) {
+        switch ( work->key ) {
+            case K_PLAYLIST_ID:
+            case K_PLAYLIST_PERSISTENT_ID:
+            case K_NAME:
+            case K_TRACK_ID:
+                return 1;
+            case K_PLAYLIST_ITEMS:
+                return ( 0 == work->skip );
+            default:
+                return 0;
+        }
+    }
+    return 0;
+}
+
+
+static void
+_keep_value(struct level *work, const char *value)
+{
+    size_t len = strlen(value);
+    char *grow = NULL;
+
+    if ( len >= work->textsz ) {
+        grow = realloc(work->text, len + 256);
+        if ( NULL == grow ) {
+            mydebug("sn:Unable to allocate %ld bytes of space: %s\n",
+                    len + 256, strerror(errno));
+            exit(2);
+        }
+        work->text   = grow;
+        work->textsz = len + 256;
+    }
+    memcpy(work->text, value, len + 1);
+    work->value = work->text;
+    work->vlen  = len;
+}
+
+
+int
 set_node(int depth, int ntype, char* name, int emptyel, int hasval, char* value)
 {
-    char   trid[1024] = "\0\0\0";
     struct level *work, *prevwork = NULL;
-    int    cx         = 0;
     int    init_level = node_alloc(depth, ntype);
+    int        action = NODE_NEXT;
 
-    HASH_FIND_INT(node_tree, &node_depth, work);
-
-    if (NULL == work) {
-        mydebug("sn:%s unable to find depth %d\n"
-                , "HASH_FIND_INT(node_tree, &node_depth, work)"
-                , node_depth);
-        exit(-2);
+    work = &node_stack[node_depth];
+    if ( 0 < node_depth ) {
+        prevwork = &node_stack[node_depth - 1];
     }
 
-    prevwork = work->hh.prev;
-
     if ( 1 == init_level ) {
         node_init(work);
-        if ( NULL != prevwork ) {
-            if ( ( 0 == str_diffn( "key"
-                                , prevwork->open_el, 4) )
-                    && ( _check_for_id(prevwork->open_text ) )
-                    && ( 0 == str_diffn("dict"
-                                , prevwork->sibling_el, 5) )
-                ) {
-                // extradebug("sn: Copy trid into node level %i from %i\n"
-                //         , work->level, prevwork->level);
-                strncpy(trid, prevwork->open_text, 1024);
-            }
-            else if (
-                     ( prevwork->is_plid )
-                    ) {
-                work->is_plid = prevwork->is_plid;
-                work->id = prevwork->id;
-                work->skip = prevwork->skip;
-            }
+        if ( ( NULL != prevwork ) && ( prevwork->is_plid ) ) {
+            work->is_plid = prevwork->is_plid;
+            work->id = prevwork->id;
+            work->skip = prevwork->skip;
         }
         // extradebug("sn:Level %d initialized\n", node_depth);
     }
 
-    // extradebug("sn:node_tree[%d], work, ptr is %p\n"
-    //          , node_depth, work);
-
     if ( 1 == ntype ) {         // ELEMENT (Open)
-        if ( 0 == str_diffn( "key", name, 4 ) ) {
+        enum elname el = _elname(name);
+        if ( EL_KEY == el ) {
             work->is_key = 1;
             work->lvl_state = 1;
-            strncpy( work->open_el, name, 1024 );
-            strncpy( work->open_text, "\0\0", 3 );
-            strncpy( work->sibling_el, "\0\0", 3 );
-            strncpy( work->sibling_text, "\0\0", 3 );
+            work->key = K_UNKNOWN;
+            work->keyid = -1;
+            work->open_el = el;
+            work->sibling_el = EL_NONE;
+            work->value = node_empty;
+            work->vlen = 0;
         }
-        else if ( 0 == strlen( work->open_el ) ) {
+        else if ( EL_NONE == work->open_el ) {
             work->lvl_state = 1;
-            strncpy( work->open_el, name, 1024 );
-            strncpy( work->open_text, "\0\0", 3 );
-            strncpy( work->sibling_el, "\0\0", 3 );
-            strncpy( work->sibling_text, "\0\0", 3 );
+            work->key = K_UNKNOWN;
+            work->keyid = -1;
+            work->open_el = el;
+            work->sibling_el = EL_NONE;
+            work->value = node_empty;
+            work->vlen = 0;
         }
         else {
             work->lvl_state = 2;
-            strncpy( work->sibling_el, name, 1024 );
-            strncpy( work->sibling_text, "\0\0", 3 );
+            work->sibling_el = el;
+            work->value = node_empty;
+            work->vlen = 0;
+            if ( ( ! emptyel ) && ( ! _wants_sibling(work) ) ) {
+                // No close will come, lvl_state 2 waits for the next <key>
+                Stats.skipped++;
+                action = NODE_SKIP;
+            }
+            else if (   ( emptyel ) && ( 1 == work->in_tracks )
+                     && ( 1 != work->is_trid )
+                     && ( 0 <= columnIndex(work->key) )
+                     && (   ( 0 == str_diffn("true", name, 5) )
+                         || ( 0 == str_diffn("false", name, 6) ) ) ) {
+                // <true/> and <false/>: no text, no close, the name is it.
+                _set_track(work->id, work->key, name);
+            }
         }
     }
     else if ( 15 == ntype ) {   // Close Element
-        if ( 1 == work->lvl_state ) { // open_el, open_text
+        if ( 1 == work->lvl_state ) { // open_el, key
             work->lvl_state = 0;
-            if ( 0 == str_diffn("Playlists", work->open_text, 1024) ) {
+            if ( K_PLAYLISTS == work->key ) {
                 work->in_tracks = 0;
                 work->in_playlists = 1;
                 extradebug("sn:Playlist Start\n");
             }
-            if ( 0 == str_diffn("Tracks", work->open_text, 1024) ) {
+            else if ( K_TRACKS == work->key ) {
                 work->in_tracks = 1;
                 work->in_playlists = 0;
             }
         }
-        else if ( 2 == work->lvl_state ) { // sibling_el, sibling_text
+        else if ( 2 == work->lvl_state ) { // sibling_el, value
             work->lvl_state = 0;
             if (   ( 1 == work->in_tracks )
                     && ( 1 != work->is_trid )
-                    && ( 0 == str_diffn( "Track ID", work->open_text, 9 ) )
-                    && ( _check_for_id( work->sibling_text ) )
+                    && ( K_TRACK_ID == work->key )
+                    && ( _check_for_id( work->value ) )
                     ) {
-                // extradebug("sn:Track ID check, %s against ", work->sibling_text);
-                strncpy(trid, work->sibling_text, 1024);
                 work->is_trid = -1;
                 if ( prevwork ) {
-                    // extradebug("... Parent ID %s: ", prevwork->open_text);
-                    if (
-                        str_diffn(
-                              prevwork->open_text
-                            , work->sibling_text, 1024
-                            )
-                        ) {
+                    // extradebug("... Parent ID %i: ", prevwork->keyid);
+                    if ( prevwork->keyid != atoi(work->value) ) {
                         mydebug(
                             "TRID in track %s does not match TRID on envelope %i\n"
-                            , work->sibling_text, prevwork->open_text );
+                            , work->value, prevwork->keyid );
                         exit(3);
                     }
                     else {
-                        work->id = atoi(work->sibling_text);
+                        work->id = prevwork->keyid;
                         prevwork->is_trid = 1;
                         prevwork->id = work->id;
+                        // The track exists even if no field is projected.
+                        _set_track(work->id, K_TRACK_ID, work->value);
                     }
                 }
                 else {
@@ -270,22 +608,34 @@ set_node(int depth, int ntype, char* name, int emptyel, int hasval, char* value)
             else if ( ( 1 == work->in_tracks )
                     && ( 1 != work->is_trid )
                     ) {
-                _set_track(work->id, work->open_text, work->sibling_text);
+                _set_track(work->id, work->key, work->value);
             }
             else if ( ( 1 == work->in_playlists )
-                    && ( 0 == str_diffn( "Playlist ID", work->open_text, 9 ) )
-                    && ( _check_for_id( work->sibling_text ) )
+                    && ( K_PLAYLIST_ID == work->key )
+                    && ( _check_for_id( work->value ) )
                     ) {
+                if ( lists_complete() ) {
+                    extradebug("sn:Lists complete before playlist %s\n"
+                            , work->value);
+                    return NODE_STOP;
+                }
                 Stats.playlists++;
                 work->is_plid = 1;
-                work->id = atoi( work->sibling_text );
+                work->id = atoi( work->value );
             }
             else if ( ( 1 == work->in_playlists )
                     && ( 1 == work->is_plid )
                     && ( 0 == work->skip )
                     ) {
-                if (set_list(work->id, work->open_text, work->sibling_text)) {
-                    prevwork->skip = 1;
+                if (set_list(work->id, work->key, work->value)) {
+                    // Unwanted list, the rest of this <dict> is skipped.
+                    work->skip = 1;
+                }
+                else if ( ( K_PLAYLIST_ITEMS == work->key )
+                        && ( lists_complete() ) ) {
+                    extradebug("sn:Lists complete after playlist %i\n"
+                            , work->id);
+                    return NODE_STOP;
                 }
             }
         }
@@ -297,10 +647,18 @@ set_node(int depth, int ntype, char* name, int emptyel, int hasval, char* value)
     }
     else if ( 3 == ntype ) {    // TEXT (between elements)
         if ( 1 == work->lvl_state ) {
-            strncpy( work->open_text, value, 1024 );
+            work->key = itunesKey(value);
+            work->keyid = -1;
+            if (   ( EL_KEY == work->open_el )
+                && ( _check_for_id(value) )
+                ) {
+                work->keyid = atoi(value);
+            }
         }
         else if ( 2 == work->lvl_state ) {
-            strncpy( work->sibling_text, value, 1024 );
+            if ( _keeps_value(work) ) {
+                _keep_value(work, value);
+            }
         }
         else {
             mydebug("sn:#text [%s], but nowhere to put it.\n", value);
@@ -310,6 +668,7 @@ set_node(int depth, int ntype, char* name, int emptyel, int hasval, char* value)
     }
 
     // extradebug("Found end of set_node()\n");
+    return action;
 }
 
 
@@ -322,66 +681,74 @@ trid_compare(char *strid, int itrid)
 }
 
 
+/****************************************************************************
+ * Track and playlist ids are all digits.
+ */
 int
 _check_for_id(char* value)
 {
-    regex_t digits;
-    int     rxret;
-    char    rxerrbuf[1024];
-
-    /* Compile regular expression */
-    rxret = regcomp(&digits, "^[[:digit:]]+$", REG_EXTENDED|REG_NOSUB);
-    if (rxret) {
-        fprintf(stderr, "Could not compile regex\n");
-        exit(2);
-    }
-
-    /* Execute regular expression */
-    rxret = regexec(&digits, value, 0, NULL, 0);
-    if (!rxret) {
-        // extradebug("RegEx digits matched, %s\n", value);
-        return(1);
-    }
-    else if (REG_NOMATCH == rxret) {
-        // extradebug("RegEx for digits DID NOT match, [%s]\n", value);
-        return(0);
-    }
-    else {
-        regerror(rxret, &digits, rxerrbuf, sizeof(rxerrbuf));
-        fprintf(stderr, "Regex match failed: %s\n", rxerrbuf);
-        exit(2);
-    }
-
-    /* Free memory allocated to the pattern buffer by regcomp() */
-    regfree(&digits);
-    return(0);
+    return strkDigits(value);
 }
 
 
 void
-storageInfo()
+storageInfo(const char *filename)
 {
+    size_t records = 0;
+    size_t strings = 0;
+
     if ( Stats.tracks ) {
-        mydebug("sI: %s Totals\n", Opts.itunes_xml_file);
+        trackUsage(&records, &strings);
+        mydebug("sI: %s Totals\n", filename);
         mydebug("sI:    Tracks: %i\n", Stats.tracks);
         mydebug("sI: Playlists: %i\n", Stats.playlists);
+        mydebug("sI:   Skipped: %i values unread\n", Stats.skipped);
+        mydebug("sI:    Memory: %ld KB of tracks, %ld KB of strings"
+                " (%ld KB as char[1024] fields)\n"
+                , (long)( records / 1024 ), (long)( strings / 1024 )
+                , (long)( ( records + ( track.count * 4096L ) )
+                    / 1024 ));
+        trackInternInfo();
+        columnInfo();
     }
 
+    if ( storage_size.tracks ) {
+        mydebug("sI:  Estimate: %ld tracks (%d read), %ld playlists (%d read)"
+                ", %ld list items (%u kept), %ld KB of strings (%ld KB used)"
+                ", %s\n"
+                , storage_size.tracks, Stats.tracks
+                , storage_size.playlists, Stats.playlists
+                , storage_size.members, list_members.used
+                , (long)( storage_size.strings / 1024 )
+                , (long)( track_strings.used / 1024 )
+                , ( storage_size.counted ? "counted" : "from the file size" ));
+    }
+    regionInfo(&parse_region);
     trackInfo();
     listInfo();
 }
 
 
+/**
+ * storageSeal
+ *
+ * Every track is stored: turn the Track IDs in the playlists into track
+ * slots, for listm3u.c (and the snapshot) to walk.
+ */
+void
+storageSeal()
+{
+    listSeal();
+}
+
+
 void
 storageFree()
 {
-    struct level *curlvl, *ltmp;
     listFree();
     trackFree();
-    HASH_ITER(hh, node_tree, curlvl, ltmp) {
-        HASH_DEL(node_tree, curlvl);
-        free(curlvl);
-    }
+    _stack_free();
+    regionFree(&parse_region);
 }
 
 /**
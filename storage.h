@@ -10,60 +10,285 @@
  */
 #ifndef STORAGE_H
 #define STORAGE_H 1
+#include <stdint.h>
 #include "utils.h"
 #include "uthash.h"
 #include "utarray.h"
+#include "keys.h"
+
+/****
+ * set_node's answer to an element open.  NODE_SKIP means nothing inside
+ * the element is wanted, the reader should step over its whole subtree
+ * (xmlTextReaderNext) and send no events for it, not even the close.
+ * NODE_STOP (only ever on a close) means every requested playlist is
+ * stored, the reader can stop and report success.
+ */
+enum nodeAction {
+    NODE_NEXT = 0,
+    NODE_SKIP,
+    NODE_STOP
+};
 
 void storageInit();
-void storageInfo();
+void storageEstimate(const char *filename, int prescan);
+void storageInfo(const char *filename);
 void storageFree();
-void set_node(int depth,   int ntype,  char* name, 
+void storageSeal();
+struct storagepart;
+void storageThreadInit(double share);
+void storageThreadDone(struct storagepart *part);
+void storageMerge(struct storagepart *part);
+int  set_node(int depth,   int ntype,  char* name, 
               int emptyel, int hasval, char* value);
 int  _check_for_id(char* value);
 int  trid_compare(char *strid, int itrid);
 /* track_storage.c */
-void _set_track(int trid, char* name, char* value);
+void _set_track(int trid, enum itunesKey key, char* value);
+struct trackmap *trackAdd(int trid);
+struct trackmap *trackAt(int slot);
+int  trackSlot(int trid);
+int  trackReused(int trid);
+struct tracktab;
+struct strarena;
+struct interntab;
+struct coltab;
+int  trackMerge(struct tracktab *from, struct strarena *strings
+                , struct interntab *syms, struct coltab *cols);
+void trackProject();
+void trackReserve(long tracks, size_t strings);
+int  want_track_key(enum itunesKey key);
 void trackInfo();
 void trackFree();
 /* list_storage.c */
-int set_list(int plid, char* name, char* value);
+struct options;
+struct listopts;
+int set_list(int plid, enum itunesKey key, char* value);
+struct list *listAdd(int plid);
+void want_names(UT_array *names);
+int want_list(struct options *opts, int plid, char* name);
+int want_list_any(int plid, char* name);
+void listProject();
+void listReserve(long members);
+int lists_complete();
+void listSeal();
+struct list **listsOf(uint32_t slot, uint32_t *count);
+struct list *listCompose(struct listopts *lo);
 void listInfo();
 void listFree();
 
 struct statistics {
     int     tracks;
     int     playlists;
+    int     skipped;    // values and subtrees never read (NODE_SKIP)
 };
 
+/****
+ * Stats, track and the set_node state are per thread, so that reader2.c
+ * can parse slices of the Tracks dict on worker threads.  Playlists
+ * (set_list, listAdd, listAppend) are written by whichever one thread
+ * runs set_node over the Playlists array: the main thread, or ring.c's
+ * storage thread, which the main thread joins before reading them.
+ * Everything else (options, projections) is only written by the main
+ * thread, before the other threads start or after they are joined.
+ */
 #ifndef STORAGE_C
-extern struct statistics Stats;
+extern __thread struct statistics Stats;
 #endif /* STORAGE_C */
 
+/****
+ * How big the tables are expected to get, from the XML's size or, with
+ * --prescan, from counting its keys (storageEstimate).  storageInit()
+ * presizes for it, a worker thread for its share.  All 0 is no guess.
+ */
+struct storagesize {
+    long    tracks;
+    long    playlists;
+    long    members;    // Playlist Items, in every list
+    size_t  strings;    // track text, see struct strarena
+    int     counted;    // 1 from a prescan, 0 from the size
+};
+
+#ifndef STORAGE_C
+extern struct storagesize storage_size;
+#endif /* STORAGE_C */
+
+
+/****
+ * Track strings live end to end in one growing buffer per thread (moved
+ * to the main thread's by storageMerge), a track only holds where.  Read
+ * them with trackStr(); offset 0 is always "".
+ */
+struct strarena {
+    char   *buf;
+    size_t  used;
+    size_t  size;
+};
+
+struct trackstr {
+    uint32_t off;
+    uint32_t len;
+};
 
 struct trackmap {
     int   id;           // Track ID
     int   time;         // Total TIme
-    char  file[1024];   // Location
-    char  name[1024];   // Track Name
-    char  album[1024];  // Album Name
-    char  artist[1024]; // Album Artist or Artist
-    UT_hash_handle hh;
+    int   previd;       // Track ID in the last snapshot if copied from it
+    uint64_t pid;       // Persistent ID   (--incremental)
+    uint64_t modified;  // Date Modified   (--incremental)
+    struct trackstr file;   // Location
+    struct trackstr name;   // Track Name
+    uint32_t album;         // Album Name, symbol (see trackSym)
+    uint32_t artist;        // Album Artist or Artist, symbol
+};
+
+/****
+ * Tracks are kept end to end, numbered by slot (0..count-1) in the order
+ * they were first seen, with a Track ID to slot lookup beside them.
+ * After storageSeal(), playlists hold slots, not Track IDs.  A track
+ * pointer is only good until the next trackAdd() (rec may move).
+ */
+struct tracktab {
+    struct trackmap *rec;       // by slot
+    uint32_t         count;
+    uint32_t         size;
+    uint32_t        *slot;      // open addressing, slot + 1, 0 is free
+    uint32_t         slots;     // a power of 2
+};
+
+/****
+ * Values that repeat across tracks (artist, album) are interned: stored
+ * once in the arena, and numbered.  Symbol 0 is always "", so equal
+ * symbols are equal strings.  Like the arena, one table per thread.
+ */
+struct interntab {
+    uint32_t        *slot;      // open addressing, symbol + 1, 0 is free
+    uint32_t         slots;     // a power of 2
+    struct trackstr *sym;       // string of each symbol
+    uint32_t         count;
+    uint32_t         size;
+    size_t           refs;      // values interned
+    size_t           saved;     // bytes not stored again
 };
 
+const char *trackStr   (struct trackstr str);
+void        trackStrSet(struct trackstr *str, const char *value, size_t len);
+const char *trackSym   (uint32_t sym);
+uint32_t    trackIntern(const char *value, size_t len);
+void        trackUsage (size_t *records, size_t *strings);
+void        trackInternInfo();
+
 #ifndef TRACK_STORAGE_C
-extern struct trackmap *track;
+extern __thread struct tracktab  track;
+extern __thread struct strarena  track_strings;
+extern __thread struct interntab track_syms;
 #endif /* TRACK_STORAGE_C */
 
+/****
+ * Track keys beyond what the playlists need, captured only when some
+ * device configuration asks for them (capture = Genre, Year, ...).
+ * Each captured key is one column, its values end to end by track slot,
+ * with a bit per slot saying the track had the key.  A scan over one
+ * key reads just that column.  Like the track table, one set per thread.
+ */
+#define COL_MAX 32
+
+enum coltype {
+    COL_INT32,      // counts, numbers, milliseconds
+    COL_INT64,      // Size, Play Date
+    COL_DATE,       // seconds since 1970 (int64_t)
+    COL_BOOL,       // <true/> or <false/>, data is bits like valid
+    COL_SYM         // interned string, see trackSym()
+};
+
+struct column {
+    enum itunesKey key;
+    enum coltype   type;
+    void          *data;    // by slot: int32_t, int64_t, bits or uint32_t
+    uint64_t      *valid;   // bit per slot
+    uint32_t       size;    // slots there is room for
+    uint32_t       count;   // values set
+};
+
+struct coltab {
+    struct column col[COL_MAX];
+    int           count;
+};
+
+#define COL_BIT(bits, slot) \
+    ( ( (bits)[(slot) >> 6] >> ( (slot) & 63 ) ) & 1 )
+#define COL_SET(bits, slot) \
+    ( (bits)[(slot) >> 6] |= ( (uint64_t)1 << ( (slot) & 63 ) ) )
+#define COL_CLR(bits, slot) \
+    ( (bits)[(slot) >> 6] &= ~( (uint64_t)1 << ( (slot) & 63 ) ) )
+
+void            columnProject();
+int             columnCount();
+int             columnIndex(enum itunesKey key);
+struct column * columnAt   (int col);
+int             columnGet  (int col, uint32_t slot, int64_t *value);
+void            columnSet  (uint32_t slot, enum itunesKey key
+                                , const char *value);
+void            columnMerge(struct coltab *from, const uint32_t *slotmap
+                                , uint32_t n, const uint32_t *symmap);
+void            columnPrint(uint32_t slot);
+void            columnInfo ();
+void            columnFree (struct coltab *tab);
+
+#ifndef COLUMN_STORAGE_C
+extern __thread struct coltab track_cols;
+#endif /* COLUMN_STORAGE_C */
+
+/****
+ * What a worker thread hands back, see storageThreadDone().
+ */
+struct storagepart {
+    struct tracktab   track;
+    struct strarena   strings;
+    struct interntab  syms;
+    struct coltab     cols;
+    struct statistics stats;
+};
+
 struct list {
     int   id;
+    uint64_t ppid;      // Playlist Persistent ID
     char  name[1024];
     int   wanted;
-    UT_array * trid;
+    uint32_t first;     // members, see struct listpool
+    uint32_t count;
     UT_hash_handle hh;
 };
 
+/****
+ * Every playlist's members end to end in one array (compressed sparse
+ * row): list work has ref[work->first] up to ref[work->first + count].
+ * Track IDs while parsing, track slots after storageSeal().
+ */
+struct listpool {
+    uint32_t *ref;
+    uint32_t  used;
+    uint32_t  size;
+};
+
+uint32_t *listRefs  (struct list *work);
+void      listAppend(struct list *work, uint32_t ref);
+
+/****
+ * The same membership turned around, built by listSeal(): the wanted
+ * lists holding track slot cx are list[start[cx]] up to list[start[cx+1]],
+ * each list once.
+ */
+struct listindex {
+    uint32_t     *start;    // tracks + 1 of them
+    struct list **list;
+    uint32_t      tracks;
+    uint32_t      used;
+};
+
 #ifndef LIST_STORAGE_C
 extern struct list *playlist;
+extern struct listpool list_members;
+extern struct listindex list_index;
 #endif /* LIST_STORAGE_C */
 
 #endif /* STORAGE_H */
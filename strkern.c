@@ -0,0 +1,440 @@
+/****************************************************************************
+ * File: strkern.c
+ *
+ * Length based string scanning kernels.
+ *
+ * Everything here runs once per track Location (or more, once per track
+ * per playlist), so it avoids allocating and never re-measures a string.
+ * Byte and substring searches use 32 bytes at a time with AVX2 when the
+ * CPU has it (checked once, at the first call), 16 with SSE2 or NEON, and
+ * plain C otherwise.  Substring search compares the first and last byte of
+ * the needle across a whole vector and only memcmp()s where both match.
+ *
+ * Copyright (c) 2019-2024, Gary Allen Vollink.  http://voll.ink/playlister
+ * All rights reserved.
+ *
+ * Licence to use, see LICENSE file in this distribution.
+ */
+#define STRKERN_C 1
+#include <string.h>      // memchr, memcmp, memmove
+#if defined(__x86_64__) && ( defined(__GNUC__) || defined(__clang__) )
+#define STRK_X86 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define STRK_NEON 1
+#include <arm_neon.h>
+#endif
+#include "utils.h"
+#include "strkern.h"
+
+typedef const char *(*chr_f)(const char *, size_t, int);
+typedef const char *(*str_f)(const char *, size_t, const char *, size_t);
+
+static const char *_chr_resolve(const char *s, size_t len, int c);
+static const char *_str_resolve(const char *hay, size_t hlen
+                                , const char *needle, size_t nlen);
+
+static chr_f       _chr  = _chr_resolve;
+static str_f       _str  = _str_resolve;
+static const char *_impl = NULL;
+
+
+/****************************************************************************
+ * Plain C, also the tail of every vector version.
+ */
+static const char *
+_chr_scalar(const char *s, size_t len, int c)
+{
+    return (const char *) memchr(s, c, len);
+}
+
+
+static const char *
+_str_scalar(const char *hay, size_t hlen, const char *needle, size_t nlen)
+{
+    const char *p    = hay;
+    const char *last = hay + ( hlen - nlen );
+
+    while ( p <= last ) {
+        if ( NULL == ( p = memchr(p, needle[0], ( last - p ) + 1) ) ) {
+            return NULL;
+        }
+        if ( 0 == memcmp(p + 1, needle + 1, nlen - 1) ) {
+            return p;
+        }
+        p++;
+    }
+    return NULL;
+}
+
+
+#if defined(STRK_X86)
+/****************************************************************************
+ * SSE2 is part of x86_64, no check needed.
+ */
+static const char *
+_chr_sse2(const char *s, size_t len, int c)
+{
+    const char  *end = s + len;
+    const __m128i cv = _mm_set1_epi8((char)c);
+
+    while ( 16 <= ( end - s ) ) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)s);
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, cv));
+        if ( mask ) {
+            return s + __builtin_ctz(mask);
+        }
+        s += 16;
+    }
+    return _chr_scalar(s, end - s, c);
+}
+
+
+static const char *
+_str_sse2(const char *hay, size_t hlen, const char *needle, size_t nlen)
+{
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i  last = _mm_set1_epi8(needle[nlen - 1]);
+    size_t           cx = 0;
+
+    // Each block tests starts cx..cx+15, the last byte read is cx+15+nlen-1.
+    for ( ; cx + 16 + nlen - 1 <= hlen; cx += 16 ) {
+        __m128i bf = _mm_loadu_si128((const __m128i *)( hay + cx ));
+        __m128i bl = _mm_loadu_si128((const __m128i *)( hay + cx + nlen - 1 ));
+        unsigned mask = (unsigned) _mm_movemask_epi8(
+                    _mm_and_si128( _mm_cmpeq_epi8(bf, first)
+                                 , _mm_cmpeq_epi8(bl, last) ) );
+        while ( mask ) {
+            int bit = __builtin_ctz(mask);
+            if ( 0 == memcmp(hay + cx + bit + 1, needle + 1, nlen - 2) ) {
+                return hay + cx + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    if ( cx + nlen > hlen ) {
+        return NULL;
+    }
+    return _str_scalar(hay + cx, hlen - cx, needle, nlen);
+}
+
+
+__attribute__((target("avx2")))
+static const char *
+_chr_avx2(const char *s, size_t len, int c)
+{
+    const char  *end = s + len;
+    const __m256i cv = _mm256_set1_epi8((char)c);
+
+    while ( 32 <= ( end - s ) ) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)s);
+        unsigned mask = (unsigned) _mm256_movemask_epi8(
+                            _mm256_cmpeq_epi8(chunk, cv));
+        if ( mask ) {
+            return s + __builtin_ctz(mask);
+        }
+        s += 32;
+    }
+    return _chr_sse2(s, end - s, c);
+}
+
+
+__attribute__((target("avx2")))
+static const char *
+_str_avx2(const char *hay, size_t hlen, const char *needle, size_t nlen)
+{
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i  last = _mm256_set1_epi8(needle[nlen - 1]);
+    size_t           cx = 0;
+
+    for ( ; cx + 32 + nlen - 1 <= hlen; cx += 32 ) {
+        __m256i bf = _mm256_loadu_si256((const __m256i *)( hay + cx ));
+        __m256i bl = _mm256_loadu_si256(
+                        (const __m256i *)( hay + cx + nlen - 1 ));
+        unsigned mask = (unsigned) _mm256_movemask_epi8(
+                    _mm256_and_si256( _mm256_cmpeq_epi8(bf, first)
+                                    , _mm256_cmpeq_epi8(bl, last) ) );
+        while ( mask ) {
+            int bit = __builtin_ctz(mask);
+            if ( 0 == memcmp(hay + cx + bit + 1, needle + 1, nlen - 2) ) {
+                return hay + cx + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    if ( cx + nlen > hlen ) {
+        return NULL;
+    }
+    return _str_sse2(hay + cx, hlen - cx, needle, nlen);
+}
+
+#elif defined(STRK_NEON)
+/****************************************************************************
+ * NEON is part of aarch64.  There is no movemask, so a hit only says
+ * which 16 bytes to finish with plain C.
+ */
+static const char *
+_chr_neon(const char *s, size_t len, int c)
+{
+    const char     *end = s + len;
+    const uint8x16_t cv = vdupq_n_u8((uint8_t)c);
+
+    while ( 16 <= ( end - s ) ) {
+        uint8x16_t chunk = vld1q_u8((const uint8_t *)s);
+        if ( vmaxvq_u8(vceqq_u8(chunk, cv)) ) {
+            return _chr_scalar(s, 16, c);
+        }
+        s += 16;
+    }
+    return _chr_scalar(s, end - s, c);
+}
+
+
+static const char *
+_str_neon(const char *hay, size_t hlen, const char *needle, size_t nlen)
+{
+    const uint8x16_t first = vdupq_n_u8((uint8_t)needle[0]);
+    const uint8x16_t  last = vdupq_n_u8((uint8_t)needle[nlen - 1]);
+    const char      *found = NULL;
+    size_t              cx = 0;
+
+    for ( ; cx + 16 + nlen - 1 <= hlen; cx += 16 ) {
+        uint8x16_t bf = vld1q_u8((const uint8_t *)( hay + cx ));
+        uint8x16_t bl = vld1q_u8((const uint8_t *)( hay + cx + nlen - 1 ));
+        if ( vmaxvq_u8(vandq_u8(vceqq_u8(bf, first), vceqq_u8(bl, last))) ) {
+            // Somewhere in these 16 starts, settle it in plain C.
+            found = _str_scalar(hay + cx, 16 + nlen - 1, needle, nlen);
+            if ( found ) {
+                return found;
+            }
+        }
+    }
+    if ( cx + nlen > hlen ) {
+        return NULL;
+    }
+    return _str_scalar(hay + cx, hlen - cx, needle, nlen);
+}
+#endif
+
+
+/****************************************************************************
+ * First call of either function lands here and picks for both.
+ */
+static void
+_resolve(void)
+{
+#if defined(STRK_X86)
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports("avx2") ) {
+        _chr  = _chr_avx2;
+        _str  = _str_avx2;
+        _impl = "avx2";
+    }
+    else {
+        _chr  = _chr_sse2;
+        _str  = _str_sse2;
+        _impl = "sse2";
+    }
+#elif defined(STRK_NEON)
+    _chr  = _chr_neon;
+    _str  = _str_neon;
+    _impl = "neon";
+#else
+    _chr  = _chr_scalar;
+    _str  = _str_scalar;
+    _impl = "scalar";
+#endif
+    extradebug("strkern: using %s string kernels\n", _impl);
+}
+
+
+static const char *
+_chr_resolve(const char *s, size_t len, int c)
+{
+    _resolve();
+    return _chr(s, len, c);
+}
+
+
+static const char *
+_str_resolve(const char *hay, size_t hlen, const char *needle, size_t nlen)
+{
+    _resolve();
+    return _str(hay, hlen, needle, nlen);
+}
+
+
+/**
+ * function: strkInit
+ *
+ * Pick the kernels now.  Call before starting threads that use them, so
+ * the first-call switch is never raced.
+ */
+void
+strkInit(void)
+{
+    if ( _chr_resolve == _chr ) {
+        _resolve();
+    }
+}
+
+
+/**
+ * function: strkChr
+ *
+ * First c in s[0, len), or NULL.
+ */
+const char *
+strkChr(const char *s, size_t len, int c)
+{
+    return _chr(s, len, c);
+}
+
+
+/**
+ * function: strkStr
+ *
+ * First needle[0, nlen) that fits entirely inside hay[0, hlen), or NULL.
+ * An empty needle matches at hay.
+ */
+const char *
+strkStr(const char *hay, size_t hlen, const char *needle, size_t nlen)
+{
+    if ( 0 == nlen ) {
+        return hay;
+    }
+    if ( nlen > hlen ) {
+        return NULL;
+    }
+    if ( 1 == nlen ) {
+        return _chr(hay, hlen, needle[0]);
+    }
+    return _str(hay, hlen, needle, nlen);
+}
+
+
+static int
+_hexval(char c)
+{
+    if ( ( '0' <= c ) && ( '9' >= c ) ) {
+        return c - '0';
+    }
+    if ( ( 'a' <= c ) && ( 'f' >= c ) ) {
+        return c - 'a' + 10;
+    }
+    if ( ( 'A' <= c ) && ( 'F' >= c ) ) {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+
+/**
+ * function: strkPercentDecode
+ * s, len: the string, decoded in place and NUL terminated
+ * decoded: set to the number of %xx sequences replaced
+ * firstbad: set to the (decoded) offset of the first '%' that is not
+ *           followed by two hex digits, or -1.  Those are left as is.
+ *
+ * One pass, the output never overtakes the input.  Returns the new length.
+ */
+size_t
+strkPercentDecode(char *s, size_t len, int *decoded, long *firstbad)
+{
+    const char *in  = s;
+    const char *end = s + len;
+    const char *pct = NULL;
+    char       *out = s;
+    int      hi, lo = 0;
+
+    *decoded  = 0;
+    *firstbad = -1;
+
+    while ( in < end ) {
+        if ( NULL == ( pct = _chr(in, end - in, '%') ) ) {
+            pct = end;
+        }
+        if ( out != in ) {
+            memmove(out, in, pct - in);
+        }
+        out += pct - in;
+        in   = pct;
+        if ( in >= end ) {
+            break;
+        }
+        if (   ( 3 <= ( end - in ) )
+            && ( 0 <= ( hi = _hexval(in[1]) ) )
+            && ( 0 <= ( lo = _hexval(in[2]) ) ) ) {
+            *out++ = (char)( ( hi << 4 ) | lo );
+            in += 3;
+            (*decoded)++;
+        }
+        else {
+            if ( 0 > *firstbad ) {
+                *firstbad = out - s;
+            }
+            *out++ = *in++;
+        }
+    }
+    *out = '\0';
+    return out - s;
+}
+
+
+/**
+ * function: strkDigits
+ *
+ * 1 if s is one or more ASCII digits and nothing else.
+ */
+int
+strkDigits(const char *s)
+{
+    if ( ( '0' > *s ) || ( '9' < *s ) ) {
+        return 0;
+    }
+    while ( ( '0' <= *s ) && ( '9' >= *s ) ) {
+        s++;
+    }
+    return ( '\0' == *s );
+}
+
+
+/**
+ * function: strkHash
+ *
+ * 64 bit hash of s[0, len), four independent multiply-xor lanes over 8
+ * byte words, a few GB/s.  Only has to notice that bytes changed (cache
+ * and stamp keys), not resist anyone.
+ */
+uint64_t
+strkHash(const char *s, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)s;
+    const uint64_t       k = 0x9E3779B97F4A7C15ull;
+    uint64_t          h[4] = { k, k ^ 1, k ^ 2, k ^ 3 };
+    uint64_t             w = 0;
+    uint64_t           out = (uint64_t)len;
+    int                 cx = 0;
+
+    for ( ; 32 <= len; p += 32, len -= 32 ) {
+        for ( cx = 0; cx < 4; cx++ ) {
+            memcpy(&w, p + cx * 8, 8);
+            h[cx]  = ( h[cx] ^ w ) * k;
+            h[cx] ^= h[cx] >> 31;
+        }
+    }
+    for ( ; len; p++, len-- ) {
+        h[0] = ( h[0] ^ *p ) * k;
+    }
+    for ( cx = 0; cx < 4; cx++ ) {
+        out  = ( out ^ h[cx] ) * k;
+        out ^= out >> 29;
+    }
+    return out;
+}
+
+
+/**
+ * vim: sw=4 ts=4 expandtab
+ * EOF: strkern.c
+ */
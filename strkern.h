@@ -0,0 +1,33 @@
+/****************************************************************************
+ * File: strkern.h
+ *
+ * Length based string scanning kernels (strkern.c), used by utils.c.
+ *
+ * Copyright (c) 2019-2024, Gary Allen Vollink.  http://voll.ink/playlister
+ * All rights reserved.
+ *
+ * Licence to use, see LICENSE file in this distribution.
+ */
+#ifndef STRKERN_H
+#define STRKERN_H 1
+#include <stddef.h>
+#include <stdint.h>
+
+/****
+ * None of these stop at a NUL, every length is a byte count the caller
+ * already knows.  Vector widths are picked once, at the first call.
+ */
+const char * strkChr          (const char *s, size_t len, int c);
+const char * strkStr          (const char *hay, size_t hlen
+                                , const char *needle, size_t nlen);
+size_t       strkPercentDecode(char *s, size_t len
+                                , int *decoded, long *firstbad);
+int          strkDigits       (const char *s);
+void         strkInit         (void);
+uint64_t     strkHash         (const char *s, size_t len);
+
+#endif /* STRKERN_H */
+/**
+ * vim: sw=4 ts=4 expandtab
+ * EOF: strkern.h
+ */
@@ -0,0 +1,81 @@
+#!/usr/bin/env python3
+#############################################################################
+# musicdb-fixture.py
+#
+# Write the XML test library as an unencrypted Library.musicdb, in the
+# record layout reader4.c reads (see the comment at the top of reader4.c).
+# Only the fields playlister uses are written.  With --zlib the records
+# are compressed, as Music.app does after the header.
+#
+#   python3 musicdb-fixture.py 'iTunes Music Library.xml' out.musicdb [--zlib]
+#
+# Copyright (c) 2019-2024, Gary Allen Vollink.  http://voll.ink/playlister
+# All rights reserved.
+#
+# Licence to use, see LICENSE file in this distribution.
+#############################################################################
+import plistlib
+import struct
+import sys
+import zlib
+
+HEADER = 104
+TRACK_STRINGS = [
+    (0x02, 'Name', 1),
+    (0x03, 'Album', 1),
+    (0x04, 'Artist', 1),
+    (0x05, 'Genre', 1),
+    (0x06, 'Kind', 1),
+    (0x0B, 'Location', 2),
+    (0x1B, 'Album Artist', 1),
+]
+
+
+def boma(subtype, text, encoding):
+    data = text.encode('utf-16-le' if 1 == encoding else 'utf-8')
+    return (b'boma' + struct.pack('<IIIIII', 0x14, 36 + len(data), subtype
+            , 0, encoding, len(data)) + bytes(8) + data)
+
+
+def record(tag, hlen, fields, body=b''):
+    head = tag + struct.pack('<II', hlen, hlen + len(body))
+    for offset, fmt, value in fields:
+        head = head.ljust(offset, b'\0') + struct.pack(fmt, value)
+    return head.ljust(hlen, b'\0') + body
+
+
+def section(kind, tag, items):
+    body = record(tag, 92, [(8, '<I', len(items))]) + b''.join(items)
+    return record(b'hsma', 96, [(12, '<I', kind)], body)
+
+
+def main(xml, out, compress):
+    library = plistlib.load(open(xml, 'rb'))
+    pid = {}
+    tracks = []
+    for trid, track in library['Tracks'].items():
+        pid[int(trid)] = int(track['Persistent ID'], 16)
+        body = b''.join(boma(sub, track[key], enc)
+                        for sub, key, enc in TRACK_STRINGS if key in track)
+        tracks.append(record(b'itma', 96
+                             , [(16, '<Q', pid[int(trid)])], body))
+    lists = []
+    for plist in library['Playlists']:
+        items = [record(b'ipfa', 76, [(24, '<Q', pid[item['Track ID']])])
+                 for item in plist.get('Playlist Items', [])]
+        body = boma(0xC8, plist['Name'], 1) + b''.join(items)
+        lists.append(record(b'lpma', 184
+                            , [(30, '<Q', int(plist['Playlist Persistent ID']
+                                               , 16))], body))
+    payload = section(1, b'ltma', tracks) + section(2, b'lPma', lists)
+    if compress:
+        payload = zlib.compress(payload, 9)
+    header = (b'hfma' + struct.pack('<II', HEADER, HEADER + len(payload))
+              ).ljust(HEADER, b'\0')
+    open(out, 'wb').write(header + payload)
+
+
+if __name__ == '__main__':
+    main(sys.argv[1], sys.argv[2], '--zlib' in sys.argv[3:])
+
+# EOF: musicdb-fixture.py
@@ -9,11 +9,12 @@ usage(char *self)
 {
     printf("%s\n", "This is for testing internal string utils.");
     printf("\n");
-    printf("%s %s\n", self, "0|1|2");
+    printf("%s %s\n", self, "0|1|2|3");
     printf("\n");
     printf("%s\n", "   0  Pre-Tests String (not a test)");
     printf("%s\n", "   1  Tests URIunescape");
     printf("%s\n", "   2  Tests removeString");
+    printf("%s\n", "   3  Tests a Location through unescape, strip, prepend");
     return;
 }
 
@@ -22,13 +23,25 @@ main(int argc, char *argv[])
 {
     Opts.verbose = 0;
 
-    char string[47] = "This is a test%3b%20a string with%20escapes%2E\n";
+    char string[48] = "This is a test%3b%20a string with%20escapes%2E\n";
 
     if ( 2 != argc ) {
         usage(argv[0]);
         exit(1);
     }
 
+    if ( '3' == *argv[1] ) {
+        // Long enough for the vector paths, with a %25 and stray %s.
+        char loc[256] = "file://localhost/Music/A%20Long%20Folder%20Name"
+                        "%20For%20Vectors/100%25%zz%4";
+        URIunescape(loc);
+        removeString(loc, "file://localhost", 256);
+        removeString(loc, "/Music/", 256);
+        prependString(loc, "/mnt/", 256);
+        printf("%s\n", loc);
+        exit(0);
+    }
+
     if ( '0' == *argv[1] ) {
         printf("%s", string);
         exit(0);
@@ -15,66 +15,700 @@
 #include <sys/stat.h> // stat
 #include <sys/errno.h> // errno
 #include <string.h> // strerror
+#include <stdint.h> // UINT32_MAX
 #include <regex.h> // POSIX Regular Expressions
 #include "utils.h"
+#include "strkern.h"
 #include "options.h"
 #include "storage.h"
+#include "cache.h"
 
-struct trackmap    *track = NULL;
+__thread struct tracktab  track;
+__thread struct strarena  track_strings;
+__thread struct interntab track_syms;
 
+/****
+ * The slot _set_track last stored to.  One track's values all arrive
+ * together, so this saves the lookup for every value after the first.
+ */
+static __thread int track_last = -1;
+
+/****
+ * The <key>s _set_track stores for this run, see trackProject().
+ * set_node skips the value of every other track key without reading it.
+ */
+static unsigned char track_fields[K_COUNT];
+
+/****************************************************************************
+ * Decide which track fields the output needs.  Location always; the
+ * #EXTINF fields only if some device (or some list) writes extm3u; the
+ * rest only for the trackInfo() dump.
+ */
 void
-_set_track(int trid,  char* name, char* value)
+trackProject()
 {
-    struct trackmap *work;
-    HASH_FIND_INT(track, &trid, work);
-    if ( NULL == work ) {
-        work = malloc( sizeof(struct trackmap) );
-        if ( NULL == work ) {
+    int extended = 0;
+    int incremental = 0;
+
+    memset(track_fields, 0, sizeof(track_fields));
+    track_fields[K_LOCATION] = 1;
+
+    columnProject();
+    for ( int key = 0; key < K_COUNT; key++ ) {
+        if ( 0 <= columnIndex(key) ) {
+            track_fields[key] = 1;
+        }
+    }
+
+    for ( struct options *dev = (struct options *) utarray_front(Devices)
+        ; dev != NULL
+        ; dev = (struct options *) utarray_next(Devices, dev)
+        ) {
+        if ( dev->m3uextended ) {
+            extended = 1;
+        }
+        if ( ( dev->incremental ) && ( CACHE_OFF != dev->cache ) ) {
+            incremental = 1;
+        }
+        for ( struct listopts * lo
+                = (struct listopts *) utarray_front(dev->playlist)
+            ; lo != NULL
+            ; lo = (struct listopts *) utarray_next(dev->playlist, lo)
+            ) {
+            if ( 1 == lo->m3uextended ) {
+                extended = 1;
+            }
+        }
+    }
+    if ( ( extended ) || ( 5 <= Opts.verbose ) ) {
+        track_fields[K_NAME]         = 1;
+        track_fields[K_TOTAL_TIME]   = 1;
+        track_fields[K_ARTIST]       = 1;
+        track_fields[K_ALBUM_ARTIST] = 1;
+    }
+    if ( 5 <= Opts.verbose ) {
+        track_fields[K_ALBUM]        = 1;
+    }
+    if ( incremental ) {
+        track_fields[K_PERSISTENT_ID] = 1;
+        track_fields[K_DATE_MODIFIED] = 1;
+    }
+    extradebug("trackProject: %s track fields\n"
+            , ( track_fields[K_NAME] ? "#EXTINF" : "Location only" ));
+}
+
+int
+want_track_key(enum itunesKey key)
+{
+    return track_fields[key];
+}
+
+/****************************************************************************
+ * Where Track ID trid lives in tab->slot (or would go).
+ */
+static uint32_t *
+_id_slot(struct tracktab *tab, int trid)
+{
+    uint32_t mask = tab->slots - 1;
+    uint32_t cx   = ( (uint32_t)trid * 2654435761u ) & mask;
+
+    while ( ( tab->slot[cx] ) && ( tab->rec[tab->slot[cx] - 1].id != trid ) ) {
+        cx = ( cx + 1 ) & mask;
+    }
+    return &tab->slot[cx];
+}
+
+/****************************************************************************
+ * Records for at least n tracks, and a lookup at most half full with n.
+ */
+static void
+_track_room(struct tracktab *tab, uint32_t n)
+{
+    struct trackmap *grow  = NULL;
+    uint32_t        *slots = NULL;
+    uint32_t         size  = 0;
+
+    if ( n > tab->size ) {
+        if ( NULL == ( grow = realloc(tab->rec
+                        , n * sizeof(struct trackmap)) ) ) {
+            mydebug("st:Unable to allocate %ld bytes of space: %s\n",
+                    n * sizeof(struct trackmap), strerror(errno));
+            exit(2);
+        }
+        tab->rec  = grow;
+        tab->size = n;
+    }
+    if ( n * 2 > tab->slots ) {
+        size = ( tab->slots ? tab->slots * 2 : 2048 );
+        while ( n * 2 > size ) {
+            size *= 2;
+        }
+        if ( NULL == ( slots = calloc(size, sizeof(uint32_t)) ) ) {
             mydebug("st:Unable to allocate %ld bytes of space: %s\n",
-                    sizeof(struct trackmap), strerror(errno));
-            exit(-2);
+                    size * sizeof(uint32_t), strerror(errno));
+            exit(2);
         }
-        memset((void *)work, 0, sizeof(struct trackmap));
-        work->id = trid;
-        HASH_ADD_INT(track, id, work);
+        free(tab->slot);
+        tab->slot  = slots;
+        tab->slots = size;
+        for ( uint32_t cx = 0; cx < tab->count; cx++ ) {
+            *_id_slot(tab, tab->rec[cx].id) = cx + 1;
+        }
+    }
+}
+
+/****************************************************************************
+ * Room for one more track.
+ */
+static void
+_track_reserve(struct tracktab *tab)
+{
+    if ( tab->count == tab->size ) {
+        _track_room(tab, ( tab->size ? tab->size * 2 : 1024 ));
+    }
+}
+
+/****************************************************************************
+ * The slot of Track ID trid, or -1.
+ */
+int
+trackSlot(int trid)
+{
+    if ( 0 == track.count ) {
+        return -1;
+    }
+    return (int)*_id_slot(&track, trid) - 1;
+}
+
+struct trackmap *
+trackAt(int slot)
+{
+    return &track.rec[slot];
+}
+
+/****************************************************************************
+ * The track with this Track ID, created (empty) if it isn't stored yet.
+ */
+struct trackmap *
+trackAdd(int trid)
+{
+    uint32_t *slot = NULL;
+
+    if ( ( 0 <= track_last ) && ( trid == track.rec[track_last].id ) ) {
+        return &track.rec[track_last];
+    }
+    _track_reserve(&track);
+    slot = _id_slot(&track, trid);
+    if ( 0 == *slot ) {
+        memset((void *)&track.rec[track.count], 0, sizeof(struct trackmap));
+        track.rec[track.count].id = trid;
+        *slot = ++track.count;
         Stats.tracks++;
     }
-    if (0 == str_diffn("Name", name, 5) ) {
-        strncpy(work->name, value, 1024);
+    track_last = *slot - 1;
+    return &track.rec[track_last];
+}
+
+/****************************************************************************
+ * Was this track copied from the last snapshot?  Then set_node skips the
+ * rest of its values unread.
+ */
+int
+trackReused(int trid)
+{
+    return ( ( 0 <= track_last ) && ( trid == track.rec[track_last].id )
+            && ( 0 != track.rec[track_last].previd ) );
+}
+
+/****************************************************************************
+ * A stored track string, "" for one never set.  The pointer is only good
+ * until the next trackStrSet() on this thread (the arena may move).
+ */
+const char *
+trackStr(struct trackstr str)
+{
+    return ( NULL == track_strings.buf ) ? "" : track_strings.buf + str.off;
+}
+
+/****************************************************************************
+ * Make the arena newsz bytes (never less than it holds).
+ */
+static void
+_arena_resize(struct strarena *arena, size_t newsz)
+{
+    char *grow = NULL;
+
+    if ( NULL == ( grow = realloc(arena->buf, newsz) ) ) {
+        mydebug("st:Unable to allocate %ld bytes of space: %s\n",
+                newsz, strerror(errno));
+        exit(2);
     }
-    else if (0 == str_diffn("Total Time", name, 11) ) {
-        work->time = atoi(value);
+    if ( NULL == arena->buf ) {
+        grow[0] = '\0';    // offset 0, every empty field
+        arena->used = 1;
     }
-    else if (0 == str_diffn("Location", name, 6) ) {
-        URIunescape(value);
-        strncpy(work->file, value, 1024);
+    arena->buf  = grow;
+    arena->size = newsz;
+}
+
+/****************************************************************************
+ * Store value (len bytes, without the NUL) in this thread's arena, for a
+ * field of a track.  Setting a field again leaves the old copy unused.
+ */
+void
+trackStrSet(struct trackstr *str, const char *value, size_t len)
+{
+    struct strarena *arena = &track_strings;
+    size_t           newsz = 0;
+
+    if ( 0 == len ) {
+        str->off = 0;
+        str->len = 0;
+        return;
     }
-    else if (0 == str_diffn("Album", name, 6) ) {
-        strncpy(work->album, value, 1024);
+    if ( arena->used + len + 1 > arena->size ) {
+        newsz = ( arena->size ? arena->size * 2 : 65536 );
+        while ( arena->used + len + 1 > newsz ) {
+            newsz *= 2;
+        }
+        if ( UINT32_MAX < newsz ) {
+            newsz = UINT32_MAX;
+            if ( arena->used + len + 1 > newsz ) {
+                myfatal("Track strings need more than 4 GB.\n");
+                exit(2);
+            }
+        }
+        _arena_resize(arena, newsz);
+    }
+    memcpy(arena->buf + arena->used, value, len);
+    arena->buf[arena->used + len] = '\0';
+    str->off = (uint32_t)arena->used;
+    str->len = (uint32_t)len;
+    arena->used += len + 1;
+}
+
+/****************************************************************************
+ * Double the slots (and set up an empty table, symbol 0 being "").
+ */
+static void
+_intern_grow(struct interntab *tab)
+{
+    uint32_t  slots = ( tab->slots ? tab->slots * 2 : 1024 );
+    uint32_t *grow  = NULL;
+    uint32_t  cx    = 0;
+    uint32_t  sx    = 0;
+
+    if ( NULL == tab->sym ) {
+        tab->size = 1024;
+        if ( NULL == ( tab->sym = malloc(tab->size
+                        * sizeof(struct trackstr)) ) ) {
+            mydebug("st:Unable to allocate %ld bytes of space: %s\n",
+                    tab->size * sizeof(struct trackstr), strerror(errno));
+            exit(2);
+        }
+        memset(&tab->sym[0], 0, sizeof(struct trackstr));
+        tab->count = 1;
     }
-    else if (0 == str_diffn("Album Artist", name, 13) ) {
-        // Always prefer the Album Artist.
-        strncpy(work->artist, value, 1024);
+    if ( NULL == ( grow = calloc(slots, sizeof(uint32_t)) ) ) {
+        mydebug("st:Unable to allocate %ld bytes of space: %s\n",
+                slots * sizeof(uint32_t), strerror(errno));
+        exit(2);
     }
-    else if (  (0 == str_diffn("Artist", name, 7))
-            && (0 == strlen(work->artist))
-        ) {
-        // Always prefer the Album Artist over Artist.
-        strncpy(work->artist, value, 1024);
+    for ( cx = 1; cx < tab->count; cx++ ) {
+        sx = (uint32_t)strkHash(track_strings.buf + tab->sym[cx].off
+                , tab->sym[cx].len) & ( slots - 1 );
+        while ( grow[sx] ) {
+            sx = ( sx + 1 ) & ( slots - 1 );
+        }
+        grow[sx] = cx + 1;
     }
+    free(tab->slot);
+    tab->slot  = grow;
+    tab->slots = slots;
+}
+
+/****************************************************************************
+ * The slot holding value, or the free slot it would go in.  The table
+ * must have room (see _intern_grow).
+ */
+static uint32_t *
+_intern_slot(struct interntab *tab, const char *value, size_t len)
+{
+    const struct trackstr *str = NULL;
+    uint32_t mask = tab->slots - 1;
+    uint32_t cx   = (uint32_t)strkHash(value, len) & mask;
+
+    while ( tab->slot[cx] ) {
+        str = &tab->sym[tab->slot[cx] - 1];
+        if (   ( str->len == len )
+            && ( 0 == memcmp(track_strings.buf + str->off, value, len) ) ) {
+            break;
+        }
+        cx = ( cx + 1 ) & mask;
+    }
+    return &tab->slot[cx];
+}
+
+/****************************************************************************
+ * Number str (already in the arena) as a new symbol, in the free *slot.
+ */
+static uint32_t
+_intern_new(struct interntab *tab, uint32_t *slot, struct trackstr str)
+{
+    struct trackstr *grow = NULL;
+
+    if ( tab->count == tab->size ) {
+        if ( NULL == ( grow = realloc(tab->sym, tab->size * 2
+                        * sizeof(struct trackstr)) ) ) {
+            mydebug("st:Unable to allocate %ld bytes of space: %s\n",
+                    tab->size * 2 * sizeof(struct trackstr), strerror(errno));
+            exit(2);
+        }
+        tab->sym   = grow;
+        tab->size *= 2;
+    }
+    tab->sym[tab->count] = str;
+    *slot = ++tab->count;
+    return tab->count - 1;
+}
+
+/****************************************************************************
+ * The symbol for value (len bytes), storing it if it is new.
+ */
+uint32_t
+trackIntern(const char *value, size_t len)
+{
+    struct interntab *tab  = &track_syms;
+    struct trackstr   str;
+    uint32_t         *slot = NULL;
+
+    if ( 0 == len ) {
+        return 0;
+    }
+    if ( tab->count * 2 >= tab->slots ) {
+        _intern_grow(tab);
+    }
+    tab->refs++;
+    slot = _intern_slot(tab, value, len);
+    if ( *slot ) {
+        tab->saved += len + 1;
+        return *slot - 1;
+    }
+    trackStrSet(&str, value, len);
+    return _intern_new(tab, slot, str);
+}
+
+/****************************************************************************
+ * Room for syms symbols, the slots at most half full.
+ */
+static void
+_intern_room(struct interntab *tab, uint32_t syms)
+{
+    struct trackstr *grow = NULL;
+
+    if ( NULL == tab->sym ) {
+        _intern_grow(tab);
+    }
+    if ( syms > tab->size ) {
+        if ( NULL == ( grow = realloc(tab->sym
+                        , syms * sizeof(struct trackstr)) ) ) {
+            mydebug("st:Unable to allocate %ld bytes of space: %s\n",
+                    syms * sizeof(struct trackstr), strerror(errno));
+            exit(2);
+        }
+        tab->sym  = grow;
+        tab->size = syms;
+    }
+    while ( syms * 2 > tab->slots ) {
+        _intern_grow(tab);
+    }
+}
+
+/****************************************************************************
+ * Presize this thread's tables for about tracks tracks and strings bytes
+ * of their text (see storageEstimate), so reading need not grow them.
+ * Artists and albums are guessed at one distinct value per 8 tracks.
+ */
+void
+trackReserve(long tracks, size_t strings)
+{
+    if ( 0 >= tracks ) {
+        return;
+    }
+    if ( ( UINT32_MAX / 4 ) < tracks ) {
+        tracks = UINT32_MAX / 4;
+    }
+    if ( UINT32_MAX < strings ) {
+        strings = UINT32_MAX;
+    }
+    _track_room(&track, (uint32_t)tracks);
+    if ( strings > track_strings.size ) {
+        _arena_resize(&track_strings, strings);
+    }
+    _intern_room(&track_syms, (uint32_t)( tracks / 8 ));
+}
+
+const char *
+trackSym(uint32_t sym)
+{
+    if ( sym >= track_syms.count ) {
+        return "";
+    }
+    return trackStr(track_syms.sym[sym]);
+}
+
+/****************************************************************************
+ * Date Modified (2019-02-13T04:53:29Z) as the number 20190213045329, which
+ * orders and compares the same way.
+ */
+static uint64_t
+_date_key(const char *value)
+{
+    uint64_t key = 0;
+
+    for ( ; *value; value++ ) {
+        if ( ( '0' <= *value ) && ( '9' >= *value ) ) {
+            key = ( key * 10 ) + ( *value - '0' );
+        }
+    }
+    return key;
+}
+
+void
+_set_track(int trid, enum itunesKey key, char* value)
+{
+    struct trackmap *work = trackAdd(trid);
+
+    columnSet((uint32_t)( work - track.rec ), key, value);
+    switch ( key ) {
+        case K_NAME:
+            trackStrSet(&work->name, value, strlen(value));
+            break;
+        case K_TOTAL_TIME:
+            work->time = atoi(value);
+            break;
+        case K_LOCATION:
+            URIunescape(value);
+            trackStrSet(&work->file, value, strlen(value));
+            break;
+        case K_ALBUM:
+            work->album = trackIntern(value, strlen(value));
+            break;
+        case K_ALBUM_ARTIST:
+            // Always prefer the Album Artist.
+            work->artist = trackIntern(value, strlen(value));
+            break;
+        case K_ARTIST:
+            // Always prefer the Album Artist over Artist.
+            if ( 0 == work->artist ) {
+                work->artist = trackIntern(value, strlen(value));
+            }
+            break;
+        case K_PERSISTENT_ID:
+            work->pid = strtoull(value, NULL, 16);
+            if ( work->modified ) {
+                cacheReuse(work);
+            }
+            break;
+        case K_DATE_MODIFIED:
+            work->modified = _date_key(value);
+            if ( work->pid ) {
+                cacheReuse(work);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/****************************************************************************
+ * Move every track in *from (a worker's table) to the end of track, its
+ * strings to the end of track_strings and its symbols into track_syms.
+ * A Track ID already here is kept and the newcomer dropped; returns how
+ * many were dropped.
+ */
+static void
+_rebase(struct trackstr *str, uint32_t base)
+{
+    if ( str->len ) {
+        str->off += base;
+    }
+}
+
+/****************************************************************************
+ * Worker symbol -> symbol here, for a worker whose strings were just
+ * appended at base.  A string new here is numbered where it lies.
+ */
+static uint32_t *
+_intern_merge(struct interntab *syms, uint32_t base)
+{
+    struct interntab *tab = &track_syms;
+    struct trackstr   str;
+    uint32_t         *map = NULL;
+    uint32_t         *slot = NULL;
+
+    if ( NULL == ( map = calloc(syms->count + 1, sizeof(uint32_t)) ) ) {
+        mydebug("st:Unable to allocate %ld bytes of space: %s\n",
+                ( syms->count + 1 ) * sizeof(uint32_t), strerror(errno));
+        exit(2);
+    }
+    for ( uint32_t cx = 1; cx < syms->count; cx++ ) {
+        if ( tab->count * 2 >= tab->slots ) {
+            _intern_grow(tab);
+        }
+        str = syms->sym[cx];
+        str.off += base;
+        slot = _intern_slot(tab, track_strings.buf + str.off, str.len);
+        map[cx] = ( *slot ) ? *slot - 1 : _intern_new(tab, slot, str);
+    }
+    tab->refs  += syms->refs;
+    tab->saved += syms->saved;
+    return map;
+}
+
+static void
+_intern_free(struct interntab *tab)
+{
+    free(tab->slot);
+    free(tab->sym);
+    memset(tab, 0, sizeof(struct interntab));
+}
+
+int
+trackMerge(struct tracktab *from, struct strarena *strings
+        , struct interntab *syms, struct coltab *cols)
+{
+    struct trackmap *curtrk = NULL;
+    char            *grow = NULL;
+    uint32_t        *map  = NULL;
+    uint32_t        *slot = NULL;
+    uint32_t     *slotmap = NULL;
+    size_t           base = track_strings.used;
+    int dups = 0;
+
+    if (   ( 0 == track.count ) && ( 1 >= track_strings.used )
+        && ( from->size >= track.size ) ) {
+        // Nothing here yet (the ring.c storage thread), take it whole.
+        free(track.rec);
+        free(track.slot);
+        track = *from;
+        memset(from, 0, sizeof(struct tracktab));
+        free(track_strings.buf);
+        track_strings = *strings;
+        memset(strings, 0, sizeof(struct strarena));
+        _intern_free(&track_syms);
+        track_syms = *syms;
+        memset(syms, 0, sizeof(struct interntab));
+        columnMerge(cols, NULL, 0, NULL);
+        track_last = -1;
+        return 0;
+    }
+    if ( strings->used ) {
+        if ( UINT32_MAX < base + strings->used ) {
+            myfatal("Track strings need more than 4 GB.\n");
+            exit(2);
+        }
+        if ( base + strings->used > track_strings.size ) {
+            grow = realloc(track_strings.buf, base + strings->used);
+            if ( NULL == grow ) {
+                mydebug("st:Unable to allocate %ld bytes of space: %s\n",
+                        base + strings->used, strerror(errno));
+                exit(2);
+            }
+            track_strings.buf  = grow;
+            track_strings.size = base + strings->used;
+        }
+        memcpy(track_strings.buf + base, strings->buf, strings->used);
+        track_strings.used = base + strings->used;
+    }
+    free(strings->buf);
+    memset(strings, 0, sizeof(struct strarena));
+    map = _intern_merge(syms, (uint32_t)base);
+    _intern_free(syms);
+    if ( ( cols->count ) && ( NULL == ( slotmap
+                    = malloc(( from->count + 1 ) * sizeof(uint32_t)) ) ) ) {
+        mydebug("st:Unable to allocate %ld bytes of space: %s\n",
+                ( from->count + 1 ) * sizeof(uint32_t), strerror(errno));
+        exit(2);
+    }
+
+    for ( uint32_t cx = 0; cx < from->count; cx++ ) {
+        curtrk = &from->rec[cx];
+        _track_reserve(&track);
+        slot = _id_slot(&track, curtrk->id);
+        if ( *slot ) {
+            mywarning("Track ID %i appears twice, keeping the first\n"
+                    , curtrk->id);
+            dups++;
+            if ( slotmap ) {
+                slotmap[cx] = UINT32_MAX;
+            }
+            continue;
+        }
+        if ( slotmap ) {
+            slotmap[cx] = track.count;
+        }
+        track.rec[track.count] = *curtrk;
+        curtrk = &track.rec[track.count];
+        *slot = ++track.count;
+        _rebase(&curtrk->file, (uint32_t)base);
+        _rebase(&curtrk->name, (uint32_t)base);
+        curtrk->album  = map[curtrk->album];
+        curtrk->artist = map[curtrk->artist];
+    }
+    if ( slotmap ) {
+        columnMerge(cols, slotmap, from->count, map);
+        free(slotmap);
+    }
+    free(map);
+    free(from->rec);
+    free(from->slot);
+    memset(from, 0, sizeof(struct tracktab));
+    track_last = -1;
+    return dups;
+}
+
+/****************************************************************************
+ * Bytes held by the track table: records (with the Track ID lookup and
+ * the symbol table) and the string arena, for storageInfo().
+ */
+void
+trackUsage(size_t *records, size_t *strings)
+{
+    *records = track.size * sizeof(struct trackmap)
+             + track.slots * sizeof(uint32_t)
+             + track_syms.slots * sizeof(uint32_t)
+             + track_syms.size * sizeof(struct trackstr);
+    *strings = track_strings.size;
+}
+
+/****************************************************************************
+ * -v -v -v: how much interning saved.
+ */
+void
+trackInternInfo()
+{
+    superdebug("sI:  Interned: %u distinct artist/album values"
+            " for %ld references, %ld bytes not stored again\n"
+            , ( track_syms.count ? track_syms.count - 1 : 0 )
+            , (long)track_syms.refs, (long)track_syms.saved);
 }
 
 void
 trackInfo()
 {
-    struct trackmap *curtrk, *ttmp;
+    struct trackmap *curtrk = NULL;
+
     if ( 5 <= Opts.verbose ) {
-        HASH_ITER(hh, track, curtrk, ttmp) {
-            printf("tI: %i (%i) %s/%s/%s %s\n"
+        for ( uint32_t cx = 0; cx < track.count; cx++ ) {
+            curtrk = &track.rec[cx];
+            printf("tI: %i (%i) %s/%s/%s %s"
                 , curtrk->id, curtrk->time
-                , curtrk->artist, curtrk->album
-                , curtrk->name, curtrk->file
+                , trackSym(curtrk->artist), trackSym(curtrk->album)
+                , trackStr(curtrk->name), trackStr(curtrk->file)
                 );
+            columnPrint(cx);
+            printf("\n");
         }
     }
 }
@@ -82,11 +716,14 @@ trackInfo()
 void
 trackFree()
 {
-    struct trackmap *curtrk, *ttmp;
-    HASH_ITER(hh, track, curtrk, ttmp) {
-        HASH_DEL(track, curtrk);
-        free(curtrk);
-    }
+    track_last = -1;
+    free(track.rec);
+    free(track.slot);
+    memset(&track, 0, sizeof(struct tracktab));
+    free(track_strings.buf);
+    memset(&track_strings, 0, sizeof(struct strarena));
+    _intern_free(&track_syms);
+    columnFree(&track_cols);
 }
 /**
  * vim: sw=4 ts=4 expandtab
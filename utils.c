@@ -15,8 +15,8 @@
 #include <sys/types.h>   // stat
 #include <sys/stat.h>    // stat
 #include <stdarg.h>      // va_args (wrapping fprintf)
-#include <regex.h>       // POSIX Regular Expressions
 #include "utils.h"
+#include "strkern.h"
 #include "options.h"
 
 const char * const LogString[] = {
@@ -47,12 +47,9 @@ replaceString(char *str, const char *search, const char *replace, size_t max)
 {
     char     *fname = "replaceString";
     char   *findptr = NULL;
-    char    *buffer = NULL;
     size_t  lenorig = str_len(str);
     size_t  lensrch = str_len(search);
     size_t  lenrplc = str_len(replace);
-    size_t  lentail = 0;
-    size_t  lengrow = 0;
 
     superdebug("%s: Start\n[%s]\nsearch=[%s]\nreplace=[%s]\nmax=[%li]\n"
                 , fname, str, search, replace, max);
@@ -63,26 +60,15 @@ replaceString(char *str, const char *search, const char *replace, size_t max)
         return NULL;
     }
 
-    if ( NULL == ( findptr = str_strn(str, search, lenorig) ) ) {
-        superdebug("%s: str_strn reported not found.\n", fname);
+    if ( NULL == ( findptr = (char *) strkStr(str, lenorig, search, lensrch) ) ) {
+        superdebug("%s: strkStr reported not found.\n", fname);
         return str;
     }
 
-    if ( NULL == ( buffer = malloc(max) ) ) {
-        mywarning("%s: Unable to allocate buffer size, %lli: %s\n"
-                , fname, max, strerror(errno));
-        return NULL;
-    }
-
-    lengrow = (findptr - str);
-    lentail = (lengrow + lensrch);
-    strncpy( buffer, str, lengrow );
-    strncpy( buffer+lengrow, replace, lenrplc );
-    lengrow = (lengrow + lenrplc);
-    strncpy( buffer+lengrow, str+lentail, (max - lengrow) );
-    memset(str, 0, max);
-    strncpy( str, buffer, max );
-    free(buffer);
+    // Shift the tail (and its NUL) once, then drop the replacement in.
+    memmove( findptr + lenrplc, findptr + lensrch
+            , lenorig - ( findptr - str ) - lensrch + 1 );
+    memcpy( findptr, replace, lenrplc );
     return findptr;
 }
 
@@ -90,60 +76,20 @@ replaceString(char *str, const char *search, const char *replace, size_t max)
 int
 URIunescape(char *str)
 {
-    char  buffer[BUFSIZ] = "\0\0\0\0\0\0\0\0";
-    char buffer2[BUFSIZ] = "\0\0\0\0\0\0\0\0";
-    char        *findptr = NULL;
-    char       *startptr = str;
-    int            repcx = 0;
-    int          charhex = 0;
-    int            rxret = 0;
-    regex_t      percnum;
-
-    /* Compile regular expression */
-    rxret = regcomp(&percnum, "%[a-f0-9][a-f0-9]"
-                    , REG_ICASE|REG_EXTENDED|REG_NOSUB);
-    if (rxret) {
-        fprintf(stderr, "Could not compile regex\n");
-        exit(5);
-    }
+    char  buffer2[BUFSIZ] = "\0\0\0\0\0\0\0\0";
+    int           repcx = 0;
+    long       firstbad = -1;
 
-    while ( ( findptr = strchr(startptr, '%') ) ) {
-        /* Execute regular expression */
-        rxret = regexec(&percnum, startptr, 0, NULL, 0);
-        if (!rxret) {
-            superdebug("RegEx percnum matched, %s\n", findptr);
-            findptr = index(startptr, '%');
-            if ( ! findptr ) {
-                fprintf(stderr, "RegEx found percent, index() could not.");
-                exit(5);
-            }
-            strncpy( buffer, findptr, 3 );
-            buffer[3] = '\0';
-            charhex = (int) strtol( buffer + 1, NULL, 16 );
-            buffer2[0] = (char) charhex;
-            buffer2[1] = '\0';
-            replaceString(startptr, buffer, buffer2, str_len(startptr) );
-            startptr = findptr + 1;
-            repcx++;
-        }
-        else if (REG_NOMATCH == rxret) {
-            // extradebug("RegEx for percnum DID NOT match, [%s]\n", value);
-            for ( int cx = 0; cx < (findptr - str); cx++ ) {
-                buffer2[cx] = ' ';
-            }
-            buffer2[findptr - str] = '\0';
-            strcpy(buffer2 + str_len(buffer2), "^ found here");
-            mywarning("%s: %% without hex found in string:\n[%s]\n:%s\n"
-                    , "URIunescape", str, buffer2);
-            startptr = findptr + 1;
-        }
-        else {
-            regerror(rxret, &percnum, buffer2, sizeof(buffer2));
-            fprintf(stderr, "Regex match failed: %s\n", buffer2);
-            exit(5);
+    strkPercentDecode(str, str_len(str), &repcx, &firstbad);
+
+    if ( 0 <= firstbad ) {
+        if ( firstbad < ( BUFSIZ - 16 ) ) {
+            memset(buffer2, ' ', firstbad);
+            strcpy(buffer2 + firstbad, "^ found here");
         }
+        mywarning("%s: %% without hex found in string:\n[%s]\n:%s\n"
+                , "URIunescape", str, buffer2);
     }
-    regfree(&percnum);
     return(repcx);
 }
 
@@ -152,31 +98,21 @@ char *
 prependString(char *str, const char *pre, size_t max)
 {
     char     *fname = "prependString";
-    char   *buffer = NULL;
-    size_t    bsiz = 0;
+    size_t     slen = str_len(str);
+    size_t     plen = str_len(pre);
 
     superdebug("%s: Start\n[%s]\nsearch=[%s]\nmax=[%li]\n"
                 , fname, str, pre, max);
 
     // Adding "/" and room for a terminating null character.
-    bsiz = ( 2 + str_len(str) + str_len(pre) );
-
-    if ( bsiz > max ) {
+    if ( ( 2 + slen + plen ) > max ) {
         mywarning("_prepend_string: Unable to insert path replacement: %s\n"
                 , "buffer not big enough" );
         exit(6);
     }
 
-    if ( NULL == ( buffer = malloc(bsiz) ) ) {
-        mywarning("_prepend_string: Memory: %s\n"
-                , strerror(errno) );
-        exit(6);
-    }
-
-    strncpy(buffer, pre, bsiz);
-    strncpy(buffer + str_len(buffer), str, bsiz - str_len(buffer));
-    strncpy(str, buffer, max);
-    free(buffer);
+    memmove(str + plen, str, slen + 1);
+    memcpy(str, pre, plen);
     return str;
 }
 
@@ -185,33 +121,14 @@ int
 removeStringIdx(char *str, size_t index, size_t ssz)
 {
     // char       *fname = "removeStringIdx";
-    int         advance = 0;
-    int         dozero = 0;
-    size_t      cx = 0;
+    size_t      len = strnlen(str, ssz);
 
-    for ( cx = 0; cx < ssz; cx++ ) {
-        if ( dozero ) {
-            str[cx] = (char)0;
-        }
-        else {
-            if ( (char)0 == str[cx+advance] ) {
-                dozero = 1;
-            }
-            else {
-                if ( cx == index ) {
-                    advance++;
-                }
-                if ( advance ) {
-                    str[cx] = str[cx+advance];
-                    str[cx+1] = (char)0;
-                    if ( 0 == str[cx] ) {
-                        dozero = 1;
-                    }
-                }
-            }
-        }
+    if ( index >= len ) {
+        return 0;
     }
-    return( advance );
+    // Everything after index, and the NUL, moves down one.
+    memmove(str + index, str + index + 1, len - index);
+    return 1;
 }
 
 int
@@ -219,11 +136,9 @@ removeString(char *str, const char *needle, size_t ssz)
 {
     char       *fname = "removeString";
     char       *found = NULL;
-    int            cx = 0;
-    int            dx = 0;
-    int       removed = 0;
-    int       fulllen = str_len(str);
-    int        outlen = str_len(needle);
+    size_t    fulllen = str_len(str);
+    size_t     outlen = str_len(needle);
+    size_t       tail = 0;
 
     superdebug("%s: Start\n[%s]\nsearch=[%s]\nmax=[%li]\n"
                 , fname, str, needle, ssz);
@@ -231,18 +146,12 @@ removeString(char *str, const char *needle, size_t ssz)
     if ( NULL != ( found = str_strn(str, needle, ssz) ) ) {
         superdebug("%s: found = [%x]\n"
                 , fname, found);
-        for ( cx = (found - str), dx = (cx + outlen)
-                ; dx <= fulllen
-                ; cx++, dx++
-            ) {
-            str[cx] = str[dx];
-            removed++;
-        }
-        for ( ; cx < dx; cx++ ) {
-            str[cx] = '\0';
-        }
+        // Bytes moved down, counting the NUL (so never 0 when found).
+        tail = fulllen - ( found - str ) - outlen + 1;
+        memmove(found, found + outlen, tail);
+        return (int) tail;
     }
-    return removed;
+    return 0;
 }
 
 
@@ -539,55 +448,31 @@ randomUTarray(UT_array *orig)
     utarray_free(copy);
 }
 
+/****************************************************************************
+ * First needle in haystack that starts no later than len.
+ */
 char *
 str_strn(const char *haystack, const char *needle, size_t len)
 {
     char *fname = "str_strn";
-    char   *hay = (char *)haystack;
-    char   *nee = (char *)needle;
-    char  start = needle[0];
-    int   index = 0;
-    int   match = 0;
-    /* Needle must start by this point in haystack */
-    int within = str_len(hay) - str_len(nee);
+    size_t hlen = str_len(haystack);
+    size_t nlen = str_len(needle);
+    const char *found = NULL;
 
     superdebug("%s: Start\nhaystack=[%s]\nneedle=[%s]\nmax=[%li]\n"
-                , fname, hay, nee, len);
+                , fname, haystack, needle, len);
 
-    if ( 0 > within ) {
-        /* Needle is longer than haystack */
-        superdebug("%s: Needle is longer than haystack\n", fname);
-        return NULL;
-    }
-
-    if ( len < within ) {
-        /* Use len ONLY if it is shorter than within */
-        superdebug("%s: Restricting search to supplied max.\n", fname);
-        within = len;
-    }
-
-    if ( len < str_len(nee) ) {
+    if ( len < nlen ) {
         superdebug("%s: Needle (%li) is longer than max length (%li)\n"
-                    , fname, str_len(nee), len);
+                    , fname, nlen, len);
         return NULL;
     }
-
-    while ( 0 == match ) {
-        index = str_chr(hay, start);
-        if ( within < index ) {
-            superdebug("%s: First char (%c) was not found in (%x) [%s] by pos [%li]\n"
-                    , fname, start, hay, hay, within);
-            return NULL;
-        }
-        superdebug("%s: First char (%c) was found in (%x) [%s] at pos %li\n"
-               , fname, start, hay, hay, index);
-        hay = hay + index;
-        within = within - index;
-        if ( 0 == ( match = str_start(hay, nee) ) ) {
-            hay++;
-        }
+    if ( ( len + nlen ) < hlen ) {
+        /* Use len ONLY if it is shorter than the haystack */
+        hlen = len + nlen;
     }
-    return hay;
+    found = strkStr(haystack, hlen, needle, nlen);
+    return (char *) found;
 }
 
 /**